@@ -0,0 +1,301 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+*                                                                            *
+*  Author: Aria Seiler                                                       *
+*                                                                            *
+*  This program is in the public domain. There is no implied warranty, so    *
+*  use it at your own risk.                                                  *
+*                                                                            *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifdef INCLUDE_HEADER
+
+// A job is a function and its parameter. Jobs are pushed in batches along with
+// a counter, which is incremented by the batch size and decremented as each
+// job finishes. Waiting on the counter is how dependencies are expressed, and
+// the waiting thread runs other jobs in the meantime, so a job is free to fan
+// out and wait on its own batch.
+typedef struct platform_job {
+	void (*Func)(vptr Param);
+	vptr Param;
+} platform_job;
+
+typedef struct job_counter {
+	u32 Value;
+
+	// Threads blocked in Platform_WaitForCounter, so finishing a job only has
+	// to make a syscall when someone is actually asleep.
+	u32 WaiterCount;
+} job_counter;
+
+#define PLATFORM_JOB_FUNCS \
+	EXPORT(void, Platform_RunJobs,        platform_job *Jobs, u32 JobCount, job_counter *Counter) \
+	EXPORT(void, Platform_WaitForCounter, job_counter *Counter, u32 Target) \
+	EXPORT(u32,  Platform_GetWorkerCount, void) \
+	INTERN(void, Platform_InitJobs,       void) \
+	INTERN(void, Platform_DeinitJobs,     void) \
+	//
+
+#endif
+
+#ifdef INCLUDE_SOURCE
+
+#define JOB_QUEUE_CAPACITY 4096
+#define JOB_MAX_WORKERS	   63
+#define JOB_SPIN_COUNT	   256
+
+typedef struct job_entry {
+	platform_job Job;
+	job_counter *Counter;
+} job_entry;
+
+// A Chase-Lev deque. The owning thread pushes and pops at the bottom, and any
+// other thread can steal from the top. The capacity is fixed, so if a queue
+// is full, the job is run immediately instead.
+typedef struct job_queue {
+	volatile s64 Top;
+	u08			 _Padding0[56];
+
+	volatile s64 Bottom;
+	u08			 _Padding1[56];
+
+	job_entry Entries[JOB_QUEUE_CAPACITY];
+} job_queue;
+
+typedef struct job_system {
+	// The main thread owns the first queue, and workers own the rest.
+	job_queue	 *Queues;
+	u32			  QueueCount;
+	thread_handle Workers[JOB_MAX_WORKERS];
+
+	volatile b08 Running;
+
+	// Idle workers sleep on Signal, which is bumped whenever jobs are pushed.
+	u32 Signal;
+	u32 SleeperCount;
+} job_system;
+
+internal job_system JobSystem;
+
+internal b08
+Platform_PushJob(job_queue *Queue, job_entry Entry)
+{
+	s64 Bottom = Queue->Bottom;
+	s64 Top	   = Queue->Top;
+	if (Bottom - Top >= JOB_QUEUE_CAPACITY) return FALSE;
+
+	Queue->Entries[Bottom & (JOB_QUEUE_CAPACITY - 1)] = Entry;
+	__asm__ volatile("" ::: "memory");
+	Queue->Bottom = Bottom + 1;
+	return TRUE;
+}
+
+internal b08
+Platform_PopJob(job_queue *Queue, job_entry *EntryOut)
+{
+	// The store to Bottom has to be visible before Top is read, otherwise a
+	// thief could take the last job at the same time.
+	s64 Bottom = Queue->Bottom - 1;
+	Intrin_Exchange64((u64 *) &Queue->Bottom, Bottom);
+	s64 Top = Queue->Top;
+
+	if (Top > Bottom) {
+		Queue->Bottom = Bottom + 1;
+		return FALSE;
+	}
+
+	*EntryOut = Queue->Entries[Bottom & (JOB_QUEUE_CAPACITY - 1)];
+	if (Top != Bottom) return TRUE;
+
+	// This was the last job, so race any thieves for it.
+	b08 Won = Intrin_CompareExchange64((u64 *) &Queue->Top, Top, Top + 1) == Top;
+	Queue->Bottom = Bottom + 1;
+	return Won;
+}
+
+internal b08
+Platform_StealJob(job_queue *Queue, job_entry *EntryOut)
+{
+	s64 Top = Queue->Top;
+	__asm__ volatile("" ::: "memory");
+	s64 Bottom = Queue->Bottom;
+	if (Top >= Bottom) return FALSE;
+
+	*EntryOut = Queue->Entries[Top & (JOB_QUEUE_CAPACITY - 1)];
+	return Intrin_CompareExchange64((u64 *) &Queue->Top, Top, Top + 1) == Top;
+}
+
+internal job_queue *
+Platform_GetJobQueue(void)
+{
+	u32 Index = Platform_GetThreadContextFast()->JobQueue;
+	if (!Index) return NULL;
+	return JobSystem.Queues + Index - 1;
+}
+
+internal b08
+Platform_FindJob(job_queue *Queue, u32 *Seed, job_entry *EntryOut)
+{
+	if (Queue && Platform_PopJob(Queue, EntryOut)) return TRUE;
+
+	// Start from a random victim so thieves don't all pile onto one queue.
+	*Seed ^= *Seed << 13;
+	*Seed ^= *Seed >> 17;
+	*Seed ^= *Seed << 5;
+
+	u32 Start = *Seed % JobSystem.QueueCount;
+	for (u32 I = 0; I < JobSystem.QueueCount; I++) {
+		job_queue *Victim = JobSystem.Queues + (Start + I) % JobSystem.QueueCount;
+		if (Victim != Queue && Platform_StealJob(Victim, EntryOut)) return TRUE;
+	}
+
+	return FALSE;
+}
+
+internal void
+Platform_ExecuteJob(job_entry Entry)
+{
+	if (_G.UtilIsLoaded) Stack_Push();
+	Entry.Job.Func(Entry.Job.Param);
+	if (_G.UtilIsLoaded) Stack_Pop();
+
+	// The locked add orders the decrement before the waiter check, which pairs
+	// with the waiter registering before its last look at the value.
+	if (Entry.Counter) {
+		Intrin_AtomicAdd32(&Entry.Counter->Value, -1);
+		if (((volatile job_counter *) Entry.Counter)->WaiterCount)
+			Platform_WakeOnAddress(&Entry.Counter->Value, S32_MAX);
+	}
+}
+
+internal void
+Platform_RunJobs(platform_job *Jobs, u32 JobCount, job_counter *Counter)
+{
+	Assert(Jobs || !JobCount);
+	if (!JobCount) return;
+
+	if (Counter) Intrin_AtomicAdd32(&Counter->Value, JobCount);
+
+	// Threads outside of the pool have no queue, so they just run the jobs.
+	job_queue *Queue = Platform_GetJobQueue();
+	for (u32 I = 0; I < JobCount; I++) {
+		job_entry Entry = { Jobs[I], Counter };
+		if (!Queue || !Platform_PushJob(Queue, Entry)) Platform_ExecuteJob(Entry);
+	}
+
+	// The locked add orders the pushes before the sleeper check, which pairs
+	// with the worker registering as a sleeper before its last look around.
+	Intrin_AtomicAdd32(&JobSystem.Signal, 1);
+	if (JobSystem.SleeperCount)
+		Platform_WakeOnAddress(&JobSystem.Signal, JobCount);
+}
+
+internal void
+Platform_WaitForCounter(job_counter *Counter, u32 Target)
+{
+	Assert(Counter);
+
+	job_queue *Queue	 = Platform_GetJobQueue();
+	u32		   Seed		 = Platform_GetThreadId(NULL) | 1;
+	u32		   SpinCount = 0;
+
+	// Help out while there's work to be found, and once there hasn't been for a
+	// while, sleep until one of the remaining jobs finishes.
+	u32 Value;
+	while ((Value = ((volatile job_counter *) Counter)->Value) > Target) {
+		job_entry Entry;
+		if (Platform_FindJob(Queue, &Seed, &Entry)) {
+			Platform_ExecuteJob(Entry);
+			SpinCount = 0;
+		} else if (++SpinCount < JOB_SPIN_COUNT) {
+			Intrin_Pause();
+		} else {
+			Intrin_AtomicAdd32(&Counter->WaiterCount, 1);
+			Value = ((volatile job_counter *) Counter)->Value;
+			if (Value > Target) Platform_WaitOnAddress(&Counter->Value, Value);
+			Intrin_AtomicAdd32(&Counter->WaiterCount, -1);
+			SpinCount = 0;
+		}
+	}
+}
+
+internal u32
+Platform_GetWorkerCount(void)
+{ return JobSystem.QueueCount - 1; }
+
+internal s32
+Platform_WorkerEntry(vptr Param)
+{
+	u32 QueueIndex = (u32) (usize) Param;
+	Platform_GetThreadContextFast()->JobQueue = QueueIndex + 1;
+
+	job_queue *Queue = JobSystem.Queues + QueueIndex;
+	u32		   Seed	 = QueueIndex * 0x9E3779B9 | 1;
+
+	while (JobSystem.Running) {
+		job_entry Entry;
+		b08		  Found = FALSE;
+		for (u32 I = 0; I < JOB_SPIN_COUNT && !Found; I++) {
+			Found = Platform_FindJob(Queue, &Seed, &Entry);
+			if (!Found) Intrin_Pause();
+		}
+
+		if (!Found) {
+			u32 Signal = ((volatile u32 *) &JobSystem.Signal)[0];
+			Intrin_AtomicAdd32(&JobSystem.SleeperCount, 1);
+			Found = Platform_FindJob(Queue, &Seed, &Entry);
+			if (!Found && JobSystem.Running)
+				Platform_WaitOnAddress(&JobSystem.Signal, Signal);
+			Intrin_AtomicAdd32(&JobSystem.SleeperCount, -1);
+		}
+
+		if (Found) Platform_ExecuteJob(Entry);
+	}
+
+	return 0;
+}
+
+internal void
+Platform_InitJobs(void)
+{
+	u32 ProcessorCount = Platform_GetProcessorCount();
+	u32 WorkerCount	   = MIN(ProcessorCount - 1, JOB_MAX_WORKERS);
+
+	JobSystem.QueueCount = WorkerCount + 1;
+	JobSystem.Queues =
+		Platform_AllocateMemory(JobSystem.QueueCount * sizeof(job_queue));
+	JobSystem.Running = TRUE;
+
+	Platform_GetThreadContextFast()->JobQueue = 1;
+
+	// The main thread is left unpinned, and each worker gets a processor.
+	for (u32 I = 0; I < WorkerCount; I++) {
+		thread_handle *Worker = JobSystem.Workers + I;
+		b08 Created = Platform_CreateThread(
+			Worker,
+			Platform_WorkerEntry,
+			(vptr) (usize) (I + 1)
+		);
+		Assert(Created, "Failed to create a job worker");
+		Platform_PinThread(Worker, I + 1);
+	}
+}
+
+internal void
+Platform_DeinitJobs(void)
+{
+	JobSystem.Running = FALSE;
+	Intrin_AtomicAdd32(&JobSystem.Signal, 1);
+	Platform_WakeOnAddress(&JobSystem.Signal, S32_MAX);
+
+	for (u32 I = 0; I < JobSystem.QueueCount - 1; I++)
+		Platform_JoinThread(JobSystem.Workers[I]);
+
+	Platform_FreeMemory(
+		JobSystem.Queues,
+		JobSystem.QueueCount * sizeof(job_queue)
+	);
+	Platform_GetThreadContextFast()->JobQueue = 0;
+	JobSystem = (job_system){ 0 };
+}
+
+#endif
@@ -21,12 +21,12 @@ __asm__(
 	"	                           \n"
 	".globl Platform_ThreadThunk   \n"
 	"Platform_ThreadThunk:         \n"
-	"	pop %rsi                   \n"
 	"	pop %rdi                   \n"
-	"	pop %rax                   \n"
+	"	pop %rsi                   \n"
+	"	pop %rdx                   \n"
 	"	sub $16, %rsp              \n"
 	"	mov %rsp, %rbp             \n"
-	"	call *%rax                 \n"
+	"	call Platform_ThreadEntry  \n"
 	"	mov %rax, %rdi             \n"
 	"	call Sys_Exit              \n"
 	"	ud2                        \n"
@@ -48,6 +48,8 @@ extern s32 Platform_ThreadThunk(void);
 
 global sys_timespec ClockResolution;
 
+internal platform_thread_context MainThreadContext;
+
 internal opengl_funcs OpenGLFuncs;
 
 internal opengl_funcs *
@@ -93,6 +95,41 @@ Platform_AllocateMemory(u64 Size)
 	return Address;
 }
 
+// Reserved memory takes up address space, but can't be touched until it's
+// committed. Freeing it releases the whole reservation.
+internal vptr
+Platform_ReserveMemory(u64 Size)
+{
+	vptr Address = Sys_MemMap(
+		NULL,
+		Size,
+		SYS_PROT_NONE,
+		SYS_MAP_PRIVATE | SYS_MAP_ANONYMOUS | SYS_MAP_NORESERVE,
+		SYS_FILE_NONE,
+		0
+	);
+	VALIDATE(Address, "Failed to reserve memory");
+	return Address;
+}
+
+internal void
+Platform_CommitMemory(vptr Base, u64 Size)
+{
+	s32 Result = Sys_MemProtect(Base, Size, SYS_PROT_READ | SYS_PROT_WRITE);
+	VALIDATE(Result, "Failed to commit memory");
+}
+
+// The pages are handed back to the system, and read as zero once they're
+// committed again.
+internal void
+Platform_DecommitMemory(vptr Base, u64 Size)
+{
+	s32 Result = Sys_MemAdvise(Base, Size, SYS_MADV_DONTNEED);
+	VALIDATE(Result, "Failed to decommit memory");
+	Result = Sys_MemProtect(Base, Size, SYS_PROT_NONE);
+	VALIDATE(Result, "Failed to decommit memory");
+}
+
 internal void
 Platform_FreeMemory(vptr Base, u64 Size)
 { VALIDATE(Sys_MemUnmap(Base, Size), "Failed to unmap memory"); }
@@ -106,6 +143,31 @@ Platform_GetFileLength(file_handle FileHandle)
 	return Stat.Size;
 }
 
+// The mapping is read only, and shared with the page cache.
+internal vptr
+Platform_MapFile(file_handle FileHandle, u64 Length)
+{
+	if (!Length) return NULL;
+
+	vptr Address = Sys_MemMap(
+		NULL,
+		Length,
+		SYS_PROT_READ,
+		SYS_MAP_PRIVATE,
+		FileHandle.FileDescriptor,
+		0
+	);
+	VALIDATE(Address, "Failed to map the file");
+	return Address;
+}
+
+internal void
+Platform_UnmapFile(vptr Base, u64 Length)
+{
+	if (!Base) return;
+	VALIDATE(Sys_MemUnmap(Base, Length), "Failed to unmap the file");
+}
+
 internal b08
 Platform_CreateThread(
 	thread_handle *ThreadHandle,
@@ -116,23 +178,39 @@ Platform_CreateThread(
 	usize StackSize = 8 * 1024 * 1024;
 	vptr  Stack		= Platform_AllocateMemory(StackSize);
 
+	// The kernel writes the thread id into the context before clone returns,
+	// then clears it and wakes any futex waiters once the thread exits.
 	sys_clone_flags Flags = SYS_CLONE_FILES
 						  | SYS_CLONE_FS
 						  | SYS_CLONE_IO
 						  | SYS_CLONE_SIGHAND
 						  | SYS_CLONE_THREAD
-						  | SYS_CLONE_VM;
+						  | SYS_CLONE_VM
+						  | SYS_CLONE_PARENT_SETTID
+						  | SYS_CLONE_CHILD_CLEARTID;
+
+	// The thread's context lives at the very top of its stack, so it's freed
+	// along with it.
+	platform_thread_context *Context =
+		(platform_thread_context *) (Stack + StackSize) - 1;
 
 #ifdef _X64
-	vptr  StackTop = Stack + StackSize - 4 * sizeof(vptr);
+	// The ABI wants the stack 16 byte aligned, whatever the context's size.
+	vptr  StackTop = (vptr) ((usize) Context & ~(usize) 15) - 4 * sizeof(vptr);
 	vptr *Words	   = StackTop;
-	Words[3]	   = Callback;
-	Words[2]	   = UserData;
-	Words[1]	   = 0;
+	Words[3]	   = UserData;
+	Words[2]	   = Callback;
+	Words[1]	   = Context;
 	Words[0]	   = Platform_ThreadThunk;
 #endif
 
-	sys_pid ProcessId = Sys_Clone(Flags, StackTop, NULL, 0, NULL);
+	sys_pid ProcessId = Sys_Clone(
+		Flags,
+		StackTop,
+		&Context->ThreadId,
+		&Context->ThreadId,
+		0
+	);
 	if (ProcessId < 0) return FALSE;
 
 	*ThreadHandle = (thread_handle){
@@ -143,38 +221,201 @@ Platform_CreateThread(
 	return TRUE;
 }
 
+internal void
+Platform_InitThreadContext(platform_thread_context *Context)
+{
+	Context->Self	  = Context;
+	Context->ThreadId = Sys_GetTid();
+#ifndef _USE_LOADER
+	// The platform's own threads share the main thread's FS base, since clone
+	// doesn't give them one, but libc gives every thread it starts its own.
+	Context->ThreadPointer = Intrin_ReadFSQWord(0);
+#endif
+	VALIDATE(
+		Sys_ArchPrctl(SYS_ARCH_SET_GS, (usize) Context),
+		"Failed to set the thread context"
+	);
+}
+
+// What util keeps in the thread slots would leak once the thread is gone.
+internal void
+Platform_ReleaseThreadSlots(void)
+{
+	if (!_G.UtilIsLoaded) return;
+	Heap_ReleaseThreadCache();
+	Stack_Release();
+}
+
+external s32
+Platform_ThreadEntry(
+	platform_thread_context *Context,
+	s32 (*Callback)(vptr UserData),
+	vptr UserData
+)
+{
+	// Clone copies the parent's GS base, so this has to happen before the
+	// callback touches any thread slots.
+	Platform_InitThreadContext(Context);
+	s32 Result = Callback(UserData);
+	Platform_ReleaseThreadSlots();
+	return Result;
+}
+
+internal platform_thread_context *
+Platform_GetThreadContext(void)
+{
+	platform_thread_context *Context =
+		(platform_thread_context *) Intrin_ReadGSQWord(0);
+
+#ifndef _USE_LOADER
+	// Threads started outside the platform, e.g. by a driver, still have the
+	// GS base they inherited from their parent, so they get a context of their
+	// own here. The parent's context has to outlive them, so threads started
+	// from a platform thread can't outlive it.
+	if (Context->ThreadPointer != Intrin_ReadFSQWord(0)) {
+		Context = Platform_AllocateMemory(sizeof(platform_thread_context));
+		Platform_InitThreadContext(Context);
+	}
+#endif
+
+	return Context;
+}
+
+// Frees the context a thread the platform didn't start was given, along with
+// what util keeps in its slots. Nothing tells us when those threads exit, so
+// they have to call this themselves before they do. It does nothing for the
+// platform's own threads.
+internal void
+Platform_ReleaseThreadContext(void)
+{
+#ifndef _USE_LOADER
+	platform_thread_context *Context =
+		(platform_thread_context *) Intrin_ReadGSQWord(0);
+	if (Context->ThreadPointer != Intrin_ReadFSQWord(0)) return;
+	if (Context->ThreadPointer == MainThreadContext.ThreadPointer) return;
+
+	Platform_ReleaseThreadSlots();
+
+	// The main thread's context never goes away, and won't match this thread
+	// if it asks for a context again.
+	VALIDATE(
+		Sys_ArchPrctl(SYS_ARCH_SET_GS, (usize) &MainThreadContext),
+		"Failed to reset the thread context"
+	);
+	Platform_FreeMemory(Context, sizeof(platform_thread_context));
+#endif
+}
+
 internal b08
 Platform_JoinThread(thread_handle ThreadHandle)
 {
-	s32 Status;
-	s32 Result = Sys_Wait4(ThreadHandle.ThreadId, &Status, 0, NULL);
-	if (Result) Platform_FreeMemory(ThreadHandle.Stack, ThreadHandle.StackSize);
-	return !Result;
+	// Threads can't be waited on like child processes, so wait for the kernel
+	// to clear the thread id instead. By then, the stack is no longer in use.
+	platform_thread_context *Context =
+		(platform_thread_context *) (ThreadHandle.Stack + ThreadHandle.StackSize)
+		- 1;
+
+	s32 ThreadId;
+	while ((ThreadId = ((volatile s32 *) &Context->ThreadId)[0])) {
+		s32 Result =
+			Sys_Futex((u32 *) &Context->ThreadId, SYS_FUTEX_WAIT, ThreadId, 0, 0, 0);
+		if (Result < 0 && Result != -SYS_EAGAIN && Result != -SYS_EINTR)
+			return FALSE;
+	}
+
+	Platform_FreeMemory(ThreadHandle.Stack, ThreadHandle.StackSize);
+	return TRUE;
 }
 
 internal void
-Platform_LockMutex(u32 *Mutex)
+Platform_PinThread(thread_handle *ThreadHandle, u32 Processor)
 {
-	Assert(Mutex);
+	u64 Mask[16] = { 0 };
+	s32 Result	 = Sys_GetAffinity(0, sizeof(Mask), Mask);
+	if (Result < 0) return;
+
+	// Count through the processors we're allowed to run on, and wrap around
+	// if there are more threads than processors.
+	u32 Count = Platform_GetProcessorCount();
+	Processor %= Count;
+
+	for (u32 I = 0; I < sizeof(Mask) * 8; I++) {
+		if (!(Mask[I / 64] & (1ull << (I % 64)))) continue;
+		if (Processor--) continue;
+
+		u64 Pinned[16]	= { 0 };
+		Pinned[I / 64] |= 1ull << (I % 64);
+		Sys_SetAffinity(ThreadHandle->ThreadId, sizeof(Pinned), Pinned);
+		return;
+	}
+}
 
-	s32 Tid = Sys_GetTid();
+internal u32
+Platform_GetProcessorCount(void)
+{
+	u64 Mask[16] = { 0 };
+	s32 Result	 = Sys_GetAffinity(0, sizeof(Mask), Mask);
+	if (Result < 0) return 1;
 
-	while (1) {
-		// If it's unlocked, lock it and return.
-		s32 OldValue = Intrin_CompareExchange32(Mutex, 0, 1);
-		if (OldValue == 0) break;
+	u32 Count = 0;
+	for (u32 I = 0; I < 16; I++) Count += Intrin_Popcount64(Mask[I]);
+	return MAX(Count, 1);
+}
+
+internal void
+Platform_WaitOnAddress(u32 *Address, u32 Value)
+{
+	s32 Result = Sys_Futex(
+		Address,
+		SYS_FUTEX_WAIT | SYS_FUTEX_PRIVATE_FLAG,
+		Value,
+		NULL,
+		NULL,
+		0
+	);
+	if (Result < 0) Assert(Result == -SYS_EAGAIN || Result == -SYS_EINTR);
+}
+
+internal void
+Platform_WakeOnAddress(u32 *Address, u32 Count)
+{
+	Sys_Futex(
+		Address,
+		SYS_FUTEX_WAKE | SYS_FUTEX_PRIVATE_FLAG,
+		Count,
+		NULL,
+		NULL,
+		0
+	);
+}
 
-		// Attempt to set it to contended. If it was unlocked between then and
-		// now, go back and attempt to re-lock it.
-		OldValue = Intrin_CompareExchange32(Mutex, 1, 2);
-		if (OldValue == 0) continue;
+internal void
+Platform_LockMutex(u32 *Mutex)
+{
+	Assert(Mutex);
 
-		// The lock is contended, so we'll sleep on it. If it was unlocked (and
-		// potentially re-locked) between then and now, futex will return EAGAIN
-		// immediately and we'll try again. Otherwise, we'll sleep until WAKE is
-		// signalled, at which point we'll try again.
-		s32 Result = Sys_Futex(Mutex, SYS_FUTEX_WAIT, 2, NULL, NULL, 0);
-		if (Result < 0) Assert(Result == -SYS_EAGAIN);
+	// 0 is unlocked, 1 is locked, and 2 is locked with possible sleepers. If
+	// it's unlocked, lock it and return.
+	u32 OldValue = Intrin_CompareExchange32(Mutex, 0, 1);
+	if (OldValue == 0) return;
+
+	// Otherwise, mark it as contended and sleep until it's unlocked. Once
+	// anyone has slept on it, it has to be taken as contended too, since
+	// taking it as 1 would make the next unlock skip the wake and strand the
+	// remaining sleepers. If it was unlocked (and potentially re-locked)
+	// before the wait, futex returns EAGAIN immediately and we try again.
+	if (OldValue != 2) OldValue = Intrin_Exchange32(Mutex, 2);
+	while (OldValue != 0) {
+		s32 Result = Sys_Futex(
+			Mutex,
+			SYS_FUTEX_WAIT | SYS_FUTEX_PRIVATE_FLAG,
+			2,
+			NULL,
+			NULL,
+			0
+		);
+		if (Result < 0) Assert(Result == -SYS_EAGAIN || Result == -SYS_EINTR);
+		OldValue = Intrin_Exchange32(Mutex, 2);
 	}
 }
 
@@ -182,14 +423,22 @@ internal void
 Platform_UnlockMutex(u32 *Mutex)
 {
 	Assert(Mutex);
-	s32 Tid = Sys_GetTid();
 
 	// Unlock the mutex.
 	s32 OldValue = Intrin_Exchange32(Mutex, 0);
 	Assert(OldValue != 0);
 
 	// If it was contended, wake up a sleeping thread that was waiting on it.
-	if (OldValue == 2) Sys_Futex(Mutex, SYS_FUTEX_WAKE, 1, NULL, NULL, 0);
+	if (OldValue == 2) {
+		Sys_Futex(
+			Mutex,
+			SYS_FUTEX_WAKE | SYS_FUTEX_PRIVATE_FLAG,
+			1,
+			NULL,
+			NULL,
+			0
+		);
+	}
 }
 
 internal b08
@@ -342,7 +591,7 @@ internal s32
 Platform_GetThreadId(thread_handle *ThreadHandle)
 {
 	if (ThreadHandle) return ThreadHandle->ThreadId;
-	return Sys_GetTid();
+	return Platform_GetThreadContextFast()->ThreadId;
 }
 
 internal b08
@@ -373,7 +622,7 @@ Platform_CloseModuleBackend(platform_module *Module)
 internal void
 Platform_Exit(u32 ExitCode)
 {
-	Sys_Exit(ExitCode);
+	Sys_ExitGroup(ExitCode);
 	UNREACHABLE;
 }
 
@@ -388,13 +637,11 @@ Platform_SetupArgTable(usize ArgCount, c08 **Args)
 internal void
 Platform_SetupEnvTable(usize EnvCount, c08 **EnvParams)
 {
-	_G.EnvTable = HashMap_InitCustom(
+	_G.EnvTable = FlatMap_InitCustom(
 		_G.Heap,
 		sizeof(string),
 		sizeof(string),
-		EnvCount * 2,
-		0.5f,
-		2.0f,
+		EnvCount,
 		(hash_func) String_HashPtr,
 		NULL,
 		(cmp_func) String_CmpPtr,
@@ -411,7 +658,7 @@ Platform_SetupEnvTable(usize EnvCount, c08 **EnvParams)
 		string Value =
 			CLEString(Param + KeySize + 1, ValueSize, STRING_ENCODING_ASCII);
 
-		HashMap_Add(&_G.EnvTable, &Key, &Value);
+		FlatMap_Add(&_G.EnvTable, &Key, &Value);
 	}
 }
 
@@ -449,6 +696,8 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 	};
 	_G.Funcs = &_F;
 
+	Platform_InitThreadContext(&MainThreadContext);
+
 	VALIDATE(
 		Sys_GetClockRes(SYS_CLOCK_REALTIME, &ClockResolution),
 		"Failed to get clock resolution"
@@ -462,6 +711,7 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 	Platform_LoadModule(UTIL_MODULE_NAME);
 	Platform_SetupArgTable(ArgCount, Args);
 	Platform_SetupEnvTable(EnvCount, EnvParams);
+	Platform_InitJobs();
 
 	Platform_LoadDependencies();
 
@@ -469,9 +719,8 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 
 	timestamp StartTime = Platform_GetTimestamp();
 
-	HASHMAP_FOREACH (
+	FLATMAP_FOREACH (
 		I,
-		Hash,
 		string,
 		Key,
 		platform_module *,
@@ -488,9 +737,8 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 	Platform_WriteConsole(CStringL("Completed initialization!\n"));
 
 	while (_G.ExecutionState == EXECUTION_RUNNING) {
-		HASHMAP_FOREACH (
+		FLATMAP_FOREACH (
 			I,
-			Hash,
 			string,
 			Key,
 			platform_module *,
@@ -505,9 +753,8 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 		}
 	}
 
-	HASHMAP_FOREACH (
+	FLATMAP_FOREACH (
 		I,
-		Hash,
 		string,
 		Key,
 		platform_module *,
@@ -522,8 +769,10 @@ Platform_CEntry(usize ArgCount, c08 **Args, c08 **EnvParams)
 		Platform_UnloadModule(Module);
 	}
 
+	Platform_DeinitJobs();
+
 	Heap_FreeA(_G.Args);
-	HashMap_Free(&_G.EnvTable);
+	FlatMap_Free(&_G.EnvTable);
 
 	Stack_Pop();
 	Platform_Exit(0);
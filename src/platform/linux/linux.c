@@ -44,6 +44,11 @@ typedef enum sys_map {
 	SYS_MAP_UNINITIALIZED = 0x4000000,
 } sys_map;
 
+typedef enum sys_madvise {
+	SYS_MADV_NORMAL	  = 0,
+	SYS_MADV_DONTNEED = 4,
+} sys_madvise;
+
 typedef enum sys_errno {
 	SYS_EPERM	= 1,  /* Operation not permitted */
 	SYS_ENOENT	= 2,  /* No such file or directory */
@@ -86,22 +91,22 @@ typedef enum sys_errno {
 	SYS_ENOSYS		 = 38, /* Invalid system call number */
 } sys_errno;
 
-#define SYS_OPEN_READONLY  0x0000
-#define SYS_OPEN_WRITEONLY 0x0001
-#define SYS_OPEN_READWRITE 0x0002
-#define SYS_OPEN_CREATE    0x0100
-#define SYS_OPEN_TRUNCATE  0x1000
-#define SYS_OPEN_APPEND    0x2000
-
-#define SYS_CREATE_OTHERS_EXEC  0x00001
-#define SYS_CREATE_OTHERS_WRITE 0x00002
-#define SYS_CREATE_OTHERS_READ  0x00004
-#define SYS_CREATE_GROUP_EXEC   0x00010
-#define SYS_CREATE_GROUP_WRITE  0x00020
-#define SYS_CREATE_GROUP_READ   0x00040
-#define SYS_CREATE_USER_EXEC    0x00100
-#define SYS_CREATE_USER_WRITE   0x00200
-#define SYS_CREATE_USER_READ    0x00400
+#define SYS_OPEN_READONLY  00000
+#define SYS_OPEN_WRITEONLY 00001
+#define SYS_OPEN_READWRITE 00002
+#define SYS_OPEN_CREATE    00100
+#define SYS_OPEN_TRUNCATE  01000
+#define SYS_OPEN_APPEND    02000
+
+#define SYS_CREATE_OTHERS_EXEC  00001
+#define SYS_CREATE_OTHERS_WRITE 00002
+#define SYS_CREATE_OTHERS_READ  00004
+#define SYS_CREATE_GROUP_EXEC   00010
+#define SYS_CREATE_GROUP_WRITE  00020
+#define SYS_CREATE_GROUP_READ   00040
+#define SYS_CREATE_USER_EXEC    00100
+#define SYS_CREATE_USER_WRITE   00200
+#define SYS_CREATE_USER_READ    00400
 
 #define SYS_RUNTIME_LOADER_LAZY     0x0001
 #define SYS_RUNTIME_LOADER_NOW      0x0002
@@ -337,12 +342,14 @@ typedef enum sys_wait_options {
 } sys_wait_options;
 
 typedef enum sys_clone_flags {
-	SYS_CLONE_VM	  = 0x00000100,
-	SYS_CLONE_FS	  = 0x00000200,
-	SYS_CLONE_FILES	  = 0x00000400,
-	SYS_CLONE_SIGHAND = 0x00000800,
-	SYS_CLONE_THREAD  = 0x00010000,
-	SYS_CLONE_IO	  = 0x80000000,
+	SYS_CLONE_VM			 = 0x00000100,
+	SYS_CLONE_FS			 = 0x00000200,
+	SYS_CLONE_FILES			 = 0x00000400,
+	SYS_CLONE_SIGHAND		 = 0x00000800,
+	SYS_CLONE_THREAD		 = 0x00010000,
+	SYS_CLONE_PARENT_SETTID	 = 0x00100000,
+	SYS_CLONE_CHILD_CLEARTID = 0x00200000,
+	SYS_CLONE_IO			 = 0x80000000,
 } sys_clone_flags;
 
 typedef enum sys_futex_op {
@@ -352,6 +359,13 @@ typedef enum sys_futex_op {
 	SYS_FUTEX_PRIVATE_FLAG = 0x80,
 } sys_futex_op;
 
+typedef enum sys_arch_prctl_code {
+	SYS_ARCH_SET_GS = 0x1001,
+	SYS_ARCH_SET_FS = 0x1002,
+	SYS_ARCH_GET_FS = 0x1003,
+	SYS_ARCH_GET_GS = 0x1004,
+} sys_arch_prctl_code;
+
 #ifndef _USE_LOADER
 extern vptr dlopen(c08 *Path, s32 Flags);
 extern vptr dlsym(vptr Handle, c08 *Symbol);
@@ -370,13 +384,14 @@ extern s32	dlclose(vptr Handle);
 	SYSCALL(10,  MemProtect,   s32,     vptr Address, usize Length, s32 Protection) \
 	SYSCALL(11,  MemUnmap,     s32,     vptr Address, usize Length) \
 	SYSCALL(16,  IoCtl,        s32,     s32 FileDescriptor, usize Op, vptr Data) \
+	SYSCALL(28,  MemAdvise,    s32,     vptr Address, usize Length, sys_madvise Advice) \
 	SYSCALL(35,  NanoSleep,    s32,     sys_timespec *Duration, sys_timespec *Rem) \
 	SYSCALL(41,  Socket,       s32,     s32 Domain, s32 Type, s32 Protocol) \
 	SYSCALL(42,  Connect,      s32,     s32 SocketFileDescriptor, sys_sockaddr *Address, u32 AddressLength) \
 	SYSCALL(44,  SendTo,       ssize,   s32 SocketFileDescriptor, vptr Buffer, usize Size, sys_msg_flags Flags, sys_sockaddr *Address, u32 AddressLength) \
 	SYSCALL(46,  SendMsg,      ssize,   s32 SocketFileDescriptor, sys_msghdr *Message, sys_msg_flags Flags) \
 	SYSCALL(47,  RecvMsg,      ssize,   s32 SocketFileDescriptor, sys_msghdr *Message, sys_msg_flags Flags) \
-	SYSCALL(56,  Clone,        sys_pid, sys_clone_flags Flags, vptr Stack, s32 *ParentTidOut, usize TLS, s32 *ChildTidOut) \
+	SYSCALL(56,  Clone,        sys_pid, sys_clone_flags Flags, vptr Stack, s32 *ParentTidOut, s32 *ChildTidOut, usize TLS) \
 	SYSCALL(57,  Fork,         sys_pid, void) \
 	SYSCALL(60,  Exit,         void,    s32 ErrorCode) \
 	SYSCALL(61,  Wait4,        sys_pid, sys_pid ProcessId, s32 *StatusOut, s32 Options, sys_rusage *ResourceUsageOut) \
@@ -384,10 +399,14 @@ extern s32	dlclose(vptr Handle);
 	SYSCALL(76,  Truncate,     s32,     c08 *Path, usize Length) \
 	SYSCALL(77,  FTruncate,    s32,     s32 FileDescriptor, usize Length) \
 	SYSCALL(79,  GetCwd,       s32,     c08 *Buffer, ssize Size) \
+	SYSCALL(158, ArchPrctl,    s32,     sys_arch_prctl_code Code, usize Address) \
 	SYSCALL(186, GetTid,       s32,     void) \
 	SYSCALL(202, Futex,        s32,     u32 *Value, sys_futex_op Op, u32 Target, sys_timespec *Time, u32 *Value2, u32 Target2) \
+	SYSCALL(203, SetAffinity,  s32,     sys_pid ThreadId, usize MaskSize, u64 *Mask) \
+	SYSCALL(204, GetAffinity,  s32,     sys_pid ThreadId, usize MaskSize, u64 *Mask) \
 	SYSCALL(228, GetClockTime, s32,     sys_clock Clock, sys_timespec *Timespec) \
 	SYSCALL(229, GetClockRes,  s32,     sys_clock Clock, sys_timespec *Timespec) \
+	SYSCALL(231, ExitGroup,    void,    s32 ErrorCode) \
 	SYSCALL(319, MemfdCreate,  s32,     c08 *Name, u32 Flags) \
 	SYSCALL(332, StatX,        s32,     s32 Fd, c08 *Path, sys_statx_flags Flags, sys_statx_mask_flags Mask, sys_statx *Stat) \
 	//
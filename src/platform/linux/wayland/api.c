@@ -171,7 +171,7 @@ typedef struct wayland_api_state {
 
 	wayland_api_id_entry *NextIdEntry;
 
-	hashmap IdTable;
+	flatmap IdTable;
 
 	wayland_message_queue MessageQueue;
 	wayland_fd_queue	  FdQueue;
@@ -236,6 +236,9 @@ extern wayland_prototype WaylandZwpLinuxDmabufV1Prototype;
 extern wayland_prototype WaylandZwpLinuxBufferParamsV1Prototype;
 extern wayland_prototype WaylandZwpLinuxDmabufFeedbackV1Prototype;
 
+// Every request and event looks up its object, so the table is typed.
+DEFINE_FLATMAP(Wayland_IdTable, u32, wayland_interface *)
+
 wayland_prototype *WaylandPrototypes[] = {
 	&WaylandBufferPrototype,
 	&WaylandCallbackPrototype,
@@ -317,7 +320,7 @@ internal vptr
 Wayland_GetObject(u32 ObjectId)
 {
 	wayland_interface *Object = NULL;
-	HashMap_Get(&_G.WaylandApi.IdTable, &ObjectId, &Object);
+	Wayland_IdTable_Get(&_G.WaylandApi.IdTable, ObjectId, &Object);
 	return Object;
 }
 
@@ -394,7 +397,7 @@ Wayland_CreateObject(wayland_prototype *Prototype, u32 ObjectId, u32 Version)
 	Object->Size	  = InterfaceSize;
 	Object->Prototype = Prototype;
 
-	HashMap_Add(&_G.WaylandApi.IdTable, &ObjectId, &Object);
+	Wayland_IdTable_Add(&_G.WaylandApi.IdTable, ObjectId, Object);
 	return Object;
 }
 
@@ -404,7 +407,7 @@ Wayland_DestroyObject(vptr Object)
 	wayland_interface *Interface = Object;
 	if (!Interface->Id) return;
 
-	HashMap_Remove(&_G.WaylandApi.IdTable, &Interface->Id, NULL, NULL);
+	Wayland_IdTable_Remove(&_G.WaylandApi.IdTable, Interface->Id, NULL);
 
 	Mem_Set(Interface, 0, Interface->Size);
 	Heap_FreeA(Interface);
@@ -558,8 +561,7 @@ Wayland_Connect(void)
 	_G.WaylandApi.HeapSize = HeapSize;
 	_G.WaylandApi.Heap	   = Heap;
 
-	_G.WaylandApi.IdTable =
-		HashMap_Init(Heap, sizeof(u32), sizeof(wayland_interface *));
+	_G.WaylandApi.IdTable = Wayland_IdTable_Init(Heap, 0);
 
 	s32	   FileDescriptor;
 	string WaylandSocket = Platform_GetEnvParam(CStringL("WAYLAND_SOCKET"));
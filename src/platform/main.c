@@ -31,9 +31,11 @@ global platform_funcs _F;
 #if defined(_WIN32)
 #include <platform/win32/win32.c>
 #include <platform/platform.c>
+#include <platform/job.c>
 #elif defined(_LINUX)
 #include <platform/linux/linux.c>
 #include <platform/platform.c>
+#include <platform/job.c>
 #include <platform/linux/wayland/drm.c>
 #include <platform/linux/wayland/gbm.c>
 #include <platform/linux/wayland/egl.c>
@@ -59,6 +61,7 @@ global platform_funcs _F;
 #define PLATFORM_FUNCS \
 	PLATFORM_SPECIFIC_FUNCS \
 	PLATFORM_SHARED_FUNCS \
+	PLATFORM_JOB_FUNCS \
 	//
 
 struct platform_state {
@@ -71,8 +74,9 @@ struct platform_state {
 	v2s32 CursorPos;
 
 	heap *Heap;
+	u64	  HashSeed;
 
-	hashmap ModuleTable;
+	flatmap ModuleTable;
 
 	v2u32				   WindowSize;
 	struct platform_funcs *Funcs;
@@ -87,7 +91,7 @@ struct platform_state {
 	usize	ArgCount;
 	string *Args;
 
-	hashmap EnvTable;
+	flatmap EnvTable;
 
 #if defined(_LINUX)
 	wayland_api_state WaylandApi;
@@ -109,6 +113,28 @@ typedef struct platform_funcs {
 #endif
 #define X PLATFORM_FUNCS
 #include <x.h>
+
+#if defined(_LINUX) && defined(_X64) && !defined(_USE_LOADER)
+// Threads started outside the platform inherit their parent's GS base, but
+// libc gives each of them an FS base of its own. So the context is only used
+// if it was installed by a thread with the same FS base, and otherwise
+// Platform_GetThreadContext gives the thread one of its own.
+intrin platform_thread_context *
+Platform_GetThreadContextFast(void)
+{
+	platform_thread_context *Context =
+		(platform_thread_context *) Intrin_ReadGSQWord(0);
+	if (Context->ThreadPointer == Intrin_ReadFSQWord(0)) return Context;
+	return Platform_GetThreadContext();
+}
+#else
+#define Platform_GetThreadContextFast() Platform_GetThreadContext()
+#endif
+
+#define Platform_GetThreadSlot(Slot) \
+	(Platform_GetThreadContextFast()->Slots[Slot])
+#define Platform_SetThreadSlot(Slot, Value) \
+	(Platform_GetThreadContextFast()->Slots[Slot] = (vptr) (Value))
 #endif
 
 #endif
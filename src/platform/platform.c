@@ -55,6 +55,30 @@ typedef struct thread_handle {
 #error Unsupported platform
 #endif
 
+typedef enum thread_slot {
+	THREAD_SLOT_STACK,
+	THREAD_SLOT_HEAP_CACHE,
+
+	THREAD_SLOT_COUNT = 8,
+} thread_slot;
+
+// Each thread started by the platform owns one of these, and the main thread
+// gets one on entry. On linux it's installed as the GS base, and threads the
+// platform didn't start are given one the first time they ask for it.
+typedef struct platform_thread_context {
+	struct platform_thread_context *Self;
+
+	s32 ThreadId;
+
+	// One past the index of the thread's job queue, or 0 if it has none
+	u32 JobQueue;
+
+	// The FS base of the thread that installed the context
+	u64 ThreadPointer;
+
+	vptr Slots[THREAD_SLOT_COUNT];
+} platform_thread_context;
+
 struct platform_module {
 	c08 *FileName;
 	c08 *Name;
@@ -289,7 +313,12 @@ typedef enum file_mode {
 	EXPORT(vptr,             Platform_AllocateMemory,        u64 Size) \
 	EXPORT(void,             Platform_CloseFile,             file_handle FileHandle) \
 	EXPORT(void,             Platform_FreeMemory,            vptr Base, u64 Size) \
+	EXPORT(vptr,             Platform_ReserveMemory,         u64 Size) \
+	EXPORT(void,             Platform_CommitMemory,          vptr Base, u64 Size) \
+	EXPORT(void,             Platform_DecommitMemory,        vptr Base, u64 Size) \
 	EXPORT(u64,              Platform_GetFileLength,         file_handle FileHandle) \
+	EXPORT(vptr,             Platform_MapFile,               file_handle FileHandle, u64 Length) \
+	EXPORT(void,             Platform_UnmapFile,             vptr Base, u64 Length) \
 	EXPORT(void,             Platform_GetFileTime,           c08 *FileName, datetime *CreationTime, datetime *LastAccessTime, datetime *LastWriteTime) \
 	EXPORT(timestamp,        Platform_GetTimestamp,          void) \
 	EXPORT(r64,              Platform_GetSecondsElapsed,     timestamp From, timestamp To) \
@@ -299,11 +328,17 @@ typedef enum file_mode {
 	EXPORT(opengl_funcs*,    Platform_LoadOpenGL,            void) \
 	INTERN(void,             Platform_GetProcAddress,        platform_module *Module, c08 *Name, vptr *ProcOut) \
 	EXPORT(s32,              Platform_GetThreadId,           thread_handle *ThreadHandle) \
+	EXPORT(platform_thread_context*, Platform_GetThreadContext, void) \
+	EXPORT(void,             Platform_ReleaseThreadContext,  void) \
 	INTERN(b08,              Platform_IsModuleBackendOpened, platform_module *Module) \
 	INTERN(void,             Platform_OpenModuleBackend,     platform_module *Module) \
 	INTERN(void,             Platform_CloseModuleBackend,    platform_module *Module) \
 	EXPORT(b08,              Platform_CreateThread,          thread_handle *ThreadHandle, s32 (*Callback)(vptr UserParam), vptr UserParam) \
 	EXPORT(b08,              Platform_JoinThread,            thread_handle ThreadHandle) \
+	INTERN(void,             Platform_PinThread,             thread_handle *ThreadHandle, u32 Processor) \
+	EXPORT(u32,              Platform_GetProcessorCount,     void) \
+	INTERN(void,             Platform_WaitOnAddress,         u32 *Address, u32 Value) \
+	INTERN(void,             Platform_WakeOnAddress,         u32 *Address, u32 Count) \
 	EXPORT(void,             Platform_LockMutex,             u32 *Mutex) \
 	EXPORT(void,             Platform_UnlockMutex,           u32 *Mutex) \
 	EXPORT(string,           Platform_GetEnvParam,           string Name) \
@@ -363,13 +398,24 @@ _Mem_Cmp(vptr A, vptr B, usize Bytes)
 	return EQUAL;
 }
 
+// Same as Mem_BytesUntil, which isn't loaded yet. Aligned loads never cross
+// a page, so reading past the terminator can't fault.
 inline internal u32
 _Mem_BytesUntil(vptr P, c08 B)
 {
-	u32	 Count = 0;
-	u08 *PB	   = P;
-	while (*PB++ != B) Count++;
-	return Count;
+	u08x16	Target = (u08x16){ 0 } + (u08) B;
+	u08x16 *Block  = (u08x16 *) ((usize) P & ~(usize) 15);
+	u32		Mask   = Intrin_MoveMask_U08x16((u08x16) (*Block == Target));
+	Mask		  &= 0xFFFF << ((u08 *) P - (u08 *) Block);
+
+	while (!Mask) {
+		Block++;
+		Mask = Intrin_MoveMask_U08x16((u08x16) (*Block == Target));
+	}
+
+	u32 Index;
+	Intrin_BitScanForward64(&Index, Mask);
+	return (u32) ((u08 *) Block + Index - (u08 *) P);
 }
 
 inline internal string
@@ -556,7 +602,7 @@ Platform_LoadModule(string Name)
 	b08 UtilIsLoaded = _G.UtilIsLoaded;
 	Assert(UtilIsLoaded || _Str_Cmp(Name.Text, "util") == 0);
 	if (UtilIsLoaded) {
-		if (HashMap_Get(&_G.ModuleTable, &Name, &Module)) return Module;
+		if (FlatMap_Get(&_G.ModuleTable, &Name, &Module)) return Module;
 
 		Module = Heap_AllocateA(
 			_G.Heap,
@@ -566,7 +612,7 @@ Platform_LoadModule(string Name)
 				+ sizeof(PLATFORM_DYNLIB_SUFFIX)
 		);
 		Mem_Set(Module, 0, sizeof(platform_module));
-		HashMap_Add(&_G.ModuleTable, &Name, &Module);
+		FlatMap_Add(&_G.ModuleTable, &Name, &Module);
 
 		Module->FileName = (c08 *) (Module + 1);
 		Mem_Cpy(Module->FileName, "./", 2);
@@ -598,22 +644,19 @@ Platform_LoadModule(string Name)
 	Platform_ReloadModule(Module);
 
 	if (!UtilIsLoaded) {
-		usize HeapSize = 8 * 1024 * 1024;
-		vptr  Mem	   = Platform_AllocateMemory(HeapSize);
-		_G.Heap		   = Heap_Init(Mem, HeapSize);
+		// This is only address space, and pages are committed as it's used.
+		_G.Heap = Heap_Reserve(16ull * 1024 * 1024 * 1024);
+		Heap_EnableThreadCaches(_G.Heap);
 
 		util_state *UtilState = Module->Data;
 		UtilState->StackSize  = 64 * 1024 * 1024;
-		UtilState->Tls		  = Tls_Init(_G.Heap, sizeof(util_tls));
 
 		Stack_Push();
-		_G.ModuleTable = HashMap_InitCustom(
+		_G.ModuleTable = FlatMap_InitCustom(
 			_G.Heap,
 			sizeof(string),
 			sizeof(platform_module *),
 			32,
-			0.5f,
-			2.0f,
 			(hash_func) String_HashPtr,
 			NULL,
 			(cmp_func) String_CmpPtr,
@@ -622,7 +665,7 @@ Platform_LoadModule(string Name)
 
 		Module = Heap_AllocateA(_G.Heap, sizeof(platform_module));
 		Mem_Cpy(Module, &_UtilModule, sizeof(platform_module));
-		HashMap_Add(&_G.ModuleTable, &Name, &Module);
+		FlatMap_Add(&_G.ModuleTable, &Name, &Module);
 	}
 
 	return Module;
@@ -632,7 +675,7 @@ internal string
 Platform_GetEnvParam(string Name)
 {
 	string Value;
-	if (HashMap_Get(&_G.EnvTable, &Name, &Value)) return Value;
+	if (FlatMap_Get(&_G.EnvTable, &Name, &Value)) return Value;
 	return EString();
 }
 
@@ -13,6 +13,9 @@ global win32_window			PrimaryWindow;
 global win32_device_context DeviceContext;
 global s64					CounterFrequency = 0;
 
+// TODO Give each thread its own context once threads are implemented
+internal platform_thread_context MainThreadContext;
+
 internal void
 Platform_LoadWin32(void)
 {
@@ -311,6 +314,26 @@ Platform_AllocateMemory(u64 Size)
 	return MemoryBlock;
 }
 
+internal vptr
+Platform_ReserveMemory(u64 Size)
+{
+	vptr MemoryBlock = Win32_VirtualAlloc(0, Size, MEM_RESERVE, PAGE_NOACCESS);
+	Assert(MemoryBlock);
+	return MemoryBlock;
+}
+
+internal void
+Platform_CommitMemory(vptr Base, u64 Size)
+{
+	vptr MemoryBlock =
+		Win32_VirtualAlloc(Base, Size, MEM_COMMIT, PAGE_READWRITE);
+	Assert(MemoryBlock);
+}
+
+internal void
+Platform_DecommitMemory(vptr Base, u64 Size)
+{ Win32_VirtualFree(Base, Size, MEM_DECOMMIT); }
+
 internal void
 Platform_FreeMemory(vptr Base, u64 Size)
 { Win32_VirtualFree(Base, 0, MEM_RELEASE); }
@@ -327,6 +350,23 @@ Platform_GetFileLength(file_handle FileHandle)
 	return Size.QuadPart;
 }
 
+internal vptr
+Platform_MapFile(file_handle FileHandle, u64 Length)
+{
+	// TODO Use a file mapping, this just reads the whole file
+	if (!Length) return NULL;
+
+	vptr Base = Platform_AllocateMemory(Length);
+	Platform_ReadFile(FileHandle, Base, Length, 0);
+	return Base;
+}
+
+internal void
+Platform_UnmapFile(vptr Base, u64 Length)
+{
+	if (Base) Platform_FreeMemory(Base, Length);
+}
+
 internal b08
 Platform_OpenFile(file_handle *FileHandle, c08 *FileName, file_mode OpenMode)
 {
@@ -548,6 +588,31 @@ Platform_JoinThread(thread_handle ThreadHandle)
 	return FALSE;
 }
 
+internal void
+Platform_PinThread(thread_handle *ThreadHandle, u32 Processor)
+{
+	// TODO
+}
+
+internal u32
+Platform_GetProcessorCount(void)
+{
+	// TODO
+	return 1;
+}
+
+internal void
+Platform_WaitOnAddress(u32 *Address, u32 Value)
+{
+	// TODO
+}
+
+internal void
+Platform_WakeOnAddress(u32 *Address, u32 Count)
+{
+	// TODO
+}
+
 internal void
 Platform_LockMutex(u32 *Mutex)
 {
@@ -575,6 +640,14 @@ Platform_GetThreadId(thread_handle *ThreadHandle)
 	return 0;
 }
 
+internal platform_thread_context *
+Platform_GetThreadContext(void)
+{ return &MainThreadContext; }
+
+internal void
+Platform_ReleaseThreadContext(void)
+{ }
+
 internal b08
 Platform_IsModuleBackendOpened(platform_module *Module)
 { return !!Module->DLL; }
@@ -807,17 +880,19 @@ Platform_Entry(void)
 	};
 	_G.Funcs = &_F;
 
+	MainThreadContext.Self = &MainThreadContext;
+
 	Platform_LoadWin32();
 	Platform_ParseCommandLine();
 	Win32_QueryPerformanceFrequency(&CounterFrequency);
 
 	platform_module *UtilModule = Platform_LoadModule(UTIL_MODULE_NAME);
+	Platform_InitJobs();
 
 	Platform_LoadModule(CStringL("base"));
 
-	HASHMAP_FOREACH (
+	FLATMAP_FOREACH (
 		I,
-		Hash,
 		string,
 		Key,
 		platform_module *,
@@ -839,9 +914,8 @@ Platform_Entry(void)
 
 	while (_G.ExecutionState == EXECUTION_RUNNING) {
 		// Will reload the modules if necessary
-		HASHMAP_FOREACH (
+		FLATMAP_FOREACH (
 			I,
-			Hash,
 			string,
 			Key,
 			platform_module *,
@@ -887,9 +961,8 @@ Platform_Entry(void)
 			}
 		}
 
-		HASHMAP_FOREACH (
+		FLATMAP_FOREACH (
 			I,
-			Hash,
 			string,
 			Key,
 			platform_module *,
@@ -914,9 +987,8 @@ Platform_Entry(void)
 		_G.FPS = CountsPerSecond / (r64) ElapsedTime;
 	}
 
-	HASHMAP_FOREACH (
+	FLATMAP_FOREACH (
 		I,
-		Hash,
 		string,
 		Key,
 		platform_module *,
@@ -933,6 +1005,8 @@ Platform_Entry(void)
 		Platform_UnloadModule(Module);
 	}
 
+	Platform_DeinitJobs();
+
 	Stack_Pop();
 
 	UtilModule->Deinit(&_G);
@@ -87,11 +87,13 @@ typedef s64(API_ENTRY *func_Win32_WindowCallback)(
 	s64			 LParam
 );
 
+#define PAGE_NOACCESS  0x01
 #define PAGE_READWRITE 0x04
 
-#define MEM_COMMIT  0x1000
-#define MEM_RESERVE 0x2000
-#define MEM_RELEASE 0x8000
+#define MEM_COMMIT   0x1000
+#define MEM_RESERVE  0x2000
+#define MEM_DECOMMIT 0x4000
+#define MEM_RELEASE  0x8000
 
 #define WS_OVERLAPPED  0x00000000
 #define WS_MAXIMIZEBOX 0x00010000
@@ -0,0 +1,530 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+*                                                                             *
+*  Author: Aria Seiler                                                        *
+*                                                                             *
+*  This program is in the public domain. There is no implied warranty, so     *
+*  use it at your own risk.                                                   *
+*                                                                             *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifdef INCLUDE_HEADER
+
+#define ATLAS_MAX_SHELVES 256
+#define ATLAS_MAX_DIRTY	  16
+#define ATLAS_NONE		  U32_MAX
+
+typedef struct atlas_slot {
+	v2u32 Pos;
+	v2u32 Size;
+} atlas_slot;
+
+// A span of a shelf, either holding a slot or free. Spans that aren't part of
+// any shelf are chained through Next.
+typedef struct atlas_node {
+	u64 Key;
+	u32 X;
+	u32 Width;
+	u32 Height;
+	u32 Shelf;
+	u32 Prev;
+	u32 Next;
+	u32 LruPrev;
+	u32 LruNext;
+	u32 LastUse;
+	b08 Used;
+} atlas_node;
+
+typedef struct atlas_shelf {
+	u32 Y;
+	u32 Height;
+	u32 First;
+} atlas_shelf;
+
+// Slots are packed into shelves, which are rows stacked from the top of the
+// bitmap, and each shelf is split into spans from left to right. Freed spans
+// merge with their free neighbours, and trailing shelves that empty out give
+// their rows back. When nothing fits, the least recently used slots are
+// evicted, except for those used since the last Atlas_BeginFrame.
+//
+// Every change to the bitmap is recorded as a dirty rectangle, as
+// { MinX, MinY, MaxX, MaxY } with the maximums exclusive, so only those
+// regions need to be uploaded.
+typedef struct atlas {
+	heap   *Heap;
+	v4u08  *Bitmap;
+	v2u32	Size;
+	hashmap Slots;
+
+	atlas_node *Nodes;
+	u32			NodeCapacity;
+	u32			FreeNode;
+	u32			SlotCount;
+	u32			MaxSlots;
+
+	atlas_shelf Shelves[ATLAS_MAX_SHELVES];
+	u32			ShelfCount;
+
+	// The head is the most recently used.
+	u32 LruHead;
+	u32 LruTail;
+	u32 Frame;
+
+	v4u32 Dirty[ATLAS_MAX_DIRTY];
+	u32	  DirtyCount;
+} atlas;
+
+#define ATLAS_FUNCS \
+   EXPORT(atlas*, Atlas_Init,       heap *Heap, v2u32 Size, u32 MaxSlots) \
+   EXPORT(void,   Atlas_Free,       atlas *Atlas) \
+   EXPORT(void,   Atlas_BeginFrame, atlas *Atlas) \
+   EXPORT(b08,    Atlas_Find,       atlas *Atlas, u64 Key, atlas_slot *SlotOut) \
+   EXPORT(b08,    Atlas_Insert,     atlas *Atlas, u64 Key, v2u32 Size, atlas_slot *SlotOut) \
+   EXPORT(b08,    Atlas_GetGlyph,   atlas *Atlas, u64 Key, msdf_shape Shape, v2u32 SlotSize, atlas_slot *SlotOut) \
+   EXPORT(void,   Atlas_Remove,     atlas *Atlas, u64 Key) \
+   EXPORT(u32,    Atlas_FlushDirty, atlas *Atlas, v4u32 *RectsOut)
+
+#endif
+
+#ifdef INCLUDE_SOURCE
+
+internal atlas *
+Atlas_Init(heap *Heap, v2u32 Size, u32 MaxSlots)
+{
+	Assert(MaxSlots > 0);
+
+	atlas *Atlas = Heap_AllocateA(Heap, sizeof(atlas));
+	Mem_Set(Atlas, 0, sizeof(atlas));
+	Atlas->Heap		= Heap;
+	Atlas->Size		= Size;
+	Atlas->Bitmap	= Heap_AllocateA(Heap, Size.X * Size.Y * sizeof(v4u08));
+	Atlas->Slots	= HashMap_Init(Heap, sizeof(u64), sizeof(u32));
+	Atlas->MaxSlots = MaxSlots;
+	Atlas->LruHead	= ATLAS_NONE;
+	Atlas->LruTail	= ATLAS_NONE;
+	Mem_Set(Atlas->Bitmap, 0, Size.X * Size.Y * sizeof(v4u08));
+
+	// Each slot can leave at most one free span behind it, plus the one at
+	// the end of each shelf.
+	Atlas->NodeCapacity = 2 * MaxSlots + ATLAS_MAX_SHELVES;
+	Atlas->Nodes =
+		Heap_AllocateA(Heap, Atlas->NodeCapacity * sizeof(atlas_node));
+	for (u32 I = 0; I < Atlas->NodeCapacity; I++)
+		Atlas->Nodes[I].Next = I + 1 < Atlas->NodeCapacity ? I + 1 : ATLAS_NONE;
+	Atlas->FreeNode = 0;
+
+	return Atlas;
+}
+
+internal void
+Atlas_Free(atlas *Atlas)
+{
+	HashMap_Free(&Atlas->Slots);
+	Heap_FreeA(Atlas->Nodes);
+	Heap_FreeA(Atlas->Bitmap);
+	Heap_FreeA(Atlas);
+}
+
+internal void
+Atlas_BeginFrame(atlas *Atlas)
+{ Atlas->Frame++; }
+
+internal u32
+Atlas_AllocateNode(atlas *Atlas)
+{
+	u32 Index = Atlas->FreeNode;
+	Assert(Index != ATLAS_NONE, "Ran out of atlas nodes");
+	Atlas->FreeNode = Atlas->Nodes[Index].Next;
+	Mem_Set(Atlas->Nodes + Index, 0, sizeof(atlas_node));
+	return Index;
+}
+
+internal void
+Atlas_ReleaseNode(atlas *Atlas, u32 Index)
+{
+	Atlas->Nodes[Index].Next = Atlas->FreeNode;
+	Atlas->FreeNode			 = Index;
+}
+
+internal atlas_slot
+Atlas_GetSlot(atlas *Atlas, u32 Index)
+{
+	atlas_node	Node  = Atlas->Nodes[Index];
+	atlas_shelf Shelf = Atlas->Shelves[Node.Shelf];
+	return (atlas_slot){ { Node.X, Shelf.Y }, { Node.Width, Node.Height } };
+}
+
+internal void
+Atlas_Unlink(atlas *Atlas, u32 Index)
+{
+	atlas_node *Node = Atlas->Nodes + Index;
+	if (Node->LruPrev != ATLAS_NONE)
+		Atlas->Nodes[Node->LruPrev].LruNext = Node->LruNext;
+	else Atlas->LruHead = Node->LruNext;
+	if (Node->LruNext != ATLAS_NONE)
+		Atlas->Nodes[Node->LruNext].LruPrev = Node->LruPrev;
+	else Atlas->LruTail = Node->LruPrev;
+}
+
+internal void
+Atlas_Touch(atlas *Atlas, u32 Index)
+{
+	atlas_node *Node = Atlas->Nodes + Index;
+	Node->LastUse	 = Atlas->Frame;
+	if (Atlas->LruHead == Index) return;
+
+	Atlas_Unlink(Atlas, Index);
+	Node->LruPrev = ATLAS_NONE;
+	Node->LruNext = Atlas->LruHead;
+	if (Atlas->LruHead != ATLAS_NONE)
+		Atlas->Nodes[Atlas->LruHead].LruPrev = Index;
+	else Atlas->LruTail = Index;
+	Atlas->LruHead = Index;
+}
+
+internal void
+Atlas_MarkDirty(atlas *Atlas, atlas_slot Slot)
+{
+	v4u32 Rect = { Slot.Pos.X, Slot.Pos.Y, Slot.Pos.X + Slot.Size.X,
+				   Slot.Pos.Y + Slot.Size.Y };
+
+	if (Atlas->DirtyCount < ATLAS_MAX_DIRTY) {
+		Atlas->Dirty[Atlas->DirtyCount++] = Rect;
+		return;
+	}
+
+	// Out of room, so collapse everything into one bounding box.
+	for (u32 I = 0; I < Atlas->DirtyCount; I++) {
+		Rect.X = MIN(Rect.X, Atlas->Dirty[I].X);
+		Rect.Y = MIN(Rect.Y, Atlas->Dirty[I].Y);
+		Rect.Z = MAX(Rect.Z, Atlas->Dirty[I].Z);
+		Rect.W = MAX(Rect.W, Atlas->Dirty[I].W);
+	}
+	Atlas->Dirty[0]	  = Rect;
+	Atlas->DirtyCount = 1;
+}
+
+internal u32
+Atlas_FlushDirty(atlas *Atlas, v4u32 *RectsOut)
+{
+	u32 Count = Atlas->DirtyCount;
+	Mem_Cpy(RectsOut, Atlas->Dirty, Count * sizeof(v4u32));
+	Atlas->DirtyCount = 0;
+	return Count;
+}
+
+// Finds the first free span in a shelf that's wide enough.
+internal u32
+Atlas_FindSpan(atlas *Atlas, atlas_shelf *Shelf, u32 Width)
+{
+	for (u32 I = Shelf->First; I != ATLAS_NONE; I = Atlas->Nodes[I].Next) {
+		atlas_node *Node = Atlas->Nodes + I;
+		if (!Node->Used && Node->Width >= Width) return I;
+	}
+	return ATLAS_NONE;
+}
+
+// Looks for a free span, preferring shelves that are close to the right
+// height, then a new shelf, then any shelf that's tall enough.
+internal u32
+Atlas_FindPlace(atlas *Atlas, v2u32 Size)
+{
+	u32 Best	  = ATLAS_NONE;
+	u32 BestWaste = U32_MAX;
+	u32 Fallback  = ATLAS_NONE;
+
+	for (u32 S = 0; S < Atlas->ShelfCount; S++) {
+		atlas_shelf *Shelf = Atlas->Shelves + S;
+		if (Shelf->Height < Size.Y) continue;
+
+		u32 Span = Atlas_FindSpan(Atlas, Shelf, Size.X);
+		if (Span == ATLAS_NONE) continue;
+
+		u32 Waste = Shelf->Height - Size.Y;
+		if (Waste <= Size.Y / 2 && Waste < BestWaste) {
+			Best	  = Span;
+			BestWaste = Waste;
+		} else if (Fallback == ATLAS_NONE) Fallback = Span;
+	}
+	if (Best != ATLAS_NONE) return Best;
+
+	u32 Top = 0;
+	if (Atlas->ShelfCount) {
+		atlas_shelf Last = Atlas->Shelves[Atlas->ShelfCount - 1];
+		Top				 = Last.Y + Last.Height;
+	}
+
+	b08 HasRoom = Atlas->Size.Y - Top >= Size.Y;
+	if (HasRoom && Atlas->ShelfCount < ATLAS_MAX_SHELVES) {
+		u32			Index = Atlas_AllocateNode(Atlas);
+		atlas_node *Node  = Atlas->Nodes + Index;
+		Node->Width		  = Atlas->Size.X;
+		Node->Shelf		  = Atlas->ShelfCount;
+		Node->Prev		  = ATLAS_NONE;
+		Node->Next		  = ATLAS_NONE;
+
+		Atlas->Shelves[Atlas->ShelfCount++] =
+			(atlas_shelf){ .Y = Top, .Height = Size.Y, .First = Index };
+		return Index;
+	}
+
+	return Fallback;
+}
+
+// Takes the front of a free span, leaving the rest of it free.
+internal void
+Atlas_SplitSpan(atlas *Atlas, u32 Index, u32 Width)
+{
+	atlas_node *Node = Atlas->Nodes + Index;
+	if (Node->Width == Width) return;
+
+	u32			RestIndex = Atlas_AllocateNode(Atlas);
+	atlas_node *Rest	  = Atlas->Nodes + RestIndex;
+	Node				  = Atlas->Nodes + Index;
+	Rest->X				  = Node->X + Width;
+	Rest->Width			  = Node->Width - Width;
+	Rest->Shelf			  = Node->Shelf;
+	Rest->Prev			  = Index;
+	Rest->Next			  = Node->Next;
+	if (Node->Next != ATLAS_NONE) Atlas->Nodes[Node->Next].Prev = RestIndex;
+	Node->Next	= RestIndex;
+	Node->Width = Width;
+}
+
+// Merges the free span at Index into the one before it.
+internal void
+Atlas_MergeSpan(atlas *Atlas, u32 Index)
+{
+	atlas_node *Node = Atlas->Nodes + Index;
+	atlas_node *Prev = Atlas->Nodes + Node->Prev;
+	Prev->Width		+= Node->Width;
+	Prev->Next		 = Node->Next;
+	if (Node->Next != ATLAS_NONE) Atlas->Nodes[Node->Next].Prev = Node->Prev;
+	Atlas_ReleaseNode(Atlas, Index);
+}
+
+internal void
+Atlas_FreeSlot(atlas *Atlas, u32 Index)
+{
+	atlas_node *Node = Atlas->Nodes + Index;
+	HashMap_Remove(&Atlas->Slots, &Node->Key, NULL, NULL);
+	Atlas_Unlink(Atlas, Index);
+	Node->Used = FALSE;
+	Atlas->SlotCount--;
+
+	if (Node->Next != ATLAS_NONE && !Atlas->Nodes[Node->Next].Used)
+		Atlas_MergeSpan(Atlas, Node->Next);
+	if (Node->Prev != ATLAS_NONE && !Atlas->Nodes[Node->Prev].Used)
+		Atlas_MergeSpan(Atlas, Index);
+
+	// Give back the rows of any empty shelves at the bottom.
+	while (Atlas->ShelfCount) {
+		atlas_shelf *Shelf = Atlas->Shelves + Atlas->ShelfCount - 1;
+		atlas_node	*First = Atlas->Nodes + Shelf->First;
+		if (First->Used || First->Next != ATLAS_NONE) break;
+
+		Atlas_ReleaseNode(Atlas, Shelf->First);
+		Atlas->ShelfCount--;
+	}
+}
+
+// Evicts the least recently used slot, unless it's been used this frame.
+internal b08
+Atlas_Evict(atlas *Atlas)
+{
+	u32 Index = Atlas->LruTail;
+	if (Index == ATLAS_NONE) return FALSE;
+	if (Atlas->Nodes[Index].LastUse == Atlas->Frame) return FALSE;
+
+	Atlas_FreeSlot(Atlas, Index);
+	return TRUE;
+}
+
+internal b08
+Atlas_Find(atlas *Atlas, u64 Key, atlas_slot *SlotOut)
+{
+	u32 *Index = HashMap_GetRef(&Atlas->Slots, &Key);
+	if (!Index) return FALSE;
+
+	Atlas_Touch(Atlas, *Index);
+	if (SlotOut) *SlotOut = Atlas_GetSlot(Atlas, *Index);
+	return TRUE;
+}
+
+// Allocates a slot without drawing to it, evicting old slots to make room if
+// needed. The slot is marked dirty, since the caller is expected to fill it.
+internal b08
+Atlas_Insert(atlas *Atlas, u64 Key, v2u32 Size, atlas_slot *SlotOut)
+{
+	Assert(!HashMap_GetRef(&Atlas->Slots, &Key), "Slot already exists");
+	if (Size.X > Atlas->Size.X || Size.Y > Atlas->Size.Y) return FALSE;
+
+	if (Atlas->SlotCount == Atlas->MaxSlots && !Atlas_Evict(Atlas))
+		return FALSE;
+
+	u32 Index = Atlas_FindPlace(Atlas, Size);
+	while (Index == ATLAS_NONE) {
+		if (!Atlas_Evict(Atlas)) return FALSE;
+		Index = Atlas_FindPlace(Atlas, Size);
+	}
+
+	Atlas_SplitSpan(Atlas, Index, Size.X);
+	atlas_node *Node = Atlas->Nodes + Index;
+	Node->Key		 = Key;
+	Node->Height	 = Size.Y;
+	Node->Used		 = TRUE;
+	Node->LruPrev	 = ATLAS_NONE;
+	Node->LruNext	 = Atlas->LruHead;
+	if (Atlas->LruHead != ATLAS_NONE)
+		Atlas->Nodes[Atlas->LruHead].LruPrev = Index;
+	else Atlas->LruTail = Index;
+	Atlas->LruHead = Index;
+	Node->LastUse  = Atlas->Frame;
+
+	Atlas->SlotCount++;
+	HashMap_Add(&Atlas->Slots, &Key, &Index);
+
+	atlas_slot Slot = Atlas_GetSlot(Atlas, Index);
+	Atlas_MarkDirty(Atlas, Slot);
+	if (SlotOut) *SlotOut = Slot;
+	return TRUE;
+}
+
+// Draws the glyph into a new slot if it isn't already present. Like with
+// MSDF_DrawShape, the slot includes a one pixel border, and the returned slot
+// excludes it. Glyphs without an outline get an empty slot instead.
+internal b08
+Atlas_GetGlyph(
+	atlas	   *Atlas,
+	u64			Key,
+	msdf_shape	Shape,
+	v2u32		SlotSize,
+	atlas_slot *SlotOut
+)
+{
+	atlas_slot Slot = { 0 };
+	if (!Shape.ContourCount) {
+		if (SlotOut) *SlotOut = Slot;
+		return TRUE;
+	}
+
+	if (!Atlas_Find(Atlas, Key, &Slot)) {
+		if (!Atlas_Insert(Atlas, Key, SlotSize, &Slot)) return FALSE;
+
+		u32	   Offset = INDEX_2D(Slot.Pos.X, Slot.Pos.Y, Atlas->Size.X);
+		v2u32  Pos	  = Slot.Pos;
+		v2u32  Size	  = Slot.Size;
+		MSDF_DrawShape(
+			Shape,
+			&Pos,
+			&Size,
+			Atlas->Bitmap + Offset,
+			Slot.Pos,
+			0,
+			Atlas->Size
+		);
+	}
+
+	// The size comes from the slot itself, since a cached glyph may have been
+	// drawn at a different size than the one asked for now.
+	Slot.Pos  = V2u32_Add(Slot.Pos, (v2u32){ 1, 1 });
+	Slot.Size = V2u32_Sub(Slot.Size, (v2u32){ 2, 2 });
+	if (SlotOut) *SlotOut = Slot;
+	return TRUE;
+}
+
+internal void
+Atlas_Remove(atlas *Atlas, u64 Key)
+{
+	u32 *Index = HashMap_GetRef(&Atlas->Slots, &Key);
+	if (Index) Atlas_FreeSlot(Atlas, *Index);
+}
+
+
+#ifndef REGION_ATLAS_TESTS
+
+#define ATLAS_TESTS                                                           \
+	TEST(Atlas_Insert, EvictsLeastRecentlyUsed, (                             \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		atlas *Atlas = Atlas_Init(Heap, (v2u32){ 64, 32 }, 16);               \
+		v2u32 Size = { 32, 16 };                                              \
+		atlas_slot Slots[5];                                                  \
+		for (u64 Key = 0; Key < 4; Key++)                                     \
+			Assert(Atlas_Insert(Atlas, Key, Size, Slots + Key));              \
+                                                                              \
+		/* Everything was used this frame, so nothing can be evicted */       \
+		Assert(!Atlas_Insert(Atlas, 4, Size, Slots + 4));                     \
+                                                                              \
+		Atlas_BeginFrame(Atlas);                                              \
+		Assert(Atlas_Find(Atlas, 0, NULL));                                   \
+		Assert(Atlas_Insert(Atlas, 4, Size, Slots + 4));                      \
+		Assert(V2u32_IsEqual(Slots[4].Pos, Slots[1].Pos));                    \
+		Assert(!Atlas_Find(Atlas, 1, NULL));                                  \
+		Assert(Atlas_Find(Atlas, 0, NULL));                                   \
+		Atlas_Free(Atlas);                                                    \
+	))                                                                        \
+	TEST(Atlas_Remove, MergesFreeSpans, (                                     \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		atlas *Atlas = Atlas_Init(Heap, (v2u32){ 64, 32 }, 16);               \
+		for (u64 Key = 0; Key < 8; Key++)                                     \
+			Assert(Atlas_Insert(Atlas, Key, (v2u32){ 16, 16 }, NULL));        \
+		Atlas_Remove(Atlas, 5);                                               \
+		Atlas_Remove(Atlas, 6);                                               \
+                                                                              \
+		atlas_slot Slot;                                                      \
+		Assert(Atlas_Insert(Atlas, 8, (v2u32){ 32, 16 }, &Slot));             \
+		Assert(Slot.Pos.X == 16 && Slot.Pos.Y == 16);                         \
+		for (u64 Key = 0; Key < 8; Key++)                                     \
+			Assert(Atlas_Find(Atlas, Key, NULL) == (Key != 5 && Key != 6));   \
+		Atlas_Free(Atlas);                                                    \
+	))                                                                        \
+	TEST(Atlas_FlushDirty, ReportsNewSlots, (                                 \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		atlas *Atlas = Atlas_Init(Heap, (v2u32){ 64, 32 }, 16);               \
+		v4u32 Rects[ATLAS_MAX_DIRTY];                                         \
+		Assert(Atlas_Insert(Atlas, 0, (v2u32){ 16, 8 }, NULL));               \
+		Assert(Atlas_Insert(Atlas, 1, (v2u32){ 16, 8 }, NULL));               \
+		Assert(Atlas_FlushDirty(Atlas, Rects) == 2);                          \
+		Assert(V4u32_IsEqual(Rects[0], (v4u32){ 0, 0, 16, 8 }));              \
+		Assert(V4u32_IsEqual(Rects[1], (v4u32){ 16, 0, 32, 8 }));             \
+		Assert(Atlas_FlushDirty(Atlas, Rects) == 0);                          \
+                                                                              \
+		/* Finding a slot doesn't change the bitmap */                        \
+		Assert(Atlas_Find(Atlas, 0, NULL));                                   \
+		Assert(Atlas_FlushDirty(Atlas, Rects) == 0);                          \
+		Atlas_Free(Atlas);                                                    \
+	))                                                                        \
+	TEST(Atlas_GetGlyph, KeepsTheDrawnSize, (                                 \
+		msdf_segment Segments[3] = {                                          \
+			{ { 0, 0 }, { 40, 0 }, { 0, 0 }, 0 },                             \
+			{ { 40, 0 }, { 20, 50 }, { 0, 0 }, 0 },                           \
+			{ { 20, 50 }, { 0, 0 }, { 0, 0 }, 0 },                            \
+		};                                                                    \
+		msdf_edge Edges[3] = {                                                \
+			{ Segments + 0, 1, 0b110 },                                       \
+			{ Segments + 1, 1, 0b011 },                                       \
+			{ Segments + 2, 1, 0b101 },                                       \
+		};                                                                    \
+		msdf_contour Contour = { Edges, 3 };                                  \
+		msdf_shape Shape = {                                                  \
+			&Contour, Edges, Segments, 1, 3, 3, { 0, 0, 40, 50 }              \
+		};                                                                    \
+                                                                              \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		atlas *Atlas = Atlas_Init(Heap, (v2u32){ 64, 32 }, 16);               \
+		atlas_slot Drawn, Cached;                                             \
+		Assert(Atlas_GetGlyph(Atlas, 0, Shape, (v2u32){ 16, 16 }, &Drawn));   \
+		Assert(Atlas_GetGlyph(Atlas, 0, Shape, (v2u32){ 32, 32 }, &Cached));  \
+		Assert(V2u32_IsEqual(Drawn.Size, (v2u32){ 14, 14 }));                 \
+		Assert(V2u32_IsEqual(Cached.Size, Drawn.Size));                       \
+		Assert(V2u32_IsEqual(Cached.Pos, Drawn.Pos));                         \
+		Atlas_Free(Atlas);                                                    \
+	))                                                                        \
+	//
+
+#endif
+
+#endif
@@ -48,6 +48,7 @@ typedef struct ttf_font_dir {
 #define TTF_CMAP_PLATFORM_UNICODE 0
 #define TTF_CMAP_PLATFORM_MICROSOFT 3
 #define TTF_CMAP_MICROSOFT_UNICODEBMP 1
+#define TTF_CMAP_MICROSOFT_UNICODEFULL 10
 #define TTF_TAG_cmap TTF_MAKE_TAG('c','m','a','p')
 typedef struct ttf_cmap {
 	u16 Version;
@@ -58,6 +59,8 @@ typedef struct ttf_cmap {
 		u32 Offset;
 	} Records[0];
 } ttf_cmap;
+// The counts are native, but the arrays point into the file and are big
+// endian, like the rest of the tables.
 typedef struct ttf_cmap_subtable_4 {
 	u16	 SegCountX2;
 	u16	 SearchRange;
@@ -70,14 +73,23 @@ typedef struct ttf_cmap_subtable_4 {
 	u16 *RangeOffsets;
 	u16 *GlyphIdArray;
 } ttf_cmap_subtable_4;
+typedef struct ttf_cmap_group {
+	u32 StartCode;
+	u32 EndCode;
+	u32 StartGlyph;
+} ttf_cmap_group;
+typedef struct ttf_cmap_subtable_12 {
+	u32				Length;
+	u32				Language;
+	u32				GroupCount;
+	ttf_cmap_group *Groups;
+} ttf_cmap_subtable_12;
 typedef struct ttf_cmap_subtable {
-	struct {
-		u16 Format;
-		u16 Length;
-		u16 Language;
-	} *Header;
+	// 0 if the font has no supported unicode subtable
+	u16 Format;
 	union {
-		ttf_cmap_subtable_4 Type4;
+		ttf_cmap_subtable_4	 Type4;
+		ttf_cmap_subtable_12 Type12;
 	};
 } ttf_cmap_subtable;
 
@@ -179,19 +191,33 @@ typedef struct ttf_maxp {
 } ttf_maxp;
 #pragma pack(pop)
 
+// Glyph indices are cached in pages of consecutive codepoints, which are
+// filled from the cmap the first time any codepoint in them is looked up.
+#define FONT_GLYPH_PAGE_SIZE  256
+#define FONT_GLYPH_PAGE_COUNT (0x110000 / FONT_GLYPH_PAGE_SIZE)
+
+// The file is never written to, so it can be mapped read only. The small
+// header tables are copied out and swapped to native order, and everything
+// else is read in place through Font_ReadU16 and Font_ReadU32.
 typedef struct font {
 	ttf_font_dir *FontDir;
 	ttf_cmap	 *cmap;
 	u08			 *glyfs;
-	ttf_head	 *head;
-	ttf_hhea	 *hhea;
+	ttf_head	  head;
+	ttf_hhea	  hhea;
 	ttf_hmtx	  hmtx;
 	ttf_loca	 *loca;
-	ttf_maxp	 *maxp;
+	ttf_maxp	  maxp;
 
 	ttf_cmap_subtable Encoding;
 
+	heap *Heap;
+	u16 **GlyphPages;
+
+	// The start of the file, which the font doesn't own unless MappingSize is
+	// set by Font_Open.
 	u08 *FileBase;
+	u64	 MappingSize;
 } font;
 
 typedef struct font_glyph {
@@ -203,7 +229,10 @@ typedef struct font_glyph {
 } font_glyph;
 
 #define FONT_FUNCS \
-    EXPORT(font,       Font_Init,          u08 *FileData) \
+    EXPORT(font,       Font_Init,          heap *Heap, u08 *FileData) \
+    EXPORT(void,       Font_Deinit,        font *Font) \
+    EXPORT(font,       Font_Open,          heap *Heap, c08 *FileName) \
+    EXPORT(void,       Font_Close,         font *Font) \
     EXPORT(u32,        Font_GetGlyphIndex, font Font, u32 Codepoint) \
     EXPORT(font_glyph, Font_GetGlyph,      font Font, u32 Codepoint, r32 Scale)
 
@@ -224,12 +253,27 @@ typedef struct font_glyph {
 //  	return Sum;
 //  }
 
+internal u16
+Font_ReadU16(vptr Data)
+{
+	u08 *Bytes = Data;
+	return (u16) (Bytes[0] << 8 | Bytes[1]);
+}
+
+internal u32
+Font_ReadU32(vptr Data)
+{
+	u08 *Bytes = Data;
+	return (u32) Bytes[0] << 24 | (u32) Bytes[1] << 16 | (u32) Bytes[2] << 8
+		 | Bytes[3];
+}
+
 internal u32
 Font_GetGlyphOffset(font Font, u32 GlyphIndex)
 {
-	if (Font.head->IndexToLocFormat == TTF_LOCA_SHORT_OFFSETS)
-		return Font.loca->Shorts[GlyphIndex] * 2;
-	else return Font.loca->Longs[GlyphIndex];
+	if (Font.head.IndexToLocFormat == TTF_LOCA_SHORT_OFFSETS)
+		return Font_ReadU16(Font.loca->Shorts + GlyphIndex) * 2;
+	else return Font_ReadU32(Font.loca->Longs + GlyphIndex);
 }
 
 internal vptr
@@ -239,21 +283,20 @@ Font_FindTable(font *Font, u32 Tag)
 	u08			 *FileBase = Font->FileBase;
 	u32			  Index;
 	u32			  Start = 0;
-	u32			  End	= FontDir->Offset.TableCount;
+	u32			  End	= Font_ReadU16(&FontDir->Offset.TableCount);
 	while (Start != End) {
-		Index = Start + (End - Start) / 2;
-		if (FontDir->Tables[Index].Tag == Tag) break;
-		if (FontDir->Tables[Index].Tag < Tag) Start = Index + 1;
+		Index		 = Start + (End - Start) / 2;
+		u32 IndexTag = Font_ReadU32(&FontDir->Tables[Index].Tag);
+		if (IndexTag == Tag) break;
+		if (IndexTag < Tag) Start = Index + 1;
 		else End = Index;
 	}
 	if (Start == End) return NULL;
-	vptr Table	   = FileBase + FontDir->Tables[Index].Offset;
-	u32	 TableSize = FontDir->Tables[Index].Length;
-	u32	 Checksum  = FontDir->Tables[Index].Checksum;
-	if (Tag == TTF_TAG_head) {
-		u32 Adjustment	= ((ttf_head *) Table)->ChecksumAdjustment;
-		Checksum	   += SWAPENDIAN32(Adjustment);
-	}
+	vptr Table	   = FileBase + Font_ReadU32(&FontDir->Tables[Index].Offset);
+	u32	 TableSize = Font_ReadU32(&FontDir->Tables[Index].Length);
+	u32	 Checksum  = Font_ReadU32(&FontDir->Tables[Index].Checksum);
+	if (Tag == TTF_TAG_head)
+		Checksum += Font_ReadU32(&((ttf_head *) Table)->ChecksumAdjustment);
 	// if(Font_CalculateChecksum(Table, TableSize) != Checksum) return NULL;
 	return Table;
 }
@@ -262,88 +305,68 @@ internal void
 Font_LoadFontDir(font *Font)
 {
 	ttf_font_dir *FontDir = Font->FontDir = (ttf_font_dir *) Font->FileBase;
-	SWAPENDIAN32(FontDir->Offset.ScalerType);
-	SWAPENDIAN16(FontDir->Offset.TableCount);
-	SWAPENDIAN16(FontDir->Offset.SearchRange);
-	SWAPENDIAN16(FontDir->Offset.EntrySelector);
-	SWAPENDIAN16(FontDir->Offset.RangeShift);
-	Assert(
-		FontDir->Offset.ScalerType == 0x00010000
-		|| FontDir->Offset.ScalerType == TTF_TAG_true
-	);
-	for (u32 T = 0; T < FontDir->Offset.TableCount; T++) {
-		SWAPENDIAN32(FontDir->Tables[T].Tag);
-		SWAPENDIAN32(FontDir->Tables[T].Checksum);
-		SWAPENDIAN32(FontDir->Tables[T].Offset);
-		SWAPENDIAN32(FontDir->Tables[T].Length);
-	}
+	u32			  ScalerType = Font_ReadU32(&FontDir->Offset.ScalerType);
+	Assert(ScalerType == 0x00010000 || ScalerType == TTF_TAG_true);
 }
 
 internal void
 Font_LoadcmapTable(font *Font)
 {
+	// Without a usable cmap, every codepoint maps to the missing glyph.
 	ttf_cmap_subtable *Encoding = &Font->Encoding;
 	ttf_cmap		  *cmap = Font->cmap = Font_FindTable(Font, TTF_TAG_cmap);
-	Assert(cmap);
-	SWAPENDIAN16(cmap->Version);
-	SWAPENDIAN16(cmap->TableCount);
-	for (u32 I = 0; I < cmap->TableCount; I++) {
-		SWAPENDIAN16(cmap->Records[I].PlatformID);
-		SWAPENDIAN16(cmap->Records[I].PlatformSpecificID);
-		SWAPENDIAN32(cmap->Records[I].Offset);
-		switch (cmap->Records[I].PlatformID) {
-			case TTF_CMAP_PLATFORM_MICROSOFT: {
-				switch (cmap->Records[I].PlatformSpecificID) {
-					case TTF_CMAP_MICROSOFT_UNICODEBMP: {
-						Encoding->Header =
-							(vptr) ((u08 *) cmap + cmap->Records[I].Offset);
-						SWAPENDIAN16(Encoding->Header->Format);
-						SWAPENDIAN16(Encoding->Header->Length);
-						SWAPENDIAN16(Encoding->Header->Language);
-					} break;
-				}
-			} break;
+	if (!cmap) return;
+
+	// Format 12 covers all of unicode, so it's preferred over format 4.
+	u08 *Subtable	= NULL;
+	u32	 TableCount = Font_ReadU16(&cmap->TableCount);
+	for (u32 I = 0; I < TableCount; I++) {
+		u16 PlatformID = Font_ReadU16(&cmap->Records[I].PlatformID);
+		u16 SpecificID = Font_ReadU16(&cmap->Records[I].PlatformSpecificID);
+		b08 IsUnicode  = PlatformID == TTF_CMAP_PLATFORM_UNICODE
+					  || (PlatformID == TTF_CMAP_PLATFORM_MICROSOFT
+						  && (SpecificID == TTF_CMAP_MICROSOFT_UNICODEBMP
+							  || SpecificID == TTF_CMAP_MICROSOFT_UNICODEFULL));
+		if (!IsUnicode) continue;
+
+		u08 *Data	   = (u08 *) cmap + Font_ReadU32(&cmap->Records[I].Offset);
+		u16	 NewFormat = Font_ReadU16(Data);
+		if (NewFormat == 12 || (NewFormat == 4 && Encoding->Format != 12)) {
+			Subtable		 = Data;
+			Encoding->Format = NewFormat;
 		}
 	}
-	Assert(Encoding->Header);
-	switch (Encoding->Header->Format) {
+
+	switch (Encoding->Format) {
 		case 4: {
-			u08 *Data				   = (u08 *) (Encoding->Header + 1);
-			Encoding->Type4.SegCountX2 = SWAPENDIAN16(
-				*(u16 *) (Data + OFFSET_OF(ttf_cmap_subtable_4, SegCountX2))
-			);
-			Encoding->Type4.SearchRange = SWAPENDIAN16(
-				*(u16 *) (Data + OFFSET_OF(ttf_cmap_subtable_4, SearchRange))
-			);
-			Encoding->Type4.EntrySelector = SWAPENDIAN16(
-				*(u16 *) (Data + OFFSET_OF(ttf_cmap_subtable_4, EntrySelector))
-			);
-			Encoding->Type4.RangeShift = SWAPENDIAN16(
-				*(u16 *) (Data + OFFSET_OF(ttf_cmap_subtable_4, RangeShift))
-			);
-			Data += OFFSET_OF(ttf_cmap_subtable_4, EndCodes);
-			Encoding->Type4.EndCodes =
-				(u16 *) (Data + 0 * Encoding->Type4.SegCountX2);
-			Encoding->Type4.StartCodes =
-				(u16 *) (Data + 1 * Encoding->Type4.SegCountX2);
-			Encoding->Type4.Deltas =
-				(s16 *) (Data + 2 * Encoding->Type4.SegCountX2);
-			Encoding->Type4.RangeOffsets =
-				(u16 *) (Data + 3 * Encoding->Type4.SegCountX2);
-			Encoding->Type4.GlyphIdArray =
-				(u16 *) (Data + 4 * Encoding->Type4.SegCountX2);
-			for (u32 I = 0; I < (u32) Encoding->Type4.SegCountX2 / 2; I++) {
-				SWAPENDIAN16(Encoding->Type4.EndCodes[I]);
-				SWAPENDIAN16(Encoding->Type4.StartCodes[I]);
-				SWAPENDIAN16(Encoding->Type4.Deltas[I]);
-				SWAPENDIAN16(Encoding->Type4.RangeOffsets[I]);
-			}
-			Data			  += 4 * Encoding->Type4.SegCountX2;
-			u32 RemainingSize  = Encoding->Header->Length
-							   - (u32) ((u64) Data - (u64) Encoding->Header);
-			for (u32 I = 0; I < RemainingSize / 2; I++)
-				SWAPENDIAN16(Encoding->Type4.GlyphIdArray[I]);
-		}
+			// The format is followed by the length and language.
+			ttf_cmap_subtable_4 *Table = &Encoding->Type4;
+			u08					*Data  = Subtable + 3 * sizeof(u16);
+			Table->SegCountX2		   = Font_ReadU16(Data + 0);
+			Table->SearchRange		   = Font_ReadU16(Data + 2);
+			Table->EntrySelector	   = Font_ReadU16(Data + 4);
+			Table->RangeShift		   = Font_ReadU16(Data + 6);
+
+			// The end codes are followed by a reserved pad.
+			Data			   += 8;
+			Table->EndCodes		= (u16 *) Data;
+			Data			   += sizeof(u16);
+			Table->StartCodes	= (u16 *) (Data + 1 * Table->SegCountX2);
+			Table->Deltas		= (s16 *) (Data + 2 * Table->SegCountX2);
+			Table->RangeOffsets = (u16 *) (Data + 3 * Table->SegCountX2);
+			Table->GlyphIdArray = (u16 *) (Data + 4 * Table->SegCountX2);
+		} break;
+
+		case 12: {
+			ttf_cmap_subtable_12 *Table = &Encoding->Type12;
+
+			// The format is followed by a reserved u16 instead of the length.
+			u08 *Data		  = Subtable + 4;
+			Table->Length	  = Font_ReadU32(Data + 0);
+			Table->Language	  = Font_ReadU32(Data + 4);
+			Table->GroupCount = Font_ReadU32(Data + 8);
+			Table->Groups	  = (ttf_cmap_group *) (Data + 12);
+		} break;
 	}
 }
 
@@ -352,38 +375,15 @@ Font_LoadglyfTable(font *Font)
 {
 	Font->glyfs = Font_FindTable(Font, TTF_TAG_glyf);
 	Assert(Font->glyfs);
-	for (u32 I = 0; I < Font->maxp->GlyphCount; I++) {
-		u32 GlyphOffset = Font_GetGlyphOffset(*Font, I);
-		u32 NextOffset	= Font_GetGlyphOffset(*Font, I + 1);
-		if (NextOffset == GlyphOffset) continue;
-
-		ttf_glyph *Glyph = (ttf_glyph *) (Font->glyfs + GlyphOffset);
-		SWAPENDIAN16(Glyph->ContourCount);
-		SWAPENDIAN16(Glyph->XMin);
-		SWAPENDIAN16(Glyph->YMin);
-		SWAPENDIAN16(Glyph->XMax);
-		SWAPENDIAN16(Glyph->YMax);
-
-		u08 *Data = Glyph->Data;
-		if (Glyph->ContourCount > 0) {
-			for (u16 C = 0; C < Glyph->ContourCount; C++) {
-				SWAPENDIAN16(*(u16 *) Data);
-				Data += 2;
-			}
-
-			SWAPENDIAN16(*(u16 *) Data);
-			Data += 2;
-		} else if (Glyph->ContourCount < 0) {
-			Assert(I < ' ' - 29 || I > '~' - 29);
-		}
-	}
 }
 
 internal void
 Font_LoadheadTable(font *Font)
 {
-	ttf_head *head = Font->head = Font_FindTable(Font, TTF_TAG_head);
-	Assert(head);
+	ttf_head *head	= &Font->head;
+	vptr	  Table = Font_FindTable(Font, TTF_TAG_head);
+	Assert(Table);
+	Mem_Cpy(head, Table, sizeof(ttf_head));
 	SWAPENDIAN32(head->Version);
 	SWAPENDIAN32(head->Revision);
 	SWAPENDIAN32(head->ChecksumAdjustment);
@@ -406,8 +406,10 @@ Font_LoadheadTable(font *Font)
 internal void
 Font_LoadhheaTable(font *Font)
 {
-	ttf_hhea *hhea = Font->hhea = Font_FindTable(Font, TTF_TAG_hhea);
-	Assert(hhea);
+	ttf_hhea *hhea	= &Font->hhea;
+	vptr	  Table = Font_FindTable(Font, TTF_TAG_hhea);
+	Assert(Table);
+	Mem_Cpy(hhea, Table, sizeof(ttf_hhea));
 	SWAPENDIAN32(hhea->Version);
 	SWAPENDIAN16(hhea->Ascent);
 	SWAPENDIAN16(hhea->Descent);
@@ -429,18 +431,9 @@ Font_LoadhmtxTable(font *Font)
 	vptr hmtx = Font_FindTable(Font, TTF_TAG_hmtx);
 	Assert(hmtx);
 	Font->hmtx.HMetrics = hmtx;
-	for (u32 I = 0; I < Font->hhea->HMetricCount; I++) {
-		SWAPENDIAN16(Font->hmtx.HMetrics[I].AdvanceX);
-		SWAPENDIAN16(Font->hmtx.HMetrics[I].LeftBearing);
-	}
 	Font->hmtx.ExtraBearings =
 		(ttf_fword *) ((u08 *) hmtx
-					   + Font->hhea->HMetricCount * sizeof(struct ttf_hmetric));
-	for (
-		u32 I = 0; I < (u32) Font->maxp->GlyphCount - Font->hhea->HMetricCount;
-		I++
-	)
-		SWAPENDIAN16(Font->hmtx.ExtraBearings[I]);
+					   + Font->hhea.HMetricCount * sizeof(struct ttf_hmetric));
 }
 
 internal void
@@ -448,19 +441,15 @@ Font_LoadlocaTable(font *Font)
 {
 	Font->loca = Font_FindTable(Font, TTF_TAG_loca);
 	Assert(Font->loca);
-	if (Font->head->IndexToLocFormat == TTF_LOCA_SHORT_OFFSETS)
-		for (u32 I = 0; I <= Font->maxp->GlyphCount; I++)
-			SWAPENDIAN16(Font->loca->Shorts[I]);
-	else
-		for (u32 I = 0; I <= Font->maxp->GlyphCount; I++)
-			SWAPENDIAN32(Font->loca->Longs[I]);
 }
 
 internal void
 Font_LoadmaxpTable(font *Font)
 {
-	ttf_maxp *maxp = Font->maxp = Font_FindTable(Font, TTF_TAG_maxp);
-	Assert(maxp);
+	ttf_maxp *maxp	= &Font->maxp;
+	vptr	  Table = Font_FindTable(Font, TTF_TAG_maxp);
+	Assert(Table);
+	Mem_Cpy(maxp, Table, sizeof(ttf_maxp));
 	SWAPENDIAN32(maxp->Version);
 	SWAPENDIAN16(maxp->GlyphCount);
 	SWAPENDIAN16(maxp->MaxPoints);
@@ -479,11 +468,12 @@ Font_LoadmaxpTable(font *Font)
 }
 
 internal font
-Font_Init(u08 *FileData)
+Font_Init(heap *Heap, u08 *FileData)
 {
 	Assert(FileData);
 	font Font	  = { 0 };
 	Font.FileBase = FileData;
+	Font.Heap	  = Heap;
 
 	Font_LoadFontDir(&Font);
 	Font_LoadcmapTable(&Font);
@@ -494,52 +484,137 @@ Font_Init(u08 *FileData)
 	Font_LoadlocaTable(&Font);
 	Font_LoadglyfTable(&Font);
 
+	usize PagesSize = FONT_GLYPH_PAGE_COUNT * sizeof(u16 *);
+	Font.GlyphPages = Heap_AllocateA(Heap, PagesSize);
+	Mem_Set(Font.GlyphPages, 0, PagesSize);
+
 	return Font;
 }
 
+internal void
+Font_Deinit(font *Font)
+{
+	for (u32 I = 0; I < FONT_GLYPH_PAGE_COUNT; I++)
+		if (Font->GlyphPages[I]) Heap_FreeA(Font->GlyphPages[I]);
+	Heap_FreeA(Font->GlyphPages);
+	Font->GlyphPages = NULL;
+}
+
+internal font
+Font_Open(heap *Heap, c08 *FileName)
+{
+	file_handle FileHandle;
+	b08			Opened = Platform_OpenFile(&FileHandle, FileName, FILE_READ);
+	Assert(Opened, "Invalid file name!");
+
+	u64	 Length = Platform_GetFileLength(FileHandle);
+	u08 *Data	= Platform_MapFile(FileHandle, Length);
+	Platform_CloseFile(FileHandle);
+	Assert(Data, "Failed to map the font");
+
+	font Font		 = Font_Init(Heap, Data);
+	Font.MappingSize = Length;
+	return Font;
+}
+
+internal void
+Font_Close(font *Font)
+{
+	Assert(Font->MappingSize, "The font wasn't opened with Font_Open");
+	Font_Deinit(Font);
+	Platform_UnmapFile(Font->FileBase, Font->MappingSize);
+	Font->FileBase	  = NULL;
+	Font->MappingSize = 0;
+}
+
 internal u32
-Font_GetGlyphIndex(font Font, u32 Codepoint)
+Font_LookupGlyphIndex(font Font, u32 Codepoint)
 {
 	u32 GlyphIndex = 0;
-	switch (Font.Encoding.Header->Format) {
+	switch (Font.Encoding.Format) {
 		case 4: {
 			ttf_cmap_subtable_4 *Table = &Font.Encoding.Type4;
 			u32					 Index;
 			u32					 Start = 0;
 			u32					 End   = Table->SegCountX2 / 2;
+			u32					 StartCode;
 			while (Start != End) {
-				Index = Start + (End - Start) / 2;
-				if (Table->EndCodes[Index] < Codepoint) Start = Index + 1;
-				else if (Table->StartCodes[Index] > Codepoint) End = Index;
+				Index	  = Start + (End - Start) / 2;
+				StartCode = Font_ReadU16(Table->StartCodes + Index);
+				if (Font_ReadU16(Table->EndCodes + Index) < Codepoint)
+					Start = Index + 1;
+				else if (StartCode > Codepoint) End = Index;
 				else break;
 			}
 			if (Start != End) {
-				u32 Offset = Table->RangeOffsets[Index] / 2;
+				s16 Delta  = (s16) Font_ReadU16(Table->Deltas + Index);
+				u32 Offset = Font_ReadU16(Table->RangeOffsets + Index) / 2;
 				if (Offset) {
-					u32 CodepointOffset = Codepoint - Table->StartCodes[Index];
-					GlyphIndex			= *(
+					u32 CodepointOffset = Codepoint - StartCode;
+					GlyphIndex			= Font_ReadU16(
 						Table->RangeOffsets + Index + Offset + CodepointOffset
 					);
-					if (GlyphIndex) GlyphIndex += Table->Deltas[Index];
+					if (GlyphIndex) GlyphIndex += Delta;
 				} else {
-					GlyphIndex = Codepoint + Table->Deltas[Index];
+					GlyphIndex = Codepoint + Delta;
 				}
 			}
 			GlyphIndex %= (u32) U16_MAX + 1;
 		} break;
+
+		case 12: {
+			ttf_cmap_subtable_12 *Table = &Font.Encoding.Type12;
+			u32					  Start = 0;
+			u32					  End	= Table->GroupCount;
+			while (Start != End) {
+				u32				Index	  = Start + (End - Start) / 2;
+				ttf_cmap_group *Group	  = Table->Groups + Index;
+				u32				StartCode = Font_ReadU32(&Group->StartCode);
+				if (Font_ReadU32(&Group->EndCode) < Codepoint) Start = Index + 1;
+				else if (StartCode > Codepoint) End = Index;
+				else {
+					GlyphIndex = Font_ReadU32(&Group->StartGlyph)
+							   + (Codepoint - StartCode);
+					break;
+				}
+			}
+		} break;
 	}
+
+	if (GlyphIndex >= Font.maxp.GlyphCount) GlyphIndex = 0;
 	return GlyphIndex;
 }
 
+// Not thread safe, since the first lookup in a page fills it in.
+internal u32
+Font_GetGlyphIndex(font Font, u32 Codepoint)
+{
+	if (Codepoint >= FONT_GLYPH_PAGE_COUNT * FONT_GLYPH_PAGE_SIZE) return 0;
+
+	u16 **Page = Font.GlyphPages + Codepoint / FONT_GLYPH_PAGE_SIZE;
+	if (!*Page) {
+		*Page = Heap_AllocateA(Font.Heap, FONT_GLYPH_PAGE_SIZE * sizeof(u16));
+
+		u32 First = Codepoint - Codepoint % FONT_GLYPH_PAGE_SIZE;
+		for (u32 I = 0; I < FONT_GLYPH_PAGE_SIZE; I++)
+			(*Page)[I] = Font_LookupGlyphIndex(Font, First + I);
+	}
+
+	return (*Page)[Codepoint % FONT_GLYPH_PAGE_SIZE];
+}
+
 #define SIN_ALPHA 0.08715574274765817355806427083747
 internal void
 Font_FindSegments(msdf_shape *Shape, u08 *Data)
 {
-	u16 *EndPointsOfContours  = (u16 *) Data;
-	Data					 += Shape->ContourCount * sizeof(u16);
-	u16 InstructionLength	  = *(u16 *) Data;
-	Data					 += 2;
-	Data					 += InstructionLength;
+	// The contour end points get swapped into scratch, since they're read
+	// over and over.
+	u16 *EndPointsOfContours = Stack_Allocate(Shape->ContourCount * sizeof(u16));
+	for (u32 C = 0; C < Shape->ContourCount; C++, Data += 2)
+		EndPointsOfContours[C] = Font_ReadU16(Data);
+	u16 InstructionLength  = Font_ReadU16(Data);
+	Data				  += 2;
+	Data				  += InstructionLength;
 
 	u32 VertexCount		= EndPointsOfContours[Shape->ContourCount - 1] + 1;
 	Shape->SegmentCount = VertexCount;
@@ -582,7 +657,7 @@ Font_FindSegments(msdf_shape *Shape, u08 *Data)
 			s16 Delta  = *Data++;
 			Pos.X	  += (Flags[F] & TTF_VERTEX_POS_X) ? Delta : -Delta;
 		} else if (!(Flags[F] & TTF_VERTEX_SAME_X)) {
-			Pos.X += (s16) _SWAPENDIAN16(*(u16 *) Data);
+			Pos.X += (s16) Font_ReadU16(Data);
 			Data  += 2;
 		}
 		if (Flags[F] & TTF_VERTEX_ON_CURVE) {
@@ -606,7 +681,7 @@ Font_FindSegments(msdf_shape *Shape, u08 *Data)
 			s16 Delta  = *Data++;
 			Pos.Y	  += (Flags[F] & TTF_VERTEX_POS_Y) ? Delta : -Delta;
 		} else if (!(Flags[F] & TTF_VERTEX_SAME_Y)) {
-			Pos.Y += (s16) _SWAPENDIAN16(*(u16 *) Data);
+			Pos.Y += (s16) Font_ReadU16(Data);
 			Data  += 2;
 		}
 		if (Flags[F] & TTF_VERTEX_ON_CURVE) {
@@ -708,29 +783,36 @@ Font_GetGlyph(font Font, u32 Codepoint, r32 Scale)
 	font_glyph Glyph	  = { 0 };
 	u32		   GlyphIndex = Font_GetGlyphIndex(Font, Codepoint);
 
-	if (GlyphIndex < Font.hhea->HMetricCount) {
-		Glyph.Advance	= Font.hmtx.HMetrics[GlyphIndex].AdvanceX * Scale;
-		Glyph.Bearing.X = Font.hmtx.HMetrics[GlyphIndex].LeftBearing * Scale;
+	u32					HMetricCount = Font.hhea.HMetricCount;
+	struct ttf_hmetric *HMetrics	 = Font.hmtx.HMetrics;
+	if (GlyphIndex < HMetricCount) {
+		s16 Bearing		= (s16) Font_ReadU16(&HMetrics[GlyphIndex].LeftBearing);
+		Glyph.Advance	= Font_ReadU16(&HMetrics[GlyphIndex].AdvanceX) * Scale;
+		Glyph.Bearing.X = Bearing * Scale;
 	} else {
+		ttf_fword *Bearing = Font.hmtx.ExtraBearings + GlyphIndex - HMetricCount;
 		Glyph.Advance =
-			Font.hmtx.HMetrics[Font.hhea->HMetricCount - 1].AdvanceX * Scale;
-		Glyph.Bearing.X =
-			Font.hmtx.ExtraBearings[GlyphIndex - Font.hhea->HMetricCount]
-			* Scale;
+			Font_ReadU16(&HMetrics[HMetricCount - 1].AdvanceX) * Scale;
+		Glyph.Bearing.X = (s16) Font_ReadU16(Bearing) * Scale;
 	}
 
 	u32		   Offset	  = Font_GetGlyphOffset(Font, GlyphIndex);
 	u32		   NextOffset = Font_GetGlyphOffset(Font, GlyphIndex + 1);
 	ttf_glyph *GlyphData  = (ttf_glyph *) (Font.glyfs + Offset);
 
-	if (NextOffset == Offset) {
+	// Composite glyphs aren't supported, so they're left without an outline.
+	s16 ContourCount = 0;
+	if (NextOffset != Offset)
+		ContourCount = (s16) Font_ReadU16(&GlyphData->ContourCount);
+
+	if (ContourCount <= 0) {
 		Glyph.Bearing.Y = 0;
 		Glyph.Size		= (v2r32){ 0 };
 	} else {
-		Glyph.Shape.Bounds.X = GlyphData->XMin;
-		Glyph.Shape.Bounds.Y = GlyphData->YMin;
-		Glyph.Shape.Bounds.Z = GlyphData->XMax;
-		Glyph.Shape.Bounds.W = GlyphData->YMax;
+		Glyph.Shape.Bounds.X = (s16) Font_ReadU16(&GlyphData->XMin);
+		Glyph.Shape.Bounds.Y = (s16) Font_ReadU16(&GlyphData->YMin);
+		Glyph.Shape.Bounds.Z = (s16) Font_ReadU16(&GlyphData->XMax);
+		Glyph.Shape.Bounds.W = (s16) Font_ReadU16(&GlyphData->YMax);
 		r32 SX				 = Glyph.Shape.Bounds.X * Scale;
 		r32 SY				 = -Glyph.Shape.Bounds.W * Scale;
 		r32 EX				 = Glyph.Shape.Bounds.Z * Scale;
@@ -738,7 +820,7 @@ Font_GetGlyph(font Font, u32 Codepoint, r32 Scale)
 		Glyph.Bearing.Y		 = -EY;
 		Glyph.Size			 = (v2r32){ EX - SX, EY - SY };
 
-		Glyph.Shape.ContourCount = GlyphData->ContourCount;
+		Glyph.Shape.ContourCount = ContourCount;
 		Font_FindSegments(&Glyph.Shape, GlyphData->Data);
 
 		u32 TotalE = 0, TotalV = 0;
@@ -797,4 +879,248 @@ Font_GetGlyph(font Font, u32 Codepoint, r32 Scale)
 	return Glyph;
 }
 
+internal u08 *
+Font_WriteU16(u08 *Data, u32 Value)
+{
+	Data[0] = (u08) (Value >> 8);
+	Data[1] = (u08) Value;
+	return Data + 2;
+}
+
+internal u08 *
+Font_WriteU32(u08 *Data, u32 Value)
+{
+	Data = Font_WriteU16(Data, Value >> 16);
+	return Font_WriteU16(Data, Value);
+}
+
+// Both formats map 'A' to glyph 1. In format 4, 'A' through 'C' map by delta,
+// U+100 through U+102 go through the glyph array, and U+2000 maps past the
+// last glyph. Format 12 maps the capitals, some emoji and the end of unicode.
+internal u08 *
+Font_WriteTestSubtable(u08 *Data, u32 Format)
+{
+	if (Format == 4) {
+		u16 Words[] = {
+			4, 54, 0, 8, 8, 2, 0,				   // Header
+			0x0043, 0x0102, 0x2000, 0xFFFF, 0,	   // End codes, reserved pad
+			0x0041, 0x0100, 0x2000, 0xFFFF,		   // Start codes
+			(u16) -0x40, 5, (u16) (250 - 0x2000), 1, // Deltas
+			0, 3 * sizeof(u16), 0, 0,			   // Range offsets
+			10, 0, 12,							   // Glyph IDs
+		};
+		for (u32 I = 0; I < sizeof(Words) / sizeof(u16); I++)
+			Data = Font_WriteU16(Data, Words[I]);
+	} else {
+		u32 Words[] = {
+			12 << 16, 52, 0, 3,			 // Header, with the reserved u16
+			0x41, 0x5A, 1,				 // Groups
+			0x1F600, 0x1F602, 100,
+			0x10FFF0, 0x10FFFF, 190,
+		};
+		for (u32 I = 0; I < sizeof(Words) / sizeof(u32); I++)
+			Data = Font_WriteU32(Data, Words[I]);
+	}
+	return Data;
+}
+
+// Builds a font in scratch memory with 200 glyphs, where glyph 1 is a triangle
+// and the rest are empty. It has a test subtable of the given format for
+// each encoding, which holds the platform ID in its high half and the
+// platform specific ID in its low half, and has no cmap if Count is 0.
+internal u08 *
+Font_MakeTestFile(u32 Count, u32 *Encodings, u32 *Formats, u32 *SizeOut)
+{
+	u32 GlyphCount = 200;
+	u08 Triangle[] = {
+		0, 1, 0, 0, 0, 0, 0x01, 0x90, 0x01, 0xF4, // Contours and bounds
+		0, 2, 0, 0, 1, 1, 1,					  // End point and flags
+		0, 0, 0x01, 0x90, 0xFF, 0x38,			  // X: 0, 400, 200
+		0, 0, 0, 0, 0x01, 0xF4,					  // Y: 0, 0, 500
+	};
+
+	u32 Tags[] = { TTF_TAG_cmap, TTF_TAG_glyf, TTF_TAG_head, TTF_TAG_hhea,
+				   TTF_TAG_hmtx, TTF_TAG_loca, TTF_TAG_maxp };
+	u32 Sizes[] = {
+		4 + Count * 64,
+		sizeof(Triangle),
+		sizeof(ttf_head),
+		sizeof(ttf_hhea),
+		sizeof(struct ttf_hmetric) + (GlyphCount - 1) * sizeof(ttf_fword),
+		(GlyphCount + 1) * sizeof(u16),
+		sizeof(ttf_maxp),
+	};
+	u32 First	   = Count ? 0 : 1;
+	u32 TableCount = sizeof(Tags) / sizeof(u32) - First;
+
+	u32 Size = sizeof(ttf_font_dir) + TableCount * 16;
+	for (u32 I = First; I < First + TableCount; I++)
+		Size += ALIGN_UP(Sizes[I], 4);
+	u08 *File = Stack_Allocate(Size);
+	Mem_Set(File, 0, Size);
+
+	u08 *Entry = Font_WriteU32(File, 0x00010000);
+	Entry	   = Font_WriteU16(Entry, TableCount) + 6;
+	u08 *Table = File + sizeof(ttf_font_dir) + TableCount * 16;
+	for (u32 I = First; I < First + TableCount; I++) {
+		switch (Tags[I]) {
+			case TTF_TAG_cmap: {
+				u08 *Data = Font_WriteU16(Table, 0);
+				Data	  = Font_WriteU16(Data, Count);
+				u08 *Subtable = Data + Count * 8;
+				for (u32 J = 0; J < Count; J++) {
+					Data	 = Font_WriteU32(Data, Encodings[J]);
+					Data	 = Font_WriteU32(Data, Subtable - Table);
+					Subtable = Font_WriteTestSubtable(Subtable, Formats[J]);
+				}
+			} break;
+
+			case TTF_TAG_glyf: {
+				Mem_Cpy(Table, Triangle, sizeof(Triangle));
+			} break;
+
+			case TTF_TAG_hhea: {
+				Font_WriteU16(Table + OFFSET_OF(ttf_hhea, HMetricCount), 1);
+			} break;
+
+			case TTF_TAG_hmtx: {
+				Font_WriteU16(Table, 500);
+			} break;
+
+			case TTF_TAG_loca: {
+				// Offsets are halved in the short format.
+				for (u32 J = 2; J <= GlyphCount; J++)
+					Font_WriteU16(Table + J * 2, (sizeof(Triangle) + 1) / 2);
+			} break;
+
+			case TTF_TAG_maxp: {
+				u08 *Data = Table + OFFSET_OF(ttf_maxp, GlyphCount);
+				Font_WriteU16(Data, GlyphCount);
+			} break;
+		}
+
+		Entry  = Font_WriteU32(Entry, Tags[I]);
+		Entry  = Font_WriteU32(Entry, 0);
+		Entry  = Font_WriteU32(Entry, Table - File);
+		Entry  = Font_WriteU32(Entry, Sizes[I]);
+		Table += ALIGN_UP(Sizes[I], 4);
+	}
+
+	*SizeOut = Size;
+	return File;
+}
+
+// Writes a test font from Font_MakeTestFile to disk for Font_Open, and
+// returns its size.
+internal u32
+Font_SaveTestFile(c08 *FileName, u32 Count, u32 *Encodings, u32 *Formats)
+{
+	Stack_Push();
+	u32	 Size;
+	u08 *Data = Font_MakeTestFile(Count, Encodings, Formats, &Size);
+
+	file_handle File;
+	file_mode	Mode   = FILE_WRITE | FILE_CREATE | FILE_CLEAR;
+	b08			Opened = Platform_OpenFile(&File, FileName, Mode);
+	Assert(Opened, "Couldn't create the test font");
+	u64 Written = Platform_WriteFile(File, Data, Size, 0);
+	Assert(Written == Size, "Couldn't write the test font");
+	Platform_CloseFile(File);
+	Stack_Pop();
+	return Size;
+}
+
+#ifndef REGION_FONT_TESTS
+
+#define FONT_TESTS                                                            \
+	TEST(Font_GetGlyphIndex, ReadsFormat4, (                                  \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x00030001 }, Formats[] = { 4 }, Size;            \
+		u08 *File = Font_MakeTestFile(1, Encodings, Formats, &Size);          \
+		font Font = Font_Init(Heap, File);                                    \
+		Assert(Font.Encoding.Format == 4);                                    \
+		Assert(Font_GetGlyphIndex(Font, 'A') == 1);                           \
+		Assert(Font_GetGlyphIndex(Font, 'C') == 3);                           \
+		Assert(Font_GetGlyphIndex(Font, 'D') == 0);                           \
+		Assert(Font_GetGlyphIndex(Font, 0x100) == 15);                        \
+		Assert(Font_GetGlyphIndex(Font, 0x101) == 0);                         \
+		Assert(Font_GetGlyphIndex(Font, 0x102) == 17);                        \
+		Assert(Font_GetGlyphIndex(Font, 0xFFFF) == 0);                        \
+		Assert(Font_GetGlyphIndex(Font, 0x1F600) == 0);                       \
+                                                                              \
+		/* Glyph 250 is past the end of the font */                           \
+		Assert(Font_GetGlyphIndex(Font, 0x2000) == 0);                        \
+		Font_Deinit(&Font);                                                   \
+	))                                                                        \
+	TEST(Font_GetGlyphIndex, PrefersFormat12, (                               \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x00030001, 0x0003000A }, Formats[] = { 4, 12 };  \
+		u32 Size;                                                             \
+		u08 *File = Font_MakeTestFile(2, Encodings, Formats, &Size);          \
+		font Font = Font_Init(Heap, File);                                    \
+		Assert(Font.Encoding.Format == 12);                                   \
+		Assert(Font_GetGlyphIndex(Font, 'A') == 1);                           \
+		Assert(Font_GetGlyphIndex(Font, 'D') == 4);                           \
+		Assert(Font_GetGlyphIndex(Font, 0x100) == 0);                         \
+		Assert(Font_GetGlyphIndex(Font, 0x1F601) == 101);                     \
+		Assert(Font_GetGlyphIndex(Font, 0x1F603) == 0);                       \
+		Assert(Font_GetGlyphIndex(Font, 0x10FFF9) == 199);                    \
+		Assert(Font_GetGlyphIndex(Font, 0x10FFFA) == 0);                      \
+		Assert(Font_GetGlyphIndex(Font, 0x110000) == 0);                      \
+		Font_Deinit(&Font);                                                   \
+	))                                                                        \
+	TEST(Font_GetGlyphIndex, CachesPages, (                                   \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x00000003 }, Formats[] = { 12 }, Size;           \
+		u08 *File = Font_MakeTestFile(1, Encodings, Formats, &Size);          \
+		font Font = Font_Init(Heap, File);                                    \
+		Assert(Font_GetGlyphIndex(Font, 'A') == 1);                           \
+		Assert(Font.GlyphPages[0] && !Font.GlyphPages[1]);                    \
+                                                                              \
+		/* Later lookups in the page don't read the cmap again */             \
+		ttf_cmap_group *Group = Font.Encoding.Type12.Groups;                  \
+		Font_WriteU32((u08 *) &Group->StartGlyph, 50);                        \
+		Assert(Font_LookupGlyphIndex(Font, 'B') == 51);                       \
+		Assert(Font_GetGlyphIndex(Font, 'B') == 2);                           \
+		Assert(Font_GetGlyphIndex(Font, 0x141) == 0);                         \
+		Assert(Font.GlyphPages[1]);                                           \
+		Font_Deinit(&Font);                                                   \
+	))                                                                        \
+	TEST(Font_GetGlyphIndex, MapsToZeroWithoutCmap, (                         \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Size;                                                             \
+		u08 *File = Font_MakeTestFile(0, NULL, NULL, &Size);                  \
+		font Font = Font_Init(Heap, File);                                    \
+		Assert(!Font.cmap && !Font.Encoding.Format);                          \
+		Assert(Font_GetGlyphIndex(Font, 'A') == 0);                           \
+		Font_Deinit(&Font);                                                   \
+                                                                              \
+		/* Macintosh subtables aren't unicode */                              \
+		u32 Encodings[] = { 0x00010000 }, Formats[] = { 4 };                  \
+		File = Font_MakeTestFile(1, Encodings, Formats, &Size);               \
+		Font = Font_Init(Heap, File);                                         \
+		Assert(Font.cmap && !Font.Encoding.Format);                           \
+		Assert(Font_GetGlyphIndex(Font, 'A') == 0);                           \
+		Assert(Font_GetGlyphIndex(Font, 0x1F600) == 0);                       \
+		Font_Deinit(&Font);                                                   \
+	))                                                                        \
+	TEST(Font_Open, UnmapsOnClose, (                                          \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x0003000A }, Formats[] = { 12 };                 \
+		u32 Size = Font_SaveTestFile("font_test.ttf", 1, Encodings, Formats); \
+		font Font = Font_Open(Heap, "font_test.ttf");                         \
+		Assert(Font.FileBase && Font.MappingSize == Size);                    \
+		Assert(Font_GetGlyphIndex(Font, 0x1F600) == 100);                     \
+		Font_Close(&Font);                                                    \
+		Assert(!Font.FileBase && !Font.MappingSize && !Font.GlyphPages);      \
+	))                                                                        \
+	//
+
+#endif
+
 #endif
@@ -0,0 +1,470 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *\
+*                                                                             *
+*  Author: Aria Seiler                                                        *
+*                                                                             *
+*  This program is in the public domain. There is no implied warranty, so     *
+*  use it at your own risk.                                                   *
+*                                                                             *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifdef INCLUDE_HEADER
+
+// The cache file is a header followed by records, which are only ever
+// appended. The version has to be bumped whenever the layout or the MSDF
+// output changes, since the distance range isn't stored and comes from the
+// generator.
+#define GLYPH_CACHE_MAGIC	0x43594C47 // GLYC
+#define GLYPH_CACHE_VERSION 1
+
+typedef struct glyph_cache_header {
+	u32 Magic;
+	u32 Version;
+	u64 FontHash;
+} glyph_cache_header;
+
+typedef struct glyph_cache_key {
+	u32	  GlyphIndex;
+	r32	  Scale;
+	v2u32 SlotSize;
+} glyph_cache_key;
+
+// The tile is the whole slot given to MSDF_DrawShape, border included, and is
+// left out for glyphs without an outline.
+typedef struct glyph_cache_record {
+	glyph_cache_key Key;
+	r32				Advance;
+	v2r32			Bearing;
+	v2r32			Size;
+	u32				PixelCount;
+	v4u08			Pixels[0];
+} glyph_cache_record;
+
+// Records generated this run live on the heap, since the mapping is fixed.
+typedef struct glyph_cache_block {
+	struct glyph_cache_block *Next;
+	glyph_cache_record		  Record;
+} glyph_cache_block;
+
+// Not thread safe. If the file can't be opened, glyphs are only kept in
+// memory.
+typedef struct glyph_cache glyph_cache;
+
+#define GLYPH_FUNCS \
+   EXPORT(glyph_cache*,        GlyphCache_Open,  heap *Heap, c08 *CachePath, c08 *FontPath) \
+   EXPORT(glyph_cache_record*, GlyphCache_Get,   glyph_cache *Cache, font Font, u32 Codepoint, r32 Scale, v2u32 SlotSize) \
+   EXPORT(void,                GlyphCache_Close, glyph_cache *Cache)
+
+#endif
+
+#ifdef INCLUDE_SOURCE
+
+// Defined here since the platform types aren't visible in the header.
+struct glyph_cache {
+	heap			  *Heap;
+	hashmap			   Records;
+	glyph_cache_block *Blocks;
+
+	file_handle File;
+	b08			Persistent;
+	u64			FontHash;
+	u64			FileSize;
+	vptr		Mapping;
+	u64			MappingSize;
+};
+
+internal u64
+GlyphCache_HashFile(c08 *FileName)
+{
+	file_handle FileHandle;
+	b08			Opened = Platform_OpenFile(&FileHandle, FileName, FILE_READ);
+	Assert(Opened, "Invalid file name!");
+
+	u64	 Length = Platform_GetFileLength(FileHandle);
+	u08 *Data	= Platform_MapFile(FileHandle, Length);
+
+	// FNV-1a
+	u64 Hash = 0xCBF29CE484222325;
+	for (u64 I = 0; I < Length; I++) {
+		Hash ^= Data[I];
+		Hash *= 0x100000001B3;
+	}
+
+	Platform_UnmapFile(Data, Length);
+	Platform_CloseFile(FileHandle);
+	return Hash;
+}
+
+internal usize
+GlyphCache_RecordSize(u32 PixelCount)
+{ return sizeof(glyph_cache_record) + PixelCount * sizeof(v4u08); }
+
+// Only succeeds if every record is whole, so a write that was cut short
+// invalidates the file rather than leaving garbage for later appends to land
+// behind.
+internal b08
+GlyphCache_IsValid(glyph_cache *Cache)
+{
+	u08 *Data = Cache->Mapping;
+	u64	 Size = Cache->MappingSize;
+
+	if (Size < sizeof(glyph_cache_header)) return FALSE;
+
+	glyph_cache_header *Header = (glyph_cache_header *) Data;
+	if (Header->Magic != GLYPH_CACHE_MAGIC) return FALSE;
+	if (Header->Version != GLYPH_CACHE_VERSION) return FALSE;
+	if (Header->FontHash != Cache->FontHash) return FALSE;
+
+	u64 Offset = sizeof(glyph_cache_header);
+	while (Offset < Size) {
+		if (Size - Offset < sizeof(glyph_cache_record)) return FALSE;
+
+		glyph_cache_record *Record = (glyph_cache_record *) (Data + Offset);
+		v2u32				Slot   = Record->Key.SlotSize;
+		if (Record->PixelCount && Record->PixelCount != Slot.X * Slot.Y)
+			return FALSE;
+
+		u64 RecordSize = GlyphCache_RecordSize(Record->PixelCount);
+		if (Size - Offset < RecordSize) return FALSE;
+		Offset += RecordSize;
+	}
+
+	return TRUE;
+}
+
+internal void
+GlyphCache_IndexRecords(glyph_cache *Cache)
+{
+	u08 *Data	= Cache->Mapping;
+	u64	 Offset = sizeof(glyph_cache_header);
+
+	while (Offset < Cache->MappingSize) {
+		glyph_cache_record *Record = (glyph_cache_record *) (Data + Offset);
+		HashMap_Add(&Cache->Records, &Record->Key, &Record);
+		Offset += GlyphCache_RecordSize(Record->PixelCount);
+	}
+}
+
+internal glyph_cache *
+GlyphCache_Open(heap *Heap, c08 *CachePath, c08 *FontPath)
+{
+	glyph_cache *Cache = Heap_AllocateA(Heap, sizeof(glyph_cache));
+	Mem_Set(Cache, 0, sizeof(glyph_cache));
+	Cache->Heap		= Heap;
+	Cache->FontHash = GlyphCache_HashFile(FontPath);
+	Cache->Records	= HashMap_Init(
+		Heap,
+		sizeof(glyph_cache_key),
+		sizeof(glyph_cache_record *)
+	);
+
+	file_mode Mode	  = FILE_READ | FILE_WRITE | FILE_CREATE;
+	Cache->Persistent = Platform_OpenFile(&Cache->File, CachePath, Mode);
+	if (!Cache->Persistent) return Cache;
+
+	Cache->MappingSize = Platform_GetFileLength(Cache->File);
+	Cache->Mapping	   = Platform_MapFile(Cache->File, Cache->MappingSize);
+
+	if (GlyphCache_IsValid(Cache)) {
+		GlyphCache_IndexRecords(Cache);
+		Cache->FileSize = Cache->MappingSize;
+		return Cache;
+	}
+
+	// It's stale or damaged, so start over.
+	Platform_UnmapFile(Cache->Mapping, Cache->MappingSize);
+	Platform_CloseFile(Cache->File);
+	Cache->Mapping	   = NULL;
+	Cache->MappingSize = 0;
+
+	Mode			  = Mode | FILE_CLEAR;
+	Cache->Persistent = Platform_OpenFile(&Cache->File, CachePath, Mode);
+	if (!Cache->Persistent) return Cache;
+
+	glyph_cache_header Header = {
+		.Magic	  = GLYPH_CACHE_MAGIC,
+		.Version  = GLYPH_CACHE_VERSION,
+		.FontHash = Cache->FontHash,
+	};
+	Cache->FileSize =
+		Platform_WriteFile(Cache->File, &Header, sizeof(Header), 0);
+	if (Cache->FileSize != sizeof(Header)) {
+		Platform_CloseFile(Cache->File);
+		Cache->Persistent = FALSE;
+	}
+	return Cache;
+}
+
+internal glyph_cache_record *
+GlyphCache_Get(
+	glyph_cache *Cache,
+	font		 Font,
+	u32			 Codepoint,
+	r32			 Scale,
+	v2u32		 SlotSize
+)
+{
+	glyph_cache_key Key = {
+		.GlyphIndex = Font_GetGlyphIndex(Font, Codepoint),
+		.Scale		= Scale,
+		.SlotSize	= SlotSize,
+	};
+
+	glyph_cache_record *Record;
+	if (HashMap_Get(&Cache->Records, &Key, &Record)) return Record;
+
+	Stack_Push();
+	font_glyph Glyph = Font_GetGlyph(Font, Codepoint, Scale);
+
+	u32	  PixelCount = Glyph.Shape.ContourCount ? SlotSize.X * SlotSize.Y : 0;
+	usize RecordSize = GlyphCache_RecordSize(PixelCount);
+
+	glyph_cache_block *Block = Heap_AllocateA(
+		Cache->Heap,
+		sizeof(glyph_cache_block) + PixelCount * sizeof(v4u08)
+	);
+	Block->Next		   = Cache->Blocks;
+	Cache->Blocks	   = Block;
+	Record			   = &Block->Record;
+	Record->Key		   = Key;
+	Record->Advance	   = Glyph.Advance;
+	Record->Bearing	   = Glyph.Bearing;
+	Record->Size	   = Glyph.Size;
+	Record->PixelCount = PixelCount;
+
+	if (PixelCount) {
+		v2u32 Pos  = { 0 };
+		v2u32 Size = SlotSize;
+		MSDF_DrawShape(
+			Glyph.Shape,
+			&Pos,
+			&Size,
+			Record->Pixels,
+			(v2u32){ 0 },
+			0,
+			SlotSize
+		);
+	}
+	Stack_Pop();
+
+	// Appending after a partial record would only add to what gets thrown
+	// away on the next open, so stop persisting after a short write.
+	if (Cache->Persistent) {
+		u64 Written =
+			Platform_WriteFile(Cache->File, Record, RecordSize, Cache->FileSize);
+		Cache->FileSize += Written;
+		if (Written != RecordSize) {
+			Platform_CloseFile(Cache->File);
+			Cache->Persistent = FALSE;
+		}
+	}
+
+	HashMap_Add(&Cache->Records, &Key, &Record);
+	return Record;
+}
+
+internal void
+GlyphCache_Close(glyph_cache *Cache)
+{
+	while (Cache->Blocks) {
+		glyph_cache_block *Next = Cache->Blocks->Next;
+		Heap_FreeA(Cache->Blocks);
+		Cache->Blocks = Next;
+	}
+
+	// The file may have been closed early by a short write, but the records
+	// read from it still live in the mapping until now.
+	if (Cache->Mapping) Platform_UnmapFile(Cache->Mapping, Cache->MappingSize);
+	if (Cache->Persistent) Platform_CloseFile(Cache->File);
+
+	HashMap_Free(&Cache->Records);
+	Heap_FreeA(Cache);
+}
+
+internal u64
+GlyphCache_GetTestFileLength(c08 *FileName)
+{
+	file_handle File;
+	b08			Opened = Platform_OpenFile(&File, FileName, FILE_READ);
+	Assert(Opened, "Couldn't open the test file");
+	u64 Length = Platform_GetFileLength(File);
+	Platform_CloseFile(File);
+	return Length;
+}
+
+// The platform can't truncate files, so this reads back the part that's
+// kept, clears the file and writes it again. The file is created if needed.
+internal void
+GlyphCache_TruncateTestFile(c08 *FileName, u64 Length)
+{
+	Stack_Push();
+	u08 *Data = Stack_Allocate(Length);
+
+	file_handle File;
+	file_mode	Mode   = FILE_READ | FILE_WRITE | FILE_CREATE;
+	b08			Opened = Platform_OpenFile(&File, FileName, Mode);
+	Assert(Opened, "Couldn't open the test file");
+	u64 Read = Length ? Platform_ReadFile(File, Data, Length, 0) : 0;
+	Assert(Read == Length, "The test file is too short");
+	Platform_CloseFile(File);
+
+	Opened = Platform_OpenFile(&File, FileName, FILE_CLEAR);
+	Assert(Opened, "Couldn't clear the test file");
+	u64 Written = Length ? Platform_WriteFile(File, Data, Length, 0) : 0;
+	Assert(Written == Length, "Couldn't write the test file");
+	Platform_CloseFile(File);
+	Stack_Pop();
+}
+
+internal void
+GlyphCache_PatchTestFile(c08 *FileName, u64 Offset, vptr Data, u64 Size)
+{
+	file_handle File;
+	b08			Opened = Platform_OpenFile(&File, FileName, FILE_WRITE);
+	Assert(Opened, "Couldn't open the test file");
+	u64 Written = Platform_WriteFile(File, Data, Size, Offset);
+	Assert(Written == Size, "Couldn't patch the test file");
+	Platform_CloseFile(File);
+}
+
+// Fills a new cache for the test font with a drawn glyph and an empty one,
+// and returns the size of the file.
+internal u64
+GlyphCache_MakeTestFile(heap *Heap, font Font)
+{
+	GlyphCache_TruncateTestFile("glyph_test.cache", 0);
+	glyph_cache *Cache =
+		GlyphCache_Open(Heap, "glyph_test.cache", "glyph_test.ttf");
+	GlyphCache_Get(Cache, Font, 'A', 1 / 32.0f, (v2u32){ 16, 16 });
+	GlyphCache_Get(Cache, Font, 'B', 1 / 32.0f, (v2u32){ 16, 16 });
+	GlyphCache_Close(Cache);
+	return sizeof(glyph_cache_header) + GlyphCache_RecordSize(16 * 16)
+		 + GlyphCache_RecordSize(0);
+}
+
+#ifndef REGION_GLYPH_TESTS
+
+// Every test uses glyph_test.ttf and glyph_test.cache in the working
+// directory. A cache that was thrown out and rebuilt has nothing mapped.
+#define GLYPH_TESTS                                                           \
+	TEST(GlyphCache_Get, AppendsAcrossRuns, (                                 \
+		u32 HeapSize = 256 * 1024;                                            \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x0003000A }, Formats[] = { 12 };                 \
+		Font_SaveTestFile("glyph_test.ttf", 1, Encodings, Formats);           \
+		font Font = Font_Open(Heap, "glyph_test.ttf");                        \
+		c08 *Path = "glyph_test.cache";                                       \
+		GlyphCache_TruncateTestFile(Path, 0);                                 \
+                                                                              \
+		v2u32 Slot = { 16, 16 };                                              \
+		r32 Scale = 1 / 32.0f;                                                \
+		glyph_cache *Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");   \
+		Assert(Cache->Persistent && !Cache->Records.EntryCount);              \
+		glyph_cache_record *A, *B;                                            \
+		A = GlyphCache_Get(Cache, Font, 'A', Scale, Slot);                    \
+		B = GlyphCache_Get(Cache, Font, 'B', Scale, Slot);                    \
+		Assert(A->PixelCount == 16 * 16 && !B->PixelCount);                   \
+		Assert(GlyphCache_Get(Cache, Font, 'A', Scale, Slot) == A);           \
+		v4u08 *Pixels = Stack_Allocate(16 * 16 * sizeof(v4u08));              \
+		Mem_Cpy(Pixels, A->Pixels, 16 * 16 * sizeof(v4u08));                  \
+                                                                              \
+		/* The size counts what was written, so it matches the file */        \
+		u64 Length = sizeof(glyph_cache_header) + GlyphCache_RecordSize(256)  \
+				   + GlyphCache_RecordSize(0);                                \
+		Assert(Cache->FileSize == Length);                                    \
+		GlyphCache_Close(Cache);                                              \
+		Assert(GlyphCache_GetTestFileLength(Path) == Length);                 \
+                                                                              \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(Cache->Mapping && Cache->Records.EntryCount == 2);             \
+		A = GlyphCache_Get(Cache, Font, 'A', Scale, Slot);                    \
+		Assert((u08 *) A - (u08 *) Cache->Mapping < Cache->MappingSize);      \
+		Assert(!Mem_Cmp(A->Pixels, Pixels, 16 * 16 * sizeof(v4u08)));         \
+		GlyphCache_Get(Cache, Font, 'C', Scale, Slot);                        \
+		Length += GlyphCache_RecordSize(0);                                   \
+		Assert(Cache->FileSize == Length);                                    \
+		GlyphCache_Close(Cache);                                              \
+		Assert(GlyphCache_GetTestFileLength(Path) == Length);                 \
+                                                                              \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(Cache->Mapping && Cache->Records.EntryCount == 3);             \
+		GlyphCache_Close(Cache);                                              \
+		Font_Close(&Font);                                                    \
+	))                                                                        \
+	TEST(GlyphCache_Open, RejectsTruncatedRecords, (                          \
+		u32 HeapSize = 256 * 1024;                                            \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x0003000A }, Formats[] = { 12 };                 \
+		Font_SaveTestFile("glyph_test.ttf", 1, Encodings, Formats);           \
+		font Font = Font_Open(Heap, "glyph_test.ttf");                        \
+		c08 *Path = "glyph_test.cache";                                       \
+		u64 HeaderSize = sizeof(glyph_cache_header);                          \
+                                                                              \
+		/* The last record is cut short */                                    \
+		u64 Length = GlyphCache_MakeTestFile(Heap, Font);                     \
+		GlyphCache_TruncateTestFile(Path, Length - 1);                        \
+		glyph_cache *Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");   \
+		Assert(!Cache->Mapping && !Cache->Records.EntryCount);                \
+		Assert(Cache->FileSize == HeaderSize);                                \
+		GlyphCache_Close(Cache);                                              \
+		Assert(GlyphCache_GetTestFileLength(Path) == HeaderSize);             \
+                                                                              \
+		/* The first record is cut off in its pixels */                       \
+		GlyphCache_MakeTestFile(Heap, Font);                                  \
+		Length = HeaderSize + sizeof(glyph_cache_record) + 4;                 \
+		GlyphCache_TruncateTestFile(Path, Length);                            \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(!Cache->Mapping && !Cache->Records.EntryCount);                \
+		GlyphCache_Close(Cache);                                              \
+                                                                              \
+		/* The records are whole */                                           \
+		Length = GlyphCache_MakeTestFile(Heap, Font);                         \
+		GlyphCache_TruncateTestFile(Path, Length - GlyphCache_RecordSize(0)); \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(Cache->Mapping && Cache->Records.EntryCount == 1);             \
+		GlyphCache_Close(Cache);                                              \
+		Font_Close(&Font);                                                    \
+	))                                                                        \
+	TEST(GlyphCache_Open, RebuildsStaleFiles, (                               \
+		u32 HeapSize = 256 * 1024;                                            \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u32 Encodings[] = { 0x0003000A }, Formats[] = { 12 };                 \
+		Font_SaveTestFile("glyph_test.ttf", 1, Encodings, Formats);           \
+		font Font = Font_Open(Heap, "glyph_test.ttf");                        \
+		c08 *Path = "glyph_test.cache";                                       \
+		glyph_cache *Cache;                                                   \
+                                                                              \
+		GlyphCache_MakeTestFile(Heap, Font);                                  \
+		u32 Version = GLYPH_CACHE_VERSION + 1;                                \
+		u64 Offset = OFFSET_OF(glyph_cache_header, Version);                  \
+		GlyphCache_PatchTestFile(Path, Offset, &Version, sizeof(u32));        \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(!Cache->Mapping && !Cache->Records.EntryCount);                \
+		GlyphCache_Close(Cache);                                              \
+                                                                              \
+		GlyphCache_MakeTestFile(Heap, Font);                                  \
+		u32 Magic = 0;                                                        \
+		Offset = OFFSET_OF(glyph_cache_header, Magic);                        \
+		GlyphCache_PatchTestFile(Path, Offset, &Magic, sizeof(u32));          \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(!Cache->Mapping && !Cache->Records.EntryCount);                \
+		GlyphCache_Close(Cache);                                              \
+                                                                              \
+		/* The same records are kept for the same font */                     \
+		GlyphCache_MakeTestFile(Heap, Font);                                  \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(Cache->Mapping && Cache->Records.EntryCount == 2);             \
+		GlyphCache_Close(Cache);                                              \
+                                                                              \
+		/* But not once the font file changes */                              \
+		Font_Close(&Font);                                                    \
+		Formats[0] = 4;                                                       \
+		Font_SaveTestFile("glyph_test.ttf", 1, Encodings, Formats);           \
+		Cache = GlyphCache_Open(Heap, Path, "glyph_test.ttf");                \
+		Assert(!Cache->Mapping && !Cache->Records.EntryCount);                \
+		GlyphCache_Close(Cache);                                              \
+	))                                                                        \
+	//
+
+#endif
+
+#endif
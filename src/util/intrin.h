@@ -26,6 +26,7 @@ u64	 __popcnt64(u64 Value);
 u08	 _BitScanForward64(u32 *Index, u64 Mask);
 u08	 _BitScanReverse(u32 *Index, u32 Mask);
 u08	 _BitScanReverse64(u32 *Index, u64 Mask);
+u64	 _umul128(u64 A, u64 B, u64 *High);
 r128 _mm_sqrt_ps(r128);
 r128 _mm_set_ps(r32, r32, r32, r32);
 
@@ -37,6 +38,7 @@ r128 _mm_set_ps(r32, r32, r32, r32);
 #define Intrin_BitScanForward64(u32_p_Index, u64_Value) RETURNS(b08)  _BitScanForward64(u32_p_Index, u64_Value)
 #define Intrin_BitScanReverse32(u32_p_Index, u32_Value) RETURNS(b08)  _BitScanReverse(u32_p_Index, u32_Value)
 #define Intrin_BitScanReverse64(u32_p_Index, u64_Value) RETURNS(b08)  _BitScanReverse(u32_p_Index, u64_Value)
+#define Intrin_Multiply128(u64_A, u64_B, u64_p_High)    RETURNS(u64)  _umul128(u64_A, u64_B, u64_p_High)
 
 inline r32
 Intrin_Sqrt_R32(r32 Value)
@@ -58,7 +60,15 @@ intrin u64
 Intrin_ReadGSQWord(u32 Offset)
 {
 	u64 Result;
-	__asm__("mov %%gs:0(%1), %0" : "=r"(Result) : "r"(Offset));
+	__asm__ volatile("mov %%gs:0(%1), %0" : "=r"(Result) : "r"((u64) Offset));
+	return Result;
+}
+
+intrin u64
+Intrin_ReadFSQWord(u32 Offset)
+{
+	u64 Result;
+	__asm__ volatile("mov %%fs:0(%1), %0" : "=r"(Result) : "r"((u64) Offset));
 	return Result;
 }
 
@@ -102,6 +112,8 @@ Intrin_ReadTimeStampCounter()
 		"shlq $32, %%rdx\n"
 		"orq %%rdx, %%rax\n"
 		: "=a"(Result)
+		:
+		: "rdx"
 	);
 	return Result;
 }
@@ -131,6 +143,14 @@ Intrin_BitScanReverse64(u32 *Index, u64 Value)
 	return Value != 0;
 }
 
+// Returns the low half of the product, and puts the high half in High.
+intrin u64
+Intrin_Multiply128(u64 A, u64 B, u64 *High)
+{
+	__asm__("mulq %2" : "+a"(A), "=d"(*High) : "rm"(B));
+	return A;
+}
+
 #define Intrin_BitScanForward MAC_CONCAT(Intrin_BitScanForward, _WORD_SIZE)
 #define Intrin_BitScanReverse MAC_CONCAT(Intrin_BitScanReverse, _WORD_SIZE)
 
@@ -141,48 +161,160 @@ Intrin_Sqrt_R32(r32 Value)
 	return Value;
 }
 
+// Four lanes in an sse register. These support the usual arithmetic and
+// comparison operators, and comparisons give an s32x4 of all ones or zeros.
+typedef r32 r32x4 __attribute__((vector_size(16)));
+typedef s32 s32x4 __attribute__((vector_size(16)));
+
+intrin r32x4
+Intrin_Sqrt_R32x4(r32x4 Value)
+{
+	__asm__("sqrtps %0, %0" : "+x"(Value));
+	return Value;
+}
+
+intrin u32
+Intrin_MoveMask_R32x4(r32x4 Value)
+{
+	u32 Result;
+	__asm__("movmskps %1, %0" : "=r"(Result) : "x"(Value));
+	return Result;
+}
+
+// Sixteen bytes in an sse register. Like plain bytes, these can alias
+// anything. The unaligned types can be dereferenced at any address, and are
+// how loads and stores that don't know their alignment should be written.
+typedef u08 u08x16 __attribute__((vector_size(16), may_alias));
+typedef u08 u08x16_unaligned
+	__attribute__((vector_size(16), aligned(1), may_alias));
+typedef u16 u16_unaligned __attribute__((aligned(1), may_alias));
+typedef u32 u32_unaligned __attribute__((aligned(1), may_alias));
+typedef u64 u64_unaligned __attribute__((aligned(1), may_alias));
+
+intrin u32
+Intrin_MoveMask_U08x16(u08x16 Value)
+{
+	u32 Result;
+	__asm__("pmovmskb %1, %0" : "=r"(Result) : "x"(Value));
+	return Result;
+}
+
+// Bypasses the cache, so the destination has to be 16 byte aligned, and the
+// stores have to be fenced before anyone else reads them.
+intrin void
+Intrin_StoreNonTemporal_U08x16(vptr Dest, u08x16 Value)
+{ __asm__("movntdq %1, %0" : "=m"(*(u08x16 *) Dest) : "x"(Value)); }
+
+intrin void
+Intrin_StoreFence(void)
+{ __asm__ volatile("sfence" ::: "memory"); }
+
+intrin void
+Intrin_RepMovsb(vptr Dest, vptr Src, usize Size)
+{
+	__asm__ volatile("rep movsb"
+					 : "+D"(Dest), "+S"(Src), "+c"(Size)
+					 :
+					 : "memory");
+}
+
+intrin void
+Intrin_RepStosb(vptr Dest, u08 Byte, usize Size)
+{ __asm__ volatile("rep stosb" : "+D"(Dest), "+c"(Size) : "a"(Byte) : "memory"); }
+
+intrin void
+Intrin_CpuId(u32 Leaf, u32 SubLeaf, u32 *Registers)
+{
+	__asm__("cpuid"
+			: "=a"(Registers[0]),
+			  "=b"(Registers[1]),
+			  "=c"(Registers[2]),
+			  "=d"(Registers[3])
+			: "a"(Leaf), "c"(SubLeaf));
+}
+
 typedef __builtin_va_list va_list;
 #define VA_Start(Args, ...) __builtin_c23_va_start(Args)
 #define VA_Next(Args, Type) __builtin_va_arg(Args, Type)
 #define VA_Copy(Dest, Src) __builtin_va_copy(Dest, Src)
 #define VA_End(Args) __builtin_va_end(Args)
 
+intrin void
+Intrin_Pause(void)
+{ __asm__ volatile("pause"); }
+
+// These are full barriers for both the cpu and the compiler, so they can be
+// used to publish data to other threads.
+
 intrin u32
 Intrin_Exchange32(u32 *Data, u32 Value)
 {
-	__asm__("lock xchg %1, %2" : "+r"(Value) : "m"(*Data));
+	__asm__ volatile("lock xchg %0, %1" : "+r"(Value), "+m"(*Data) : : "memory");
+	return Value;
+}
+
+intrin u64
+Intrin_Exchange64(u64 *Data, u64 Value)
+{
+	__asm__ volatile("lock xchg %0, %1" : "+r"(Value), "+m"(*Data) : : "memory");
 	return Value;
 }
 
 intrin u08
 Intrin_CompareExchange08(u08 *Mutex, u08 Target, u08 NewValue)
 {
-	__asm__("lock cmpxchg %1, %2" : "+a"(Target) : "r"(NewValue), "m"(*Mutex));
+	__asm__ volatile("lock cmpxchg %2, %1"
+					 : "+a"(Target), "+m"(*Mutex)
+					 : "q"(NewValue)
+					 : "memory");
 	return Target;
 }
 
 intrin u16
 Intrin_CompareExchange16(u16 *Mutex, u16 Target, u16 NewValue)
 {
-	__asm__("lock cmpxchg %1, %2" : "+a"(Target) : "r"(NewValue), "m"(*Mutex));
+	__asm__ volatile("lock cmpxchg %2, %1"
+					 : "+a"(Target), "+m"(*Mutex)
+					 : "r"(NewValue)
+					 : "memory");
 	return Target;
 }
 
 intrin u32
 Intrin_CompareExchange32(u32 *Mutex, u32 Target, u32 NewValue)
 {
-	__asm__("lock cmpxchg %1, %2" : "+a"(Target) : "r"(NewValue), "m"(*Mutex));
+	__asm__ volatile("lock cmpxchg %2, %1"
+					 : "+a"(Target), "+m"(*Mutex)
+					 : "r"(NewValue)
+					 : "memory");
 	return Target;
 }
 
 intrin u64
 Intrin_CompareExchange64(u64 *Mutex, u64 Target, u64 NewValue)
 {
-	u64 OldValue = Target;
-	__asm__("lock cmpxchg %1, %2" : "+a"(Target) : "r"(NewValue), "m"(*Mutex));
+	__asm__ volatile("lock cmpxchg %2, %1"
+					 : "+a"(Target), "+m"(*Mutex)
+					 : "r"(NewValue)
+					 : "memory");
 	return Target;
 }
 
+// Returns the value from before the addition.
+intrin u32
+Intrin_AtomicAdd32(u32 *Data, u32 Value)
+{
+	__asm__ volatile("lock xadd %0, %1" : "+r"(Value), "+m"(*Data) : : "memory");
+	return Value;
+}
+
+intrin u64
+Intrin_AtomicAdd64(u64 *Data, u64 Value)
+{
+	__asm__ volatile("lock xadd %0, %1" : "+r"(Value), "+m"(*Data) : : "memory");
+	return Value;
+}
+
 #endif
 
 #endif
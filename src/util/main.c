@@ -13,9 +13,11 @@
 /// upon load since the platform module relies on it as well.
 ///
 /// The following utilities are provided:
+///  - atlas: Packs rectangles, such as glyphs, into a texture atlas.
 ///  - bigint: Large, multi-word integer arithmetic.
 ///  - file: Helpers to read and operate on files.
 ///  - font: Load, parse, and query .ttf files.
+///  - glyph: A persistent cache of rendered glyphs.
 ///  - intrin: Architecture-specific intrinsics.
 ///  - memory: Memory allocators and memset/cpy/cmp.
 ///  - msdf: Multi-channel signed distance field glyph generation.
@@ -49,7 +51,9 @@ global util_funcs _F;
 #include <util/string.c>
 #include <util/set.c>
 #include <util/msdf.c>
+#include <util/atlas.c>
 #include <util/font.c>
+#include <util/glyph.c>
 #include <util/file.c>
 #include <util/tls.c>
 
@@ -65,20 +69,18 @@ global util_funcs _F;
     STRING_FUNCS   \
     SET_FUNCS      \
     MSDF_FUNCS     \
+    ATLAS_FUNCS    \
     FONT_FUNCS     \
+    GLYPH_FUNCS    \
     FILE_FUNCS     \
 	TLS_FUNCS      \
 	//
 
 typedef struct util_state {
 	usize StackSize;
-	tls	  Tls;
+	u64	  HashSeed;
 } util_state;
 
-typedef struct util_tls {
-	stack *Stack;
-} util_tls;
-
 typedef struct util_funcs {
 #define EXPORT(R, N, ...) R (*N)(__VA_ARGS__);
 #define X UTIL_FUNCS
@@ -107,6 +109,9 @@ Load(platform_state *Platform, platform_module *Module)
 #define EXPORT(R, N, ...) N = PlatformFuncs->N;
 #define X PLATFORM_FUNCS
 #include <x.h>
+
+		if (!Platform->HashSeed) Platform->HashSeed = Mem_GetHashSeed();
+		_G.HashSeed = Platform->HashSeed;
 	}
 
 	if (!_F.Initialized) {
@@ -129,19 +134,47 @@ Load(platform_state *Platform, platform_module *Module)
 	{                                                  \
 		MAC_UNPACKAGE(TestCode)                        \
 	}
+MEMORY_TESTS
 BIGINT_TESTS
 STRING_TESTS
+SET_TESTS
+MSDF_TESTS
+ATLAS_TESTS
+FONT_TESTS
+GLYPH_TESTS
+TLS_TESTS
 #undef TEST
 
+// Returns the argument after Name, or an empty string if it isn't there.
+internal string
+Util_FindArg(platform_state *Platform, string Name)
+{
+	for (usize I = 1; I + 1 < Platform->ArgCount; I++)
+		if (String_Cmp(Platform->Args[I], Name) == 0)
+			return Platform->Args[I + 1];
+	return (string){ 0 };
+}
+
+#define BENCH(FunctionName, BenchName, BenchCode)                             \
+	static void Bench_##FunctionName##_##BenchName(platform_state *Platform)  \
+	{                                                                         \
+		MAC_UNPACKAGE(BenchCode)                                              \
+	}
+MEMORY_BENCHMARKS
+SET_BENCHMARKS
+MSDF_BENCHMARKS
+#undef BENCH
+
 external void
 Init(platform_state *Platform)
 {
-	b08 RunTests = FALSE;
+	b08 RunTests	  = FALSE;
+	b08 RunBenchmarks = FALSE;
 	for (usize I = 1; I < Platform->ArgCount; I++) {
-		if (String_Cmp(Platform->Args[I], CStringL("-RunTests")) == 0) {
+		if (String_Cmp(Platform->Args[I], CStringL("-RunTests")) == 0)
 			RunTests = TRUE;
-			break;
-		}
+		if (String_Cmp(Platform->Args[I], CStringL("-RunBenchmarks")) == 0)
+			RunBenchmarks = TRUE;
 	}
 
 	if (RunTests) {
@@ -151,17 +184,67 @@ Init(platform_state *Platform)
 		Platform_WriteConsole(CStringL("Testing " #FunctionName ": " #TestName "...\n")); \
 		Test_##FunctionName##_##TestName();
 
+		Platform_WriteConsole(CStringL("\n===== Memory Tests ======\n"));
+		MEMORY_TESTS
+
 		Platform_WriteConsole(CStringL("\n===== BigInt Tests ======\n"));
 		BIGINT_TESTS
 
 		Platform_WriteConsole(CStringL("\n===== String Tests ======\n"));
 		STRING_TESTS
 
+		Platform_WriteConsole(CStringL("\n====== Set Tests ========\n"));
+		SET_TESTS
+
+		Platform_WriteConsole(CStringL("\n====== MSDF Tests =======\n"));
+		MSDF_TESTS
+
+		Platform_WriteConsole(CStringL("\n====== Atlas Tests ======\n"));
+		ATLAS_TESTS
+
+		Platform_WriteConsole(CStringL("\n====== Font Tests =======\n"));
+		FONT_TESTS
+
+		Platform_WriteConsole(CStringL("\n====== Glyph Tests ======\n"));
+		GLYPH_TESTS
+
+		Platform_WriteConsole(CStringL("\n======= Tls Tests =======\n"));
+		TLS_TESTS
+
 #undef TEST
 
 		Platform_WriteConsole(CStringL("\nAll tests passed!\n"));
 		Stack_Pop();
 	}
+
+	if (RunBenchmarks) {
+		Stack_Push();
+
+#define BENCH(FunctionName, BenchName, BenchCode)                              \
+		Platform_WriteConsole(                                                 \
+			CStringL("Benchmarking " #FunctionName ": " #BenchName "...\n")    \
+		);                                                                     \
+		Bench_##FunctionName##_##BenchName(Platform);
+
+		Platform_WriteConsole(CStringL("\n=== Memory Benchmarks ===\n"));
+		MEMORY_BENCHMARKS
+
+		Platform_WriteConsole(CStringL("\n===== Set Benchmarks ====\n"));
+		SET_BENCHMARKS
+
+		Platform_WriteConsole(CStringL("\n==== MSDF Benchmarks ====\n"));
+		MSDF_BENCHMARKS
+
+#undef BENCH
+
+		Stack_Pop();
+	}
+
+	string TimelinePath = Util_FindArg(Platform, CStringL("-HeapReport"));
+	if (TimelinePath.Length) {
+		if (!Heap_ReportTimeline(Platform->Heap, TimelinePath.Text))
+			Printf("Couldn't read the heap timeline %s\n", TimelinePath);
+	}
 }
 #endif
 #endif
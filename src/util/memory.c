@@ -13,144 +13,492 @@
 
 #define HEAP(Type) heap_handle *
 
+// Handles are 32 bytes, so two share a cache line. A free handle has no
+// block, so its block links are reused for the free list.
 typedef struct heap_handle {
 	vptr Data;
-	u64	 Index	  : 16;
 	u64	 Offset	  : 46;
 	u64	 Free	  : 1;
 	u64	 Anchored : 1;
+	u32	 Index;
 	u32	 Size;
-	u16	 PrevFree;
-	u16	 NextFree;
-	u16	 PrevUsed;
-	u16	 NextUsed;
-	u16	 PrevBlock;
-	u16	 NextBlock;
+	union {
+		struct {
+			u32 PrevBlock;
+			u32 NextBlock;
+		};
+		struct {
+			u32 PrevFree;
+			u32 NextFree;
+		};
+	};
 } heap_handle;
-
-typedef struct {
+static_assert(sizeof(heap_handle) == 32, "heap_handle must be 32 bytes!");
+
+// Anchored allocations up to HEAP_SLAB_MAX_SIZE, counting the pointer in
+// front of them, are split out of slabs instead of getting their own block.
+// A slab is an anchored block holding objects of one power of two size, so
+// allocating or freeing an object is just a list push or pop. The pointer in
+// front of a slab object is its slab with the low bit set, not a handle.
+// Slabs are kept small so that they fit in small heaps, but hold at least
+// HEAP_SLAB_MIN_OBJECTS of the bigger classes.
+#define HEAP_SLAB_MIN_SIZE	  4096
+#define HEAP_SLAB_MIN_OBJECTS 8
+#define HEAP_SLAB_MIN_SHIFT	  4
+#define HEAP_SLAB_MAX_SHIFT	  12
+#define HEAP_SLAB_MAX_SIZE	  (1 << HEAP_SLAB_MAX_SHIFT)
+#define HEAP_SLAB_CLASS_COUNT (HEAP_SLAB_MAX_SHIFT - HEAP_SLAB_MIN_SHIFT + 1)
+
+typedef struct heap_slab {
+	struct heap_slab *Prev;
+	struct heap_slab *Next;
+	struct heap		 *Heap;
+	heap_handle		 *Handle;
+
+	// Freed objects are reused first, then the untouched ones past Cursor.
+	vptr FreeList;
+	u08 *Cursor;
+	u08 *End;
+
+	u32 Class;
+	u32 UsedCount;
+} heap_slab;
+
+// Heaps from Heap_Reserve only commit memory as it's used. The handles grow
+// up from the bottom and blocks are placed from the top down, so what's
+// committed is a range at each end.
+#define HEAP_COMMIT_SIZE (64 * 1024)
+
+// These are always kept. Allocations and frees served by a thread cache are
+// counted by the thread, and only added in when it next takes the lock. The
+// used size counts objects sitting in thread caches as used, and the lock
+// wait is in timestamp counter ticks, counting only contended locks.
+typedef struct heap_counters {
+	u64 AllocationCount;
+	u64 FreeCount;
+	u64 AllocatedSize;
+	u64 UsedSize;
+	u64 PeakUsedSize;
+	u64 LockCount;
+	u64 ContendedLockCount;
+	u64 LockWaitCycles;
+} heap_counters;
+
+typedef struct heap_stats {
+	u64			  ReservedSize;
+	u64			  CommittedSize;
+	heap_counters Counters;
+} heap_stats;
+
+// Allocations made through Heap_TrackedAllocateA are also counted by their
+// file and line. Call sites past the capacity aren't tracked.
+#define HEAP_SITE_CAPACITY 1024
+
+typedef struct heap_site {
+	c08 *File;
+	u32	 Line;
+	u64	 AllocationCount;
+	u64	 AllocatedSize;
+} heap_site;
+
+// Once a timeline is enabled, the heap records its allocations, frees,
+// resizes and compaction moves into a ring, which Heap_DumpTimeline writes
+// out as a header followed by the events, oldest first. Thread caches are
+// bypassed while it's on, so every event is seen. Offsets are of the data
+// from the heap base, and times are in timestamp counter ticks.
+#define HEAP_TIMELINE_MAGIC	  0x4C545048 // HPTL
+#define HEAP_TIMELINE_VERSION 1
+
+typedef enum heap_event_type {
+	HEAP_EVENT_ALLOCATE,
+	HEAP_EVENT_FREE,
+	HEAP_EVENT_RESIZE,
+	HEAP_EVENT_MOVE,
+} heap_event_type;
+
+typedef struct heap_event {
+	u64 Time;
+	u64 Offset;
+	u64 PrevOffset;
+	u32 Size;
+	u32 Type;
+} heap_event;
+
+typedef struct heap_timeline_header {
+	u32 Magic;
+	u32 Version;
+	u64 HeapSize;
+	u64 EventCount;
+	u64 DroppedCount;
+} heap_timeline_header;
+
+typedef struct heap_timeline {
+	u64		   Count;
+	u32		   Capacity;
+	heap_event Events[];
+} heap_timeline;
+
+typedef struct heap {
 	u32 Mutex;
 
+	// Set while thread caches are enabled.
+	struct heap_cache_owner *CacheOwner;
+
+	u64 ReservedSize;
+	u64 CommittedLow;
+	u64 CommittedHigh;
+
+	// The most recently freed handle, or 0 if there are none.
+	u32 FreeHandles;
+
+	// The next block for Heap_DefragmentStep to slide up, or 0 to start over
+	// from the top.
+	u32 CompactCursor;
+
+	// The slabs with room left, by size class.
+	heap_slab *Slabs[HEAP_SLAB_CLASS_COUNT];
+
+	heap_counters  Counters;
+	heap_site	  *Sites;
+	heap_timeline *Timeline;
+
 	heap_handle Handles[];
 } heap;
 
+// For heaps with thread caches enabled, each thread keeps magazines of free
+// slab objects, so most small allocations and frees don't take the lock. An
+// empty magazine is half refilled from the heap, and a full one is half
+// emptied into it, in one locked batch. Objects belong to the heap rather
+// than to a thread, so a thread freeing another thread's object just keeps
+// it. Before such a heap is freed or set up again, Heap_DisableThreadCaches
+// has to be called, and other threads drop their entries for it without
+// touching the heap. A heap set up again at the same address doesn't inherit
+// the old one's magazines either way.
+#define HEAP_CACHE_HEAP_COUNT 4
+#define HEAP_CACHE_MAX_COUNT  64
+#define HEAP_CACHE_MAX_BYTES  (16 * 1024)
+
+typedef struct heap_magazine {
+	u32	 Count;
+	vptr Objects[HEAP_CACHE_MAX_COUNT];
+} heap_magazine;
+
+// Cache entries point at this rather than at the heap, so they can tell the
+// heap is gone without reading its memory. The heap and each entry hold a
+// reference, and the last one to let go frees it.
+typedef struct heap_cache_owner {
+	// NULL once the heap has disabled its caches
+	heap *Heap;
+	u32	  RefCount;
+} heap_cache_owner;
+
+typedef struct heap_cache_entry {
+	heap_cache_owner *Owner;
+	heap_counters	  Counters;
+	heap_magazine Magazines[HEAP_SLAB_CLASS_COUNT];
+} heap_cache_entry;
+
+typedef struct heap_cache {
+	heap_cache_entry Entries[HEAP_CACHE_HEAP_COUNT];
+} heap_cache;
+
+// Thread stacks are reserved with a guard region past the end, and pages are
+// committed as the cursor reaches them. Stacks made with Stack_Init are
+// already committed, and belong to whoever made them, so Stack_Release
+// leaves them alone.
+#define STACK_COMMIT_SIZE (64 * 1024)
+#define STACK_GUARD_SIZE  (64 * 1024)
+
 typedef struct stack {
 	u32	  Mutex;
 	usize Size;
 	u08	 *Cursor;
 	vptr *FirstMarker;
+
+	u08 *Committed;
+	u08 *HighWater;
+	b08	 Reserved;
 } stack;
 
+// An arena hands out memory in order and frees it all at once. Unlike the
+// scratch stack, it's passed around explicitly, so what lives in it is up to
+// whoever owns it. Checkpoints roll back everything allocated since.
+typedef struct arena {
+	heap *Heap;
+	b08	  Reserved;
+	u08	 *Cursor;
+	u08	 *Committed;
+	u08	 *End;
+} arena;
+
+typedef struct arena_checkpoint {
+	arena *Arena;
+	u08	  *Cursor;
+} arena_checkpoint;
+
 #define MEMORY_FUNCS \
-   EXPORT(vptr,         Mem_Set,            vptr Dest, s32 Data, usize Size) \
-   EXPORT(vptr,         Mem_Cpy,            vptr Dest, vptr Src, usize Size) \
-   EXPORT(s32,          Mem_Cmp,            vptr A, vptr B, usize Size) \
-   EXPORT(usize,        Mem_BytesUntil,     u08 *Data, u08 Byte) \
+   EXPORT(vptr,         Mem_Set,                 vptr Dest, s32 Data, usize Size) \
+   EXPORT(vptr,         Mem_Cpy,                 vptr Dest, vptr Src, usize Size) \
+   EXPORT(s32,          Mem_Cmp,                 vptr A, vptr B, usize Size) \
+   EXPORT(usize,        Mem_BytesUntil,          u08 *Data, u08 Byte) \
+   EXPORT(usize,        Mem_FindByte,            vptr Data, u08 Byte, usize Size) \
+   EXPORT(u64,          Mem_Hash,                vptr Data, usize Size, u64 Seed) \
+   EXPORT(u64,          Mem_GetHashSeed,         void) \
+   \
+   EXPORT(heap*,        Heap_GetHeap,            heap_handle *Handle) \
+   EXPORT(heap_handle*, Heap_GetHandleA,         vptr Data) \
+   EXPORT(heap*,        Heap_Init,               vptr MemBase, u64 Size) \
+   EXPORT(heap*,        Heap_Reserve,            u64 Size) \
+   EXPORT(void,         Heap_Trim,               heap *Heap) \
+   EXPORT(heap_stats,   Heap_GetStats,           heap *Heap) \
+   EXPORT(void,         Heap_EnableThreadCaches, heap *Heap) \
+   EXPORT(void,         Heap_DisableThreadCaches, heap *Heap) \
+   EXPORT(void,         Heap_ReleaseThreadCache, void) \
+   EXPORT(void,         Heap_Defragment,         heap *Heap) \
+   EXPORT(b08,          Heap_DefragmentStep,     heap *Heap, r64 Budget) \
+   EXPORT(void,         Heap_AllocateBlock,      heap *Heap, heap_handle *Handle, u32 Size) \
+   EXPORT(void,         Heap_FreeBlock,          heap *Heap, heap_handle *Handle) \
+   EXPORT(heap_handle*, _Heap_Allocate,          heap *Heap, u32 Size, b08 Anchored) \
+   EXPORT(heap_handle*, Heap_Allocate,           heap *Heap, u64 Size) \
+   EXPORT(vptr,         Heap_AllocateA,          heap *Heap, u64 Size) \
+   EXPORT(void,         Heap_Resize,             heap_handle *Handle, u32 NewSize) \
+   EXPORT(void,         Heap_ResizeA,            vptr *Data, u32 NewSize) \
+   EXPORT(void,         Heap_Free,               heap_handle *Handle) \
+   EXPORT(void,         Heap_FreeA,              vptr Data) \
+   EXPORT(void,         Heap_Dump,               heap *Heap) \
+   EXPORT(vptr,         _Heap_AllocateAtSite,    heap *Heap, u64 Size, c08 *File, u32 Line) \
+   EXPORT(void,         Heap_PrintStats,         heap *Heap) \
+   EXPORT(void,         Heap_EnableTimeline,     heap *Heap, u32 Capacity) \
+   EXPORT(b08,          Heap_DumpTimeline,       heap *Heap, c08 *FileName) \
+   EXPORT(b08,          Heap_ReportTimeline,     heap *Heap, c08 *FileName) \
    \
-   EXPORT(heap*,        Heap_GetHeap,       heap_handle *Handle) \
-   EXPORT(heap_handle*, Heap_GetHandleA,    vptr Data) \
-   EXPORT(heap*,        Heap_Init,          vptr MemBase, u64 Size) \
-   EXPORT(void,         Heap_Defragment,    heap *Heap) \
-   EXPORT(void,         Heap_AllocateBlock, heap *Heap, heap_handle *Handle, u32 Size) \
-   EXPORT(void,         Heap_FreeBlock,     heap *Heap, heap_handle *Handle) \
-   EXPORT(heap_handle*, _Heap_Allocate,     heap *Heap, u32 Size, b08 Anchored) \
-   EXPORT(heap_handle*, Heap_Allocate,      heap *Heap, u64 Size) \
-   EXPORT(vptr,         Heap_AllocateA,     heap *Heap, u64 Size) \
-   EXPORT(void,         Heap_Resize,        heap_handle *Handle, u32 NewSize) \
-   EXPORT(void,         Heap_ResizeA,       vptr *Data, u32 NewSize) \
-   EXPORT(void,         Heap_Free,          heap_handle *Handle) \
-   EXPORT(void,         Heap_FreeA,         vptr Data) \
-   EXPORT(void,         Heap_Dump,          heap *Heap) \
+   EXPORT(stack*,       Stack_Init,              vptr Mem, usize Size) \
+   EXPORT(stack*,       Stack_Reserve,           usize Size) \
+   EXPORT(stack*,       Stack_Get,               void) \
+   EXPORT(void,         Stack_Set,               stack *Stack) \
+   EXPORT(void,         Stack_Push,              void) \
+   EXPORT(vptr,         Stack_GetCursor,         void) \
+   EXPORT(void,         Stack_SetCursor,         vptr Cursor) \
+   EXPORT(vptr,         Stack_Allocate,          u64 Size) \
+   EXPORT(usize,        Stack_GetHighWater,      void) \
+   EXPORT(void,         Stack_Pop,               void) \
+   EXPORT(void,         Stack_Release,           void) \
    \
-   EXPORT(stack*,       Stack_Init,         vptr Mem, usize Size) \
-   EXPORT(stack*,       Stack_Get,          void) \
-   EXPORT(void,         Stack_Set,          stack *Stack) \
-   EXPORT(void,         Stack_Push,         void) \
-   EXPORT(vptr,         Stack_GetCursor,    void) \
-   EXPORT(void,         Stack_SetCursor,    vptr Cursor) \
-   EXPORT(vptr,         Stack_Allocate,     u64 Size) \
-   EXPORT(void,         Stack_Pop,          void)
+   EXPORT(arena*,       Arena_Init,              vptr Mem, usize Size) \
+   EXPORT(arena*,       Arena_Create,            heap *Heap, usize Size) \
+   EXPORT(arena*,       Arena_Reserve,           usize Size) \
+   EXPORT(vptr,         Arena_Allocate,          arena *Arena, usize Size) \
+   EXPORT(arena_checkpoint, Arena_Save,          arena *Arena) \
+   EXPORT(void,         Arena_Restore,           arena_checkpoint Checkpoint) \
+   EXPORT(void,         Arena_Reset,             arena *Arena) \
+   EXPORT(void,         Arena_Free,              arena *Arena)
+
+// Like Heap_AllocateA, but counts the allocation against the caller.
+#define Heap_TrackedAllocateA(Heap, Size) \
+	_Heap_AllocateAtSite(Heap, Size, __FILE__, __LINE__)
 
 #endif
 
 #ifdef INCLUDE_SOURCE
 
+// Past these sizes, rep movsb and rep stosb beat the sse loops on cpus that
+// have fast strings, and then stores skip the cache so a huge copy doesn't
+// evict everything else.
+#define MEM_REP_MIN_SIZE		  (2 * 1024)
+#define MEM_NON_TEMPORAL_MIN_SIZE (8 * 1024 * 1024)
+
+internal b08
+Mem_HasFastStrings(void)
+{
+	persist s32 HasFastStrings = -1;
+	if (HasFastStrings < 0) {
+		u32 Registers[4];
+		Intrin_CpuId(0, 0, Registers);
+		HasFastStrings = FALSE;
+		if (Registers[0] >= 7) {
+			Intrin_CpuId(7, 0, Registers);
+			HasFastStrings = (Registers[1] >> 9) & 1;
+		}
+	}
+	return HasFastStrings;
+}
+
 internal vptr
 Mem_Set(vptr Dest, s32 Data, usize Size)
 {
-	u08 *DB = (u08 *) Dest;
-	u08	 SB = Data;
-
-	switch (Size) {
-		case 7: DB[6] = SB;	 // fallthrough
-		case 6: DB[5] = SB;	 // fallthrough
-		case 5: DB[4] = SB;	 // fallthrough
-		case 4: DB[3] = SB;	 // fallthrough
-		case 3: DB[2] = SB;	 // fallthrough
-		case 2: DB[1] = SB;	 // fallthrough
-		case 1: DB[0] = SB;	 // fallthrough
-		case 0: return Dest;
-	}
-
-	usize WB  = sizeof(usize);
-	usize AB  = (WB - ((usize) DB % WB)) % WB;
-	Size	 -= AB;
-	switch (AB) {
-		case 7: DB[6] = SB;	 // fallthrough
-		case 6: DB[5] = SB;	 // fallthrough
-		case 5: DB[4] = SB;	 // fallthrough
-		case 4: DB[3] = SB;	 // fallthrough
-		case 3: DB[2] = SB;	 // fallthrough
-		case 2: DB[1] = SB;	 // fallthrough
-		case 1: DB[0] = SB;
-	}
-	DB += AB;
-
-	usize *DW = (usize *) DB;
-	usize  SW = SB | (SB << 8) | (SB << 16) | (SB << 24);
-	if (WB == 8) SW |= SW << 32;
-
-	while (Size >= WB) {
-		*DW++  = SW;
-		Size  -= WB;
-	}
-
-	DB = (u08 *) DW;
-	switch (Size) {
-		case 7: DB[6] = SB;	 // fallthrough
-		case 6: DB[5] = SB;	 // fallthrough
-		case 5: DB[4] = SB;	 // fallthrough
-		case 4: DB[3] = SB;	 // fallthrough
-		case 3: DB[2] = SB;	 // fallthrough
-		case 2: DB[1] = SB;	 // fallthrough
-		case 1: DB[0] = SB;
+	u08 *D	  = Dest;
+	u08	 Byte = Data;
+
+	// Small sizes are covered by two stores that may overlap.
+	if (Size < 16) {
+		u64 Word = 0x0101010101010101ull * Byte;
+		if (Size >= 8) {
+			*(u64_unaligned *) D			  = Word;
+			*(u64_unaligned *) (D + Size - 8) = Word;
+		} else if (Size >= 4) {
+			*(u32_unaligned *) D			  = Word;
+			*(u32_unaligned *) (D + Size - 4) = Word;
+		} else if (Size >= 2) {
+			*(u16_unaligned *) D			  = Word;
+			*(u16_unaligned *) (D + Size - 2) = Word;
+		} else if (Size) {
+			*D = Byte;
+		}
+		return Dest;
 	}
 
+	u08x16 Vector = (u08x16){ 0 } + Byte;
+	u08	  *End	  = D + Size;
+	*(u08x16_unaligned *) D			= Vector;
+	*(u08x16_unaligned *) (End - 16) = Vector;
+	if (Size <= 32) return Dest;
+
+	if (Size >= MEM_REP_MIN_SIZE && Size < MEM_NON_TEMPORAL_MIN_SIZE
+		&& Mem_HasFastStrings())
+	{
+		Intrin_RepStosb(D, Byte, Size);
+		return Dest;
+	}
+
+	// The ends are already set, so the rest can use aligned stores.
+	u08 *Cursor = (u08 *) ALIGN_UP((usize) D + 1, 16);
+	if (Size >= MEM_NON_TEMPORAL_MIN_SIZE) {
+		for (; Cursor + 64 <= End; Cursor += 64) {
+			Intrin_StoreNonTemporal_U08x16(Cursor, Vector);
+			Intrin_StoreNonTemporal_U08x16(Cursor + 16, Vector);
+			Intrin_StoreNonTemporal_U08x16(Cursor + 32, Vector);
+			Intrin_StoreNonTemporal_U08x16(Cursor + 48, Vector);
+		}
+		Intrin_StoreFence();
+	}
+	for (; Cursor + 64 <= End; Cursor += 64) {
+		((u08x16 *) Cursor)[0] = Vector;
+		((u08x16 *) Cursor)[1] = Vector;
+		((u08x16 *) Cursor)[2] = Vector;
+		((u08x16 *) Cursor)[3] = Vector;
+	}
+	for (; Cursor + 16 <= End; Cursor += 16) *(u08x16 *) Cursor = Vector;
+
 	return Dest;
 }
 
-internal vptr
-Mem_Cpy(vptr Dest, vptr Src, usize Size)
+// The ends are loaded up front and stored last, so whatever the loops write
+// over is already read. Each chunk is loaded before it's stored, and reads
+// stay ahead of writes, so the ranges can overlap as long as the
+// destination is below the source.
+internal void
+Mem_CpyForward(u08 *D, u08 *S, usize Size)
 {
-	if (Size == 0) return Dest;
-	if (Dest == Src) return Dest;
+	u08x16 Head = *(u08x16_unaligned *) S;
+	u08x16 Tail = *(u08x16_unaligned *) (S + Size - 16);
+
+	usize Offset	  = ALIGN_UP((usize) D + 1, 16) - (usize) D;
+	b08	  Overlaps	  = (usize) (S - D) < Size;
+	b08	  NonTemporal = !Overlaps && Size >= MEM_NON_TEMPORAL_MIN_SIZE;
+	for (; Offset + 64 <= Size; Offset += 64) {
+		u08x16 A = *(u08x16_unaligned *) (S + Offset);
+		u08x16 B = *(u08x16_unaligned *) (S + Offset + 16);
+		u08x16 C = *(u08x16_unaligned *) (S + Offset + 32);
+		u08x16 E = *(u08x16_unaligned *) (S + Offset + 48);
+		if (NonTemporal) {
+			Intrin_StoreNonTemporal_U08x16(D + Offset, A);
+			Intrin_StoreNonTemporal_U08x16(D + Offset + 16, B);
+			Intrin_StoreNonTemporal_U08x16(D + Offset + 32, C);
+			Intrin_StoreNonTemporal_U08x16(D + Offset + 48, E);
+		} else {
+			((u08x16 *) (D + Offset))[0] = A;
+			((u08x16 *) (D + Offset))[1] = B;
+			((u08x16 *) (D + Offset))[2] = C;
+			((u08x16 *) (D + Offset))[3] = E;
+		}
+	}
+	if (NonTemporal) Intrin_StoreFence();
+	for (; Offset + 16 <= Size; Offset += 16)
+		*(u08x16 *) (D + Offset) = *(u08x16_unaligned *) (S + Offset);
 
-	s08	 Dir	= 1;
-	u08 *Dest08 = (u08 *) Dest;
-	u08 *Src08	= (u08 *) Src;
+	*(u08x16_unaligned *) D				 = Head;
+	*(u08x16_unaligned *) (D + Size - 16) = Tail;
+}
+
+// The mirror of Mem_CpyForward, for when the destination overlaps the end
+// of the source.
+internal void
+Mem_CpyBackward(u08 *D, u08 *S, usize Size)
+{
+	u08x16 Head = *(u08x16_unaligned *) S;
+	u08x16 Tail = *(u08x16_unaligned *) (S + Size - 16);
+
+	usize Offset = Size - ((usize) (D + Size) & 15);
+	for (; Offset >= 64; Offset -= 64) {
+		u08x16 A = *(u08x16_unaligned *) (S + Offset - 64);
+		u08x16 B = *(u08x16_unaligned *) (S + Offset - 48);
+		u08x16 C = *(u08x16_unaligned *) (S + Offset - 32);
+		u08x16 E = *(u08x16_unaligned *) (S + Offset - 16);
+		((u08x16 *) (D + Offset))[-4] = A;
+		((u08x16 *) (D + Offset))[-3] = B;
+		((u08x16 *) (D + Offset))[-2] = C;
+		((u08x16 *) (D + Offset))[-1] = E;
+	}
+	for (; Offset >= 16; Offset -= 16)
+		((u08x16 *) (D + Offset))[-1] = *(u08x16_unaligned *) (S + Offset - 16);
+
+	*(u08x16_unaligned *) D				 = Head;
+	*(u08x16_unaligned *) (D + Size - 16) = Tail;
+}
 
-	if (Dest > Src) {
-		Dir		= -1;
-		Dest08 += Size - 1;
-		Src08  += Size - 1;
+// Works like memmove, so the ranges can overlap.
+internal vptr
+Mem_Cpy(vptr Dest, vptr Src, usize Size)
+{
+	u08 *D = Dest;
+	u08 *S = Src;
+	if (D == S) return Dest;
+
+	// Up to 64 bytes, everything is loaded before anything is stored, so
+	// overlap doesn't matter.
+	if (Size <= 16) {
+		if (Size >= 8) {
+			u64 A = *(u64_unaligned *) S;
+			u64 B = *(u64_unaligned *) (S + Size - 8);
+			*(u64_unaligned *) D			  = A;
+			*(u64_unaligned *) (D + Size - 8) = B;
+		} else if (Size >= 4) {
+			u32 A = *(u32_unaligned *) S;
+			u32 B = *(u32_unaligned *) (S + Size - 4);
+			*(u32_unaligned *) D			  = A;
+			*(u32_unaligned *) (D + Size - 4) = B;
+		} else if (Size >= 2) {
+			u16 A = *(u16_unaligned *) S;
+			u16 B = *(u16_unaligned *) (S + Size - 2);
+			*(u16_unaligned *) D			  = A;
+			*(u16_unaligned *) (D + Size - 2) = B;
+		} else if (Size) {
+			*D = *S;
+		}
+		return Dest;
 	}
 
-	while (Size--) {
-		*Dest08	 = *Src08;
-		Dest08	+= Dir;
-		Src08	+= Dir;
+	if (Size <= 64) {
+		usize  Half = (Size <= 32) ? 0 : 16;
+		u08x16 A	= *(u08x16_unaligned *) S;
+		u08x16 B	= *(u08x16_unaligned *) (S + Half);
+		u08x16 C	= *(u08x16_unaligned *) (S + Size - 16 - Half);
+		u08x16 E	= *(u08x16_unaligned *) (S + Size - 16);
+		*(u08x16_unaligned *) D						= A;
+		*(u08x16_unaligned *) (D + Half)				= B;
+		*(u08x16_unaligned *) (D + Size - 16 - Half) = C;
+		*(u08x16_unaligned *) (D + Size - 16)		= E;
+		return Dest;
 	}
 
+	// Fast strings only go forward at full speed, and are slow when the
+	// ranges are close together, so they're only used without overlap.
+	b08 Overlaps = (usize) (D - S) < Size || (usize) (S - D) < Size;
+	if (!Overlaps && Size >= MEM_REP_MIN_SIZE
+		&& Size < MEM_NON_TEMPORAL_MIN_SIZE && Mem_HasFastStrings())
+		Intrin_RepMovsb(D, S, Size);
+	else if ((usize) (D - S) < Size) Mem_CpyBackward(D, S, Size);
+	else Mem_CpyForward(D, S, Size);
 	return Dest;
 }
 
@@ -159,18 +507,151 @@ Mem_Cmp(vptr A, vptr B, usize Size)
 {
 	u08 *APtr = A;
 	u08 *BPtr = B;
+
+	for (; Size >= 16; Size -= 16, APtr += 16, BPtr += 16) {
+		u08x16 AVec = *(u08x16_unaligned *) APtr;
+		u08x16 BVec = *(u08x16_unaligned *) BPtr;
+		u32	   Mask = Intrin_MoveMask_U08x16((u08x16) (AVec == BVec)) ^ 0xFFFF;
+		if (Mask) {
+			u32 Index;
+			Intrin_BitScanForward64(&Index, Mask);
+			return (APtr[Index] > BPtr[Index]) ? GREATER : LESS;
+		}
+	}
+
 	while (Size && *APtr == *BPtr) Size--, APtr++, BPtr++;
 	if (!Size) return EQUAL;
 	if (*APtr > *BPtr) return GREATER;
 	return LESS;
 }
 
+// Gives a bit for each byte in the aligned block that matches. Aligned loads
+// never cross a page, so reading past the end of the data can't fault.
+internal u32
+Mem_MatchBlock(u08 *Block, u08x16 Target)
+{ return Intrin_MoveMask_U08x16((u08x16) (*(u08x16 *) Block == Target)); }
+
 internal usize
 Mem_BytesUntil(u08 *Data, u08 Byte)
 {
-	usize Length = 0;
-	while (*Data++ != Byte) Length++;
-	return Length;
+	u08x16 Target = (u08x16){ 0 } + Byte;
+	u08	  *Block  = (u08 *) ((usize) Data & ~(usize) 15);
+	u32	   Mask	  = Mem_MatchBlock(Block, Target) & (0xFFFF << (Data - Block));
+
+	while (!Mask) {
+		Block += 16;
+		Mask   = Mem_MatchBlock(Block, Target);
+	}
+
+	u32 Index;
+	Intrin_BitScanForward64(&Index, Mask);
+	return (usize) (Block + Index - Data);
+}
+
+// Returns Size if the byte isn't there.
+internal usize
+Mem_FindByte(vptr Data, u08 Byte, usize Size)
+{
+	if (!Size) return 0;
+
+	u08x16 Target = (u08x16){ 0 } + Byte;
+	u08	  *Start  = Data;
+	u08	  *End	  = Start + Size;
+	u08	  *Block  = (u08 *) ((usize) Start & ~(usize) 15);
+	u32	   Mask	  = Mem_MatchBlock(Block, Target) & (0xFFFF << (Start - Block));
+
+	while (!Mask) {
+		Block += 16;
+		if (Block >= End) return Size;
+		Mask = Mem_MatchBlock(Block, Target);
+	}
+
+	u32 Index;
+	Intrin_BitScanForward64(&Index, Mask);
+	return MIN((usize) (Block + Index - Start), Size);
+}
+
+// Multiplies into 128 bits and folds the halves together, so every bit of
+// each input reaches every bit of the result.
+internal u64
+Mem_HashMix(u64 A, u64 B)
+{
+	u64 High;
+	u64 Low = Intrin_Multiply128(A, B, &High);
+	return Low ^ High;
+}
+
+// A wyhash-style hash. Inputs are read eight bytes at a time, and never past
+// the end, so the result only depends on the Size bytes at Data.
+internal u64
+Mem_Hash(vptr Data, usize Size, u64 Seed)
+{
+	const u64 P0 = 0xA0761D6478BD642Full;
+	const u64 P1 = 0xE7037ED1A0B428DBull;
+	const u64 P2 = 0x8EBC6AF09C88C6E3ull;
+	const u64 P3 = 0x589965CC75374CC3ull;
+
+	u08 *D = Data;
+	u64	 A = 0, B = 0;
+
+	Seed ^= Mem_HashMix(Seed ^ P0, P1);
+
+	if (Size <= 16) {
+		// Short keys are covered by overlapping reads from both ends.
+		if (Size >= 4) {
+			usize Offset = (Size >> 3) << 2;
+			u32	  Head0	 = *(u32_unaligned *) D;
+			u32	  Head1	 = *(u32_unaligned *) (D + Offset);
+			u32	  Tail0	 = *(u32_unaligned *) (D + Size - 4);
+			u32	  Tail1	 = *(u32_unaligned *) (D + Size - 4 - Offset);
+			A			 = (u64) Head0 << 32 | Head1;
+			B			 = (u64) Tail0 << 32 | Tail1;
+		} else if (Size) {
+			A = (u64) D[0] << 16 | (u64) D[Size >> 1] << 8 | D[Size - 1];
+		}
+	} else {
+		usize Left = Size;
+		if (Left > 48) {
+			u64 Seed1 = Seed, Seed2 = Seed;
+			do {
+				u64_unaligned *W = (u64_unaligned *) D;
+				Seed			 = Mem_HashMix(W[0] ^ P1, W[1] ^ Seed);
+				Seed1			 = Mem_HashMix(W[2] ^ P2, W[3] ^ Seed1);
+				Seed2			 = Mem_HashMix(W[4] ^ P3, W[5] ^ Seed2);
+				D				+= 48;
+				Left			-= 48;
+			} while (Left > 48);
+			Seed ^= Seed1 ^ Seed2;
+		}
+
+		for (; Left > 16; D += 16, Left -= 16) {
+			u64 W0 = *(u64_unaligned *) D;
+			u64 W1 = *(u64_unaligned *) (D + 8);
+			Seed   = Mem_HashMix(W0 ^ P1, W1 ^ Seed);
+		}
+
+		A = *(u64_unaligned *) (D + Left - 16);
+		B = *(u64_unaligned *) (D + Left - 8);
+	}
+
+	u64 High;
+	u64 Low = Intrin_Multiply128(A ^ P1, B ^ Seed, &High);
+	return Mem_HashMix(Low ^ P0 ^ Size, High ^ P1);
+}
+
+// Picked once per process, so keys can't be chosen ahead of time to collide.
+// Load hands it to the platform, and takes it back after a reload, so hashes
+// kept from before still match.
+internal u64
+Mem_GetHashSeed(void)
+{
+	if (_G.HashSeed) return _G.HashSeed;
+
+	// The stack address adds whatever randomness the address space layout has.
+	u64 Time	= Intrin_ReadTimeStampCounter();
+	u64 NewSeed = Mem_HashMix(Time ^ 0xA0761D6478BD642Full, (usize) &Time) | 1;
+	u64 OldSeed = Intrin_CompareExchange64(&_G.HashSeed, 0, NewSeed);
+	return OldSeed ? OldSeed : NewSeed;
 }
 
 internal heap *
@@ -180,33 +661,98 @@ Heap_GetHeap(heap_handle *Handle)
 	return (heap *) (Handles - OFFSET_OF(heap, Handles));
 }
 
-// TODO Resizeable heap
-
+// Small allocations come from slabs and don't have a handle.
 internal heap_handle *
 Heap_GetHandleA(vptr Data)
-{ return *((heap_handle **) Data - 1); }
+{
+	heap_handle *Handle = *((heap_handle **) Data - 1);
+	Assert(!((usize) Handle & 1), "Slab objects don't have a handle");
+	return Handle;
+}
+
+internal void
+Heap_Lock(heap *Heap)
+{
+	// Reading the timestamp counter can cost more than taking a free lock,
+	// so only locks that look taken are timed.
+	if (!((volatile u32 *) &Heap->Mutex)[0]) {
+		Platform_LockMutex(&Heap->Mutex);
+	} else {
+		u64 StartTime = Intrin_ReadTimeStampCounter();
+		Platform_LockMutex(&Heap->Mutex);
+		u64 WaitCycles = Intrin_ReadTimeStampCounter() - StartTime;
+		Heap->Counters.LockWaitCycles += WaitCycles;
+		Heap->Counters.ContendedLockCount++;
+	}
+	Heap->Counters.LockCount++;
+}
+
+internal void
+Heap_Unlock(heap *Heap)
+{ Platform_UnlockMutex(&Heap->Mutex); }
+
+// Expects the heap to be locked.
+internal void
+Heap_AddUsedSize(heap *Heap, s64 Size)
+{
+	heap_counters *Counters	 = &Heap->Counters;
+	Counters->UsedSize		+= Size;
+	Counters->PeakUsedSize	 = MAX(Counters->PeakUsedSize, Counters->UsedSize);
+}
 
+// Expects the heap to be locked.
+internal void
+Heap_RecordEvent(
+	heap		   *Heap,
+	heap_event_type Type,
+	vptr			Data,
+	vptr			PrevData,
+	u32				Size
+)
+{
+	heap_timeline *Timeline = Heap->Timeline;
+	if (!Timeline) return;
+
+	heap_event *Event = Timeline->Events + Timeline->Count % Timeline->Capacity;
+	Event->Time		  = Intrin_ReadTimeStampCounter();
+	Event->Offset	  = (u08 *) Data - (u08 *) Heap;
+	Event->PrevOffset = PrevData ? (u08 *) PrevData - (u08 *) Heap : 0;
+	Event->Size		  = Size;
+	Event->Type		  = Type;
+	Timeline->Count++;
+}
+
+// The heap starts at the first aligned address in the memory, since anchored
+// allocations tell handles from slabs by the low bit of the pointer to them.
 internal heap *
 Heap_Init(vptr MemBase, u64 Size)
 {
 	u32 HeaderSize = sizeof(heap) + sizeof(heap_handle);
+	u64 Padding	   = ALIGN_UP((usize) MemBase, sizeof(usize)) - (usize) MemBase;
 
 	Assert(MemBase);
-	Assert(Size > HeaderSize);
-	Assert(Size - HeaderSize < (1ull << 46));
-
-	heap *Heap	= MemBase;
-	Heap->Mutex = 0;
+	Assert(Size > HeaderSize + Padding);
+	Assert(Size - Padding - HeaderSize < (1ull << 46));
+
+	Size				= Size - Padding;
+	heap *Heap			= (heap *) ((u08 *) MemBase + Padding);
+	Heap->Mutex			= 0;
+	Heap->CacheOwner	= NULL;
+	Heap->ReservedSize	= Size;
+	Heap->CommittedLow	= Size;
+	Heap->CommittedHigh = 0;
+	Heap->FreeHandles	= 0;
+	Heap->CompactCursor = 0;
+	Heap->Counters		= (heap_counters){ 0 };
+	Heap->Sites			= NULL;
+	Heap->Timeline		= NULL;
+	Mem_Set(Heap->Slabs, 0, sizeof(Heap->Slabs));
 
 	heap_handle *NullUsedHandle = Heap->Handles;
 	NullUsedHandle->Data		= (u08 *) NullUsedHandle;
 	NullUsedHandle->Size		= sizeof(heap_handle);
 	NullUsedHandle->Offset		= Size - HeaderSize;
 	NullUsedHandle->Index		= 0;
-	NullUsedHandle->PrevFree	= 0;
-	NullUsedHandle->NextFree	= 0;
-	NullUsedHandle->PrevUsed	= 0;
-	NullUsedHandle->NextUsed	= 0;
 	NullUsedHandle->PrevBlock	= 0;
 	NullUsedHandle->NextBlock	= 0;
 	NullUsedHandle->Anchored	= TRUE;
@@ -215,52 +761,207 @@ Heap_Init(vptr MemBase, u64 Size)
 	return Heap;
 }
 
+internal heap *
+Heap_Reserve(u64 Size)
+{
+	Size = ALIGN_UP(Size, HEAP_COMMIT_SIZE);
+
+	vptr MemBase = Platform_ReserveMemory(Size);
+	Platform_CommitMemory(MemBase, HEAP_COMMIT_SIZE);
+
+	heap *Heap			= Heap_Init(MemBase, Size);
+	Heap->CommittedLow	= HEAP_COMMIT_SIZE;
+	Heap->CommittedHigh = 0;
+	return Heap;
+}
+
+internal b08
+Heap_IsFullyCommitted(heap *Heap)
+{ return Heap->CommittedLow + Heap->CommittedHigh >= Heap->ReservedSize; }
+
+// Makes sure everything below the offset is committed.
 internal void
-Heap_Defragment(heap *Heap)
+Heap_CommitLow(heap *Heap, u64 Offset)
 {
-	STOP;  // Hasn't been debugged
+	if (Offset <= Heap->CommittedLow || Heap_IsFullyCommitted(Heap)) return;
+
+	u64 Limit  = Heap->ReservedSize - Heap->CommittedHigh;
+	u64 NewLow = MIN(ALIGN_UP(Offset, HEAP_COMMIT_SIZE), Limit);
+	Platform_CommitMemory(
+		(u08 *) Heap + Heap->CommittedLow,
+		NewLow - Heap->CommittedLow
+	);
+	Heap->CommittedLow = NewLow;
+}
 
-	Assert(Heap);
+// Makes sure everything from the offset up is committed.
+internal void
+Heap_CommitHigh(heap *Heap, u64 Offset)
+{
+	u64 Size = Heap->ReservedSize - Offset;
+	if (Size <= Heap->CommittedHigh || Heap_IsFullyCommitted(Heap)) return;
+
+	u64 Limit	= Heap->ReservedSize - Heap->CommittedLow;
+	u64 NewHigh = MIN(ALIGN_UP(Size, HEAP_COMMIT_SIZE), Limit);
+	Platform_CommitMemory(
+		(u08 *) Heap + Heap->ReservedSize - NewHigh,
+		NewHigh - Heap->CommittedHigh
+	);
+	Heap->CommittedHigh = NewHigh;
+}
+
+// Decommits the free space between the handles and the lowest block, which
+// is where memory is given back when the heap shrinks.
+internal void
+Heap_Trim(heap *Heap)
+{
+	Heap_Lock(Heap);
 
 	heap_handle *Handles = Heap->Handles;
+	u08			*GapBase = (u08 *) Handles[0].Data + Handles[0].Size;
+	u64			 GapStart = GapBase - (u08 *) Heap;
+	u64			 GapEnd	  = GapStart + Handles[0].Offset;
+
+	u64 Start = ALIGN_UP(GapStart, HEAP_COMMIT_SIZE);
+	u64 End	  = GapEnd & ~(u64) (HEAP_COMMIT_SIZE - 1);
+
+	if (Heap->CommittedLow < Heap->ReservedSize && Start < End) {
+		u64 Low	 = Heap->CommittedLow;
+		u64 High = Heap->ReservedSize - Heap->CommittedHigh;
+		if (Low > Start)
+			Platform_DecommitMemory((u08 *) Heap + Start, MIN(Low, End) - Start);
+		if (High < End) {
+			u64 From = MAX(High, Start);
+			Platform_DecommitMemory((u08 *) Heap + From, End - From);
+		}
+		Heap->CommittedLow = MIN(Low, Start);
 
-	u64			 Offset = 0;
-	heap_handle *Block	= Handles;
-	do {
-		Block = Handles + Block->PrevBlock;
+		// Once the heap has been fully committed, blocks can sit below where
+		// the high part starts. Whatever the low part had above the gap is
+		// still committed, and joins the high part.
+		if (Low > End) Heap->CommittedHigh = Heap->ReservedSize - End;
+		else Heap->CommittedHigh = Heap->ReservedSize - MAX(High, End);
+	}
 
-		if (Block->Anchored) {
-			Block->Offset += Offset;
-			Offset		   = 0;
-			continue;
-		}
+	Heap_Unlock(Heap);
+}
+
+internal heap_stats
+Heap_GetStats(heap *Heap)
+{
+	Heap_Lock(Heap);
+	heap_stats Stats = {
+		.ReservedSize  = Heap->ReservedSize,
+		.CommittedSize = MIN(
+			Heap->CommittedLow + Heap->CommittedHigh,
+			Heap->ReservedSize
+		),
+		.Counters = Heap->Counters,
+	};
+	Heap_Unlock(Heap);
+	return Stats;
+}
 
-		Offset		  += Block->Offset;
-		Block->Offset  = 0;
+#define HEAP_COMPACT_CHECK_INTERVAL 256
 
-		if (Offset) {
-			Mem_Cpy((u08 *) Block->Data + Offset, Block->Data, Block->Size);
-			Block->Data = (u08 *) Block->Data + Offset;
+// Expects the heap to be locked. Unanchored blocks are slid up over the gaps
+// above them, one at a time from the cursor down, so the free space ends up
+// in the gap above the next anchored block. The budget is in seconds, and
+// zero means there's no limit. A block is always moved if one is reached, so
+// repeated calls make progress. Returns whether it got to the bottom.
+internal b08
+Heap_CompactBlocks(heap *Heap, r64 Budget)
+{
+	heap_handle *Handles = Heap->Handles;
+	u32			 Cursor	 = Heap->CompactCursor;
+	heap_handle *Block	 = Handles + (Cursor ? Cursor : Handles[0].PrevBlock);
+
+	timestamp StartTime	 = Platform_GetTimestamp();
+	u32		  VisitCount = 0;
+
+	while (Block->Index) {
+		heap_handle *PrevBlock = Handles + Block->PrevBlock;
+		b08			 Moved	   = FALSE;
+
+		if (!Block->Anchored && Block->Offset) {
+			u08 *Data = Block->Data;
+			Mem_Cpy(Data + Block->Offset, Data, Block->Size);
+			Block->Data		   = Data + Block->Offset;
+			PrevBlock->Offset += Block->Offset;
+			Block->Offset	   = 0;
+			Moved			   = TRUE;
+			Heap_RecordEvent(
+				Heap,
+				HEAP_EVENT_MOVE,
+				Block->Data,
+				Data,
+				Block->Size
+			);
 		}
-	} while (Block->Index);
+
+		Block = PrevBlock;
+		if (Budget == 0) continue;
+		if (!Moved && ++VisitCount < HEAP_COMPACT_CHECK_INTERVAL) continue;
+
+		VisitCount = 0;
+		timestamp Time = Platform_GetTimestamp();
+		if (Platform_GetSecondsElapsed(StartTime, Time) >= Budget) break;
+	}
+
+	Heap->CompactCursor = Block->Index;
+	return Block->Index == 0;
 }
 
+// Moves every unanchored block, so their data pointers have to be fetched
+// from their handles again afterward.
 internal void
-Heap_AllocateBlock(heap *Heap, heap_handle *Handle, u32 Size)
+Heap_Defragment(heap *Heap)
 {
-	heap_handle *Handles   = Heap->Handles;
-	heap_handle *PrevBlock = Handles + Handles[0].PrevBlock;
-	while (PrevBlock->Index && PrevBlock->Offset < Size)
-		PrevBlock = Handles + PrevBlock->PrevBlock;
-	if (PrevBlock->Offset < Size) {
-		Heap_Defragment(Heap);
-		Assert(
-			PrevBlock->Offset >= Size,
-			"Not enough memory for new heap block"
-		);
-	}
+	Assert(Heap);
+	Heap_Lock(Heap);
+	Heap->CompactCursor = 0;
+	Heap_CompactBlocks(Heap, 0);
+	Heap_Unlock(Heap);
+}
+
+// Does part of a defragmentation, taking about Budget seconds. It picks up
+// where the last step left off, and returns TRUE once it's done a full pass.
+internal b08
+Heap_DefragmentStep(heap *Heap, r64 Budget)
+{
+	Assert(Heap);
+	Assert(Budget > 0);
+	Heap_Lock(Heap);
+	b08 Finished = Heap_CompactBlocks(Heap, Budget);
+	Heap_Unlock(Heap);
+	return Finished;
+}
+
+// Returns the block to place a new block above, or NULL if there's no gap
+// big enough.
+internal heap_handle *
+Heap_FindGap(heap *Heap, u32 Size)
+{
+	heap_handle *Handles = Heap->Handles;
+	heap_handle *Block	 = Handles + Handles[0].PrevBlock;
+	while (Block->Index && Block->Offset < Size)
+		Block = Handles + Block->PrevBlock;
+	return (Block->Offset >= Size) ? Block : NULL;
+}
+
+// Puts the block at the top of the gap above PrevBlock.
+internal void
+Heap_PlaceBlock(
+	heap		*Heap,
+	heap_handle *Handle,
+	heap_handle *PrevBlock,
+	u32			 Size
+)
+{
+	heap_handle *Handles = Heap->Handles;
 	Handle->Data =
 		(u08 *) PrevBlock->Data + PrevBlock->Size + PrevBlock->Offset - Size;
+	Heap_CommitHigh(Heap, (u08 *) Handle->Data - (u08 *) Heap);
 	PrevBlock->Offset					 -= Size;
 	Handle->PrevBlock					  = PrevBlock->Index;
 	Handle->NextBlock					  = PrevBlock->NextBlock;
@@ -270,6 +971,19 @@ Heap_AllocateBlock(heap *Heap, heap_handle *Handle, u32 Size)
 	Handle->Size						  = Size;
 }
 
+internal void
+Heap_AllocateBlock(heap *Heap, heap_handle *Handle, u32 Size)
+{
+	heap_handle *PrevBlock = Heap_FindGap(Heap, Size);
+	if (!PrevBlock) {
+		Heap->CompactCursor = 0;
+		Heap_CompactBlocks(Heap, 0);
+		PrevBlock = Heap_FindGap(Heap, Size);
+		Assert(PrevBlock, "Not enough memory for new heap block");
+	}
+	Heap_PlaceBlock(Heap, Handle, PrevBlock, Size);
+}
+
 internal void
 Heap_FreeBlock(heap *Heap, heap_handle *Handle)
 {
@@ -277,57 +991,147 @@ Heap_FreeBlock(heap *Heap, heap_handle *Handle)
 	Handles[Handle->PrevBlock].Offset	 += Handle->Size + Handle->Offset;
 	Handles[Handle->PrevBlock].NextBlock  = Handle->NextBlock;
 	Handles[Handle->NextBlock].PrevBlock  = Handle->PrevBlock;
+
+	// The compactor carries on from the block below instead.
+	if (Heap->CompactCursor == Handle->Index)
+		Heap->CompactCursor = Handle->PrevBlock;
 }
 
-internal heap_handle *
-_Heap_Allocate(heap *Heap, u32 Size, b08 Anchored)
+// Moves a block below the unanchored blocks packed under it, which move up
+// to take its place, so freeing it joins its space to the gap under them.
+// Expects the heap to be compacted. The data is swapped with three
+// reversals, since there's nowhere else to put it.
+internal void
+Heap_SinkBlock(heap *Heap, heap_handle *Handle)
 {
-	Assert(Heap);
-	Platform_LockMutex(&Heap->Mutex);
+	heap_handle *Handles   = Heap->Handles;
+	heap_handle *PrevBlock = Handles + Handle->PrevBlock;
+	heap_handle *LowBlock  = Handle;
+	while (PrevBlock->Index && !PrevBlock->Anchored && !PrevBlock->Offset) {
+		LowBlock  = PrevBlock;
+		PrevBlock = Handles + PrevBlock->PrevBlock;
+	}
+	if (LowBlock == Handle) return;
+
+	u08 *Low		 = LowBlock->Data;
+	u08 *High		 = Handle->Data;
+	u08 *End		 = High + Handle->Size;
+	u08 *Ranges[][2] = { { Low, High }, { High, End }, { Low, End } };
+	for (u32 I = 0; I < 3; I++) {
+		u08 *A = Ranges[I][0];
+		u08 *B = Ranges[I][1] - 1;
+		for (; A < B; A++, B--) SWAP(*A, *B, u08);
+	}
+
+	for (heap_handle *Block = LowBlock; Block != Handle;) {
+		Block->Data	= (u08 *) Block->Data + Handle->Size;
+		Block		= Handles + Block->NextBlock;
+	}
 
-	heap_handle *Handles	  = Heap->Handles;
-	heap_handle *Handle		  = NULL;
-	b08			 Defragmented = FALSE;
+	heap_handle *TopBlock				 = Handles + Handle->PrevBlock;
+	TopBlock->Offset					 = Handle->Offset;
+	TopBlock->NextBlock					 = Handle->NextBlock;
+	Handles[Handle->NextBlock].PrevBlock = TopBlock->Index;
+
+	Handle->Data		 = Low;
+	Handle->Offset		 = 0;
+	Handle->PrevBlock	 = PrevBlock->Index;
+	Handle->NextBlock	 = LowBlock->Index;
+	PrevBlock->NextBlock = Handle->Index;
+	LowBlock->PrevBlock	 = Handle->Index;
+}
 
-	heap_handle *PrevUsed;
-	if (Handles[0].NextFree == 0) {
+internal void
+Heap_UnlinkFreeHandle(heap *Heap, heap_handle *Handle)
+{
+	heap_handle *Handles = Heap->Handles;
+	if (Handle->PrevFree) Handles[Handle->PrevFree].NextFree = Handle->NextFree;
+	else Heap->FreeHandles = Handle->NextFree;
+	if (Handle->NextFree) Handles[Handle->NextFree].PrevFree = Handle->PrevFree;
+}
+
+// Expects the heap to be locked.
+internal heap_handle *
+Heap_AllocateHandle(heap *Heap, u32 Size, b08 Anchored)
+{
+	heap_handle *Handles = Heap->Handles;
+	heap_handle *Handle;
+
+	if (Heap->FreeHandles) {
+		Handle = Handles + Heap->FreeHandles;
+		Heap_UnlinkFreeHandle(Heap, Handle);
+	} else {
 		if (Handles[0].Offset < sizeof(heap_handle)) {
-			Heap_Defragment(Heap);
-			Defragmented = TRUE;
+			Heap->CompactCursor = 0;
+			Heap_CompactBlocks(Heap, 0);
 			Assert(
 				Handles[0].Offset >= sizeof(heap_handle),
 				"Not enough memory for new heap handle"
 			);
 		}
+		Assert(
+			Handles[0].Size <= U32_MAX - sizeof(heap_handle),
+			"Too many heap handles"
+		);
 
-		u16 HandleCount = (u16) (Handles[0].Size / sizeof(heap_handle));
+		u32 HandleCount = Handles[0].Size / sizeof(heap_handle);
 		Handle			= Handles + HandleCount;
-		Handle->Index	= HandleCount;
+		Heap_CommitLow(Heap, (u08 *) (Handle + 1) - (u08 *) Heap);
+		Handle->Index = HandleCount;
 
 		Handles[0].Size	  += sizeof(heap_handle);
 		Handles[0].Offset -= sizeof(heap_handle);
-
-		PrevUsed = Handles + Handles[0].PrevUsed;
-	} else {
-		Handle							   = Handles + Handles[0].NextFree;
-		Handles[Handle->PrevFree].NextFree = Handle->NextFree;
-		Handles[Handle->NextFree].PrevFree = Handle->PrevFree;
-
-		PrevUsed = Handle;
-		while (PrevUsed->Index && PrevUsed->Free) PrevUsed--;
-	}
-	Handle->PrevUsed				   = PrevUsed->Index;
-	Handle->NextUsed				   = PrevUsed->NextUsed;
-	Handle->PrevFree				   = 0;
-	Handle->NextFree				   = 0;
-	Handles[Handle->PrevUsed].NextUsed = Handle->Index;
-	Handles[Handle->NextUsed].PrevUsed = Handle->Index;
-	Handle->Anchored				   = Anchored;
-	Handle->Free					   = FALSE;
+	}
+	Handle->Anchored = Anchored;
+	Handle->Free	 = FALSE;
 
 	Heap_AllocateBlock(Heap, Handle, Size);
+	return Handle;
+}
+
+// Expects the heap to be locked.
+internal void
+Heap_FreeHandle(heap *Heap, heap_handle *Handle)
+{
+	heap_handle *Handles = Heap->Handles;
+
+	Heap_FreeBlock(Heap, Handle);
+
+	Handle->Data	 = NULL;
+	Handle->Offset	 = 0;
+	Handle->Free	 = TRUE;
+	Handle->Anchored = FALSE;
+	Handle->Size	 = 0;
+	Handle->PrevFree = 0;
+	Handle->NextFree = Heap->FreeHandles;
+	if (Heap->FreeHandles) Handles[Heap->FreeHandles].PrevFree = Handle->Index;
+	Heap->FreeHandles = Handle->Index;
+
+	// Free handles at the end go back to the gap. Each handle is only dropped
+	// once per time it's added, so this is constant time on average.
+	u32 HandleCount = Handles[0].Size / sizeof(heap_handle);
+	if (!Handles[HandleCount - 1].Free) return;
+	while (HandleCount > 1 && Handles[HandleCount - 1].Free)
+		Heap_UnlinkFreeHandle(Heap, Handles + --HandleCount);
+
+	u32 NewSize		   = HandleCount * sizeof(heap_handle);
+	u32 DeltaSize	   = Handles[0].Size - NewSize;
+	Handles[0].Size	   = NewSize;
+	Handles[0].Offset += DeltaSize;
+	Mem_Set(Handles + HandleCount, 0, DeltaSize);
+}
 
-	Platform_UnlockMutex(&Heap->Mutex);
+internal heap_handle *
+_Heap_Allocate(heap *Heap, u32 Size, b08 Anchored)
+{
+	Assert(Heap);
+	Heap_Lock(Heap);
+	heap_handle *Handle = Heap_AllocateHandle(Heap, Size, Anchored);
+	Heap->Counters.AllocationCount++;
+	Heap->Counters.AllocatedSize += Size;
+	Heap_AddUsedSize(Heap, Size);
+	Heap_RecordEvent(Heap, HEAP_EVENT_ALLOCATE, Handle->Data, NULL, Size);
+	Heap_Unlock(Heap);
 	return Handle;
 }
 
@@ -335,11 +1139,261 @@ internal heap_handle *
 Heap_Allocate(heap *Heap, u64 Size)
 { return _Heap_Allocate(Heap, Size, FALSE); }
 
+internal u32
+Heap_GetSlabClass(u64 Size)
+{
+	if (Size <= (1 << HEAP_SLAB_MIN_SHIFT)) return 0;
+
+	u32 Index;
+	Intrin_BitScanReverse32(&Index, (u32) Size - 1);
+	return Index + 1 - HEAP_SLAB_MIN_SHIFT;
+}
+
+// Expects the heap to be locked.
+internal vptr
+Heap_AllocateSlabObject(heap *Heap, u32 Class)
+{
+	usize	   ObjectSize = 1 << (HEAP_SLAB_MIN_SHIFT + Class);
+	heap_slab *Slab		  = Heap->Slabs[Class];
+
+	if (!Slab) {
+		usize SlabSize =
+			MAX(HEAP_SLAB_MIN_SIZE, HEAP_SLAB_MIN_OBJECTS * ObjectSize);
+		heap_handle *Handle = Heap_AllocateHandle(Heap, SlabSize, TRUE);
+
+		// Blocks aren't aligned, and the tag needs the low bit to be free.
+		Slab			   = (heap_slab *) ALIGN_UP((usize) Handle->Data, 16);
+		*Slab			   = (heap_slab){ 0 };
+		Slab->Heap		   = Heap;
+		Slab->Handle	   = Handle;
+		Slab->Class		   = Class;
+		Slab->End		   = (u08 *) Handle->Data + SlabSize;
+		Slab->Cursor	   = (u08 *) ALIGN_UP((usize) (Slab + 1), 16);
+		Heap->Slabs[Class] = Slab;
+	}
+
+	u08 *Object;
+	if (Slab->FreeList) {
+		Object		   = Slab->FreeList;
+		Slab->FreeList = *(vptr *) Object;
+	} else {
+		Object		  = Slab->Cursor;
+		Slab->Cursor += ObjectSize;
+	}
+	Slab->UsedCount++;
+	Heap_AddUsedSize(Heap, ObjectSize);
+
+	// Full slabs leave the list until something in them is freed.
+	if (!Slab->FreeList && Slab->Cursor + ObjectSize > Slab->End) {
+		Heap->Slabs[Class] = Slab->Next;
+		if (Slab->Next) Slab->Next->Prev = NULL;
+		Slab->Next = NULL;
+	}
+
+	*(usize *) Object = (usize) Slab | 1;
+	return Object + sizeof(usize);
+}
+
+internal heap_slab *
+Heap_GetSlab(vptr Data)
+{ return (heap_slab *) (*((usize *) Data - 1) - 1); }
+
+// Expects the heap to be locked.
+internal void
+Heap_FreeSlabObject(vptr Data)
+{
+	heap_slab *Slab	  = Heap_GetSlab(Data);
+	heap	  *Heap	  = Slab->Heap;
+	u08		  *Object = (u08 *) Data - sizeof(usize);
+
+	usize ObjectSize = 1 << (HEAP_SLAB_MIN_SHIFT + Slab->Class);
+	b08	  WasFull = !Slab->FreeList && Slab->Cursor + ObjectSize > Slab->End;
+
+	*(vptr *) Object = Slab->FreeList;
+	Slab->FreeList	 = Object;
+	Slab->UsedCount--;
+	Heap_AddUsedSize(Heap, -(s64) ObjectSize);
+
+	heap_slab **List = Heap->Slabs + Slab->Class;
+	if (WasFull) {
+		Slab->Prev = NULL;
+		Slab->Next = *List;
+		if (*List) (*List)->Prev = Slab;
+		*List = Slab;
+	}
+
+	// Empty slabs go back to the heap, but one is kept around per class so
+	// that a single object being allocated and freed doesn't thrash.
+	if (!Slab->UsedCount && (*List != Slab || Slab->Next)) {
+		if (Slab->Prev) Slab->Prev->Next = Slab->Next;
+		else *List = Slab->Next;
+		if (Slab->Next) Slab->Next->Prev = Slab->Prev;
+		Heap_FreeHandle(Heap, Slab->Handle);
+	}
+}
+
+internal void
+Heap_EnableThreadCaches(heap *Heap)
+{
+	if (Heap->CacheOwner) return;
+
+	heap_cache_owner *Owner = Platform_AllocateMemory(sizeof(heap_cache_owner));
+	Owner->Heap				= Heap;
+	Owner->RefCount			= 1;
+	Heap->CacheOwner		= Owner;
+}
+
+internal void
+Heap_ReleaseCacheOwner(heap_cache_owner *Owner)
+{
+	if (Intrin_AtomicAdd32(&Owner->RefCount, -1) == 1)
+		Platform_FreeMemory(Owner, sizeof(heap_cache_owner));
+}
+
+internal u32
+Heap_GetMagazineCapacity(u32 Class)
+{
+	u32 Capacity = HEAP_CACHE_MAX_BYTES >> (HEAP_SLAB_MIN_SHIFT + Class);
+	return MIN(Capacity, HEAP_CACHE_MAX_COUNT);
+}
+
+// Expects the heap to be locked.
+internal void
+Heap_FlushCacheCounters(heap *Heap, heap_cache_entry *Entry)
+{
+	Heap->Counters.AllocationCount += Entry->Counters.AllocationCount;
+	Heap->Counters.FreeCount	   += Entry->Counters.FreeCount;
+	Heap->Counters.AllocatedSize   += Entry->Counters.AllocatedSize;
+	Entry->Counters					= (heap_counters){ 0 };
+}
+
+// Gives an entry's objects back to its heap and empties it. If the heap has
+// disabled its caches, or been set up again, the objects belong to memory
+// that's gone or already taken back, so they're dropped instead.
+internal void
+Heap_ReleaseCacheEntry(heap_cache_entry *Entry)
+{
+	heap_cache_owner *Owner = Entry->Owner;
+	heap			 *Heap	= ((volatile heap_cache_owner *) Owner)->Heap;
+
+	if (Heap && Heap->CacheOwner == Owner) {
+		Heap_Lock(Heap);
+		Heap_FlushCacheCounters(Heap, Entry);
+		for (u32 C = 0; C < HEAP_SLAB_CLASS_COUNT; C++) {
+			heap_magazine *Magazine = Entry->Magazines + C;
+			for (u32 J = 0; J < Magazine->Count; J++)
+				Heap_FreeSlabObject(Magazine->Objects[J]);
+		}
+		Heap_Unlock(Heap);
+	}
+
+	Heap_ReleaseCacheOwner(Owner);
+	Mem_Set(Entry, 0, sizeof(heap_cache_entry));
+}
+
+// Returns NULL if the heap isn't cached, or if the thread already caches too
+// many live heaps.
+internal heap_cache_entry *
+Heap_GetCacheEntry(heap *Heap)
+{
+	heap_cache_owner *Owner = Heap->CacheOwner;
+	if (!Owner || Heap->Timeline) return NULL;
+
+	heap_cache *Cache = Platform_GetThreadSlot(THREAD_SLOT_HEAP_CACHE);
+	if (!Cache) {
+		Cache = Platform_AllocateMemory(sizeof(heap_cache));
+		Mem_Set(Cache, 0, sizeof(heap_cache));
+		Platform_SetThreadSlot(THREAD_SLOT_HEAP_CACHE, Cache);
+	}
+
+	for (u32 I = 0; I < HEAP_CACHE_HEAP_COUNT; I++)
+		if (Cache->Entries[I].Owner == Owner) return Cache->Entries + I;
+
+	// Entries for heaps that are gone, or were set up again at this address,
+	// can be taken over.
+	for (u32 I = 0; I < HEAP_CACHE_HEAP_COUNT; I++) {
+		heap_cache_entry *Entry = Cache->Entries + I;
+		if (Entry->Owner) {
+			heap *OldHeap = ((volatile heap_cache_owner *) Entry->Owner)->Heap;
+			if (OldHeap && OldHeap != Heap) continue;
+			Heap_ReleaseCacheEntry(Entry);
+		}
+
+		Intrin_AtomicAdd32(&Owner->RefCount, 1);
+		Entry->Owner = Owner;
+		return Entry;
+	}
+	return NULL;
+}
+
+// Has to be called before a cached heap is freed or set up again, while no
+// other thread is using it. The calling thread's cached objects go back to
+// the heap, and other threads drop theirs the next time they look.
+internal void
+Heap_DisableThreadCaches(heap *Heap)
+{
+	heap_cache_owner *Owner = Heap->CacheOwner;
+	if (!Owner) return;
+
+	heap_cache *Cache = Platform_GetThreadSlot(THREAD_SLOT_HEAP_CACHE);
+	for (u32 I = 0; Cache && I < HEAP_CACHE_HEAP_COUNT; I++)
+		if (Cache->Entries[I].Owner == Owner)
+			Heap_ReleaseCacheEntry(Cache->Entries + I);
+
+	Heap->CacheOwner = NULL;
+	((volatile heap_cache_owner *) Owner)->Heap = NULL;
+	Heap_ReleaseCacheOwner(Owner);
+}
+
+internal void
+Heap_ReleaseThreadCache(void)
+{
+	heap_cache *Cache = Platform_GetThreadSlot(THREAD_SLOT_HEAP_CACHE);
+	if (!Cache) return;
+
+	for (u32 I = 0; I < HEAP_CACHE_HEAP_COUNT; I++)
+		if (Cache->Entries[I].Owner) Heap_ReleaseCacheEntry(Cache->Entries + I);
+
+	Platform_FreeMemory(Cache, sizeof(heap_cache));
+	Platform_SetThreadSlot(THREAD_SLOT_HEAP_CACHE, NULL);
+}
+
 internal vptr
 Heap_AllocateA(heap *Heap, u64 Size)
 {
-	heap_handle *Handle =
-		_Heap_Allocate(Heap, Size + sizeof(heap_handle *), TRUE);
+	Assert(Heap);
+	u64 TotalSize = Size + sizeof(heap_handle *);
+
+	if (TotalSize <= HEAP_SLAB_MAX_SIZE) {
+		u32				  Class		 = Heap_GetSlabClass(TotalSize);
+		u32				  ObjectSize = 1 << (HEAP_SLAB_MIN_SHIFT + Class);
+		heap_cache_entry *Entry		 = Heap_GetCacheEntry(Heap);
+		heap_magazine	 *Magazine	 = Entry ? Entry->Magazines + Class : NULL;
+
+		if (Magazine && Magazine->Count) {
+			Entry->Counters.AllocationCount++;
+			Entry->Counters.AllocatedSize += ObjectSize;
+			return Magazine->Objects[--Magazine->Count];
+		}
+
+		Heap_Lock(Heap);
+		if (Magazine) {
+			u32 Count = MAX(Heap_GetMagazineCapacity(Class) / 2, 1);
+			while (Magazine->Count < Count)
+				Magazine->Objects[Magazine->Count++] =
+					Heap_AllocateSlabObject(Heap, Class);
+			Heap_FlushCacheCounters(Heap, Entry);
+		}
+		vptr Data = Magazine ? Magazine->Objects[--Magazine->Count]
+							 : Heap_AllocateSlabObject(Heap, Class);
+		Heap->Counters.AllocationCount++;
+		Heap->Counters.AllocatedSize += ObjectSize;
+		Heap_RecordEvent(Heap, HEAP_EVENT_ALLOCATE, Data, NULL, ObjectSize);
+		Heap_Unlock(Heap);
+		return Data;
+	}
+
+	heap_handle *Handle				 = _Heap_Allocate(Heap, TotalSize, TRUE);
 	*((heap_handle **) Handle->Data) = Handle;
 	return (u08 *) Handle->Data + sizeof(heap_handle *);
 }
@@ -350,25 +1404,53 @@ Heap_Resize(heap_handle *Handle, u32 NewSize)
 	Assert(Handle);
 
 	heap *Heap = Heap_GetHeap(Handle);
-	Platform_LockMutex(&Heap->Mutex);
+	Heap_Lock(Heap);
 
+	u08 *PrevData = Handle->Data;
+	u32	 PrevSize = Handle->Size;
 	if (NewSize <= Handle->Size + Handle->Offset) {
 		Handle->Offset += (s64) Handle->Size - (s64) NewSize;
 		Handle->Size	= NewSize;
 	} else {
-		u08 *PrevData = Handle->Data;
-		u32	 PrevSize = Handle->Size;
+		// Compacting after the block is freed would write over its data, so
+		// it only happens while the block is still in the list. If that
+		// isn't enough, the block is sunk so its space joins the gap that
+		// a second compaction would have made.
+		if (!Heap_FindGap(Heap, NewSize)) {
+			Heap->CompactCursor = 0;
+			Heap_CompactBlocks(Heap, 0);
+			if (!Heap_FindGap(Heap, NewSize)) Heap_SinkBlock(Heap, Handle);
+		}
+
+		PrevData = Handle->Data;
 		Heap_FreeBlock(Heap, Handle);
-		Heap_AllocateBlock(Heap, Handle, NewSize);
+		heap_handle *PrevBlock = Heap_FindGap(Heap, NewSize);
+		Assert(PrevBlock, "Not enough memory for new heap block");
+		Heap_PlaceBlock(Heap, Handle, PrevBlock, NewSize);
 		Mem_Cpy(Handle->Data, PrevData, PrevSize);
 	}
 
-	Platform_UnlockMutex(&Heap->Mutex);
+	Heap_AddUsedSize(Heap, (s64) NewSize - (s64) PrevSize);
+	Heap_RecordEvent(Heap, HEAP_EVENT_RESIZE, Handle->Data, PrevData, NewSize);
+	Heap_Unlock(Heap);
 }
 
 internal void
 Heap_ResizeA(vptr *Data, u32 NewSize)
 {
+	usize Tag = *((usize *) *Data - 1);
+	if (Tag & 1) {
+		heap_slab *Slab		  = (heap_slab *) (Tag - 1);
+		usize	   ObjectSize = 1 << (HEAP_SLAB_MIN_SHIFT + Slab->Class);
+		if (NewSize + sizeof(usize) <= ObjectSize) return;
+
+		vptr NewData = Heap_AllocateA(Slab->Heap, NewSize);
+		Mem_Cpy(NewData, *Data, ObjectSize - sizeof(usize));
+		Heap_FreeA(*Data);
+		*Data = NewData;
+		return;
+	}
+
 	heap_handle *Handle = Heap_GetHandleA(*Data);
 	Heap_Resize(Handle, NewSize + sizeof(heap_handle *));
 	*Data = (u08 *) Handle->Data + sizeof(heap_handle *);
@@ -379,57 +1461,359 @@ Heap_Free(heap_handle *Handle)
 {
 	if (!Handle) return;
 
-	heap		*Heap	 = Heap_GetHeap(Handle);
-	heap_handle *Handles = Heap->Handles;
-	Platform_LockMutex(&Heap->Mutex);
+	heap *Heap = Heap_GetHeap(Handle);
+	Heap_Lock(Heap);
+	Heap->Counters.FreeCount++;
+	Heap_AddUsedSize(Heap, -(s64) Handle->Size);
+	Heap_RecordEvent(Heap, HEAP_EVENT_FREE, Handle->Data, NULL, Handle->Size);
+	Heap_FreeHandle(Heap, Handle);
+	Heap_Unlock(Heap);
+}
 
-	Heap_FreeBlock(Heap, Handle);
+internal void
+Heap_FreeA(vptr Data)
+{
+	if (!Data) return;
 
-	Handles[Handle->NextUsed].PrevUsed = Handle->PrevUsed;
-	Handles[Handle->PrevUsed].NextUsed = Handle->NextUsed;
-
-	if (Handle->NextUsed == 0) {
-		heap_handle *PrevFree = Handles + Handle->PrevUsed;
-		while (PrevFree->Index && !PrevFree->Free) PrevFree--;
-		Handles[0].PrevFree = PrevFree->Index;
-		PrevFree->NextFree	= 0;
-
-		u16 Offset		   = Handle->PrevUsed + 1;
-		u64 NewSize		   = Offset * sizeof(heap_handle);
-		u64 DeltaSize	   = Handles[0].Size - NewSize;
-		Handles[0].Size	   = NewSize;
-		Handles[0].Offset += DeltaSize;
-		Mem_Set(Handles + Offset, 0, DeltaSize);
-	} else {
-		heap_handle *PrevFree = Handle;
-		while (PrevFree->Index && !PrevFree->Free) PrevFree--;
+	usize Tag = *((usize *) Data - 1);
+	if (!(Tag & 1)) {
+		Heap_Free((heap_handle *) Tag);
+		return;
+	}
+
+	heap_slab		 *Slab		 = Heap_GetSlab(Data);
+	heap			 *Heap		 = Slab->Heap;
+	u32				  ObjectSize = 1 << (HEAP_SLAB_MIN_SHIFT + Slab->Class);
+	heap_cache_entry *Entry		 = Heap_GetCacheEntry(Heap);
+
+	if (!Entry) {
+		Heap_Lock(Heap);
+		Heap->Counters.FreeCount++;
+		Heap_RecordEvent(Heap, HEAP_EVENT_FREE, Data, NULL, ObjectSize);
+		Heap_FreeSlabObject(Data);
+		Heap_Unlock(Heap);
+		return;
+	}
+
+	// The oldest half goes back, since the newest objects are the most
+	// likely to still be in the cache.
+	heap_magazine *Magazine = Entry->Magazines + Slab->Class;
+	u32			   Capacity = Heap_GetMagazineCapacity(Slab->Class);
+	if (Magazine->Count == Capacity) {
+		u32 Count = MAX(Capacity / 2, 1);
+		Heap_Lock(Heap);
+		Heap_FlushCacheCounters(Heap, Entry);
+		for (u32 I = 0; I < Count; I++)
+			Heap_FreeSlabObject(Magazine->Objects[I]);
+		Heap_Unlock(Heap);
+
+		Magazine->Count -= Count;
+		Mem_Cpy(
+			Magazine->Objects,
+			Magazine->Objects + Count,
+			Magazine->Count * sizeof(vptr)
+		);
+	}
+	Magazine->Objects[Magazine->Count++] = Data;
+	Entry->Counters.FreeCount++;
+}
 
-		Handle->Data					   = NULL;
-		Handle->Offset					   = 0;
-		Handle->Free					   = TRUE;
-		Handle->Anchored				   = FALSE;
-		Handle->Size					   = 0;
-		Handle->PrevFree				   = PrevFree->Index;
-		Handle->NextFree				   = PrevFree->NextFree;
-		Handle->PrevUsed				   = 0;
-		Handle->NextUsed				   = 0;
-		Handle->PrevBlock				   = 0;
-		Handle->NextBlock				   = 0;
-		Handles[Handle->NextFree].PrevFree = Handle->Index;
-		Handles[Handle->PrevFree].NextFree = Handle->Index;
+internal vptr
+_Heap_AllocateAtSite(heap *Heap, u64 Size, c08 *File, u32 Line)
+{
+	vptr Data = Heap_AllocateA(Heap, Size);
+
+	// The table is kept out of the heap so it doesn't change what's measured.
+	Heap_Lock(Heap);
+	if (!Heap->Sites) {
+		usize TableSize = HEAP_SITE_CAPACITY * sizeof(heap_site);
+		Heap->Sites		= Platform_AllocateMemory(TableSize);
+		Mem_Set(Heap->Sites, 0, TableSize);
 	}
 
-	Platform_UnlockMutex(&Heap->Mutex);
+	// Each call site has its own copy of the file name, so the pointer is
+	// enough to compare.
+	u32 Hash = (u32) ((usize) File ^ Line * 0x9E3779B9);
+	for (u32 I = 0; I < HEAP_SITE_CAPACITY; I++) {
+		heap_site *Site = Heap->Sites + (Hash + I) % HEAP_SITE_CAPACITY;
+		if (!Site->File) {
+			Site->File = File;
+			Site->Line = Line;
+		}
+		if (Site->File == File && Site->Line == Line) {
+			Site->AllocationCount++;
+			Site->AllocatedSize += Size;
+			break;
+		}
+	}
+	Heap_Unlock(Heap);
+
+	return Data;
+}
+
+internal s08
+Heap_CmpSites(vptr A, vptr B)
+{
+	u64 SizeA = ((heap_site *) A)->AllocatedSize;
+	u64 SizeB = ((heap_site *) B)->AllocatedSize;
+	if (SizeA == SizeB) return EQUAL;
+	return (SizeA > SizeB) ? LESS : GREATER;
 }
 
+#define HEAP_SITE_PRINT_COUNT 16
+
 internal void
-Heap_FreeA(vptr Data)
-{ Heap_Free(Heap_GetHandleA(Data)); }
+Heap_PrintStats(heap *Heap)
+{
+	heap_stats	  Stats	   = Heap_GetStats(Heap);
+	heap_counters Counters = Stats.Counters;
+
+	Printf(
+		"Reserved %lu bytes, committed %lu\n",
+		Stats.ReservedSize,
+		Stats.CommittedSize
+	);
+	Printf(
+		"%lu allocations of %lu bytes, %lu frees\n",
+		Counters.AllocationCount,
+		Counters.AllocatedSize,
+		Counters.FreeCount
+	);
+	Printf(
+		"%lu bytes used, %lu at the peak\n",
+		Counters.UsedSize,
+		Counters.PeakUsedSize
+	);
+	Printf(
+		"Locked %lu times, %lu of them contended, waiting %lu cycles\n",
+		Counters.LockCount,
+		Counters.ContendedLockCount,
+		Counters.LockWaitCycles
+	);
+	if (!Heap->Sites) return;
+
+	Stack_Push();
+	usize	   TableSize = HEAP_SITE_CAPACITY * sizeof(heap_site);
+	heap_site *Sites	 = Stack_Allocate(TableSize);
+	u32		   SiteCount = 0;
+	Heap_Lock(Heap);
+	for (u32 I = 0; I < HEAP_SITE_CAPACITY; I++)
+		if (Heap->Sites[I].File) Sites[SiteCount++] = Heap->Sites[I];
+	Heap_Unlock(Heap);
+
+	QuickSort(Sites, sizeof(heap_site), SiteCount, Heap_CmpSites);
+	for (u32 I = 0; I < MIN(SiteCount, HEAP_SITE_PRINT_COUNT); I++) {
+		Printf(
+			"%lu bytes in %lu allocations at %s:%u\n",
+			Sites[I].AllocatedSize,
+			Sites[I].AllocationCount,
+			CString(Sites[I].File),
+			Sites[I].Line
+		);
+	}
+	Stack_Pop();
+}
+
+// A capacity of zero turns the timeline off. The ring is kept out of the
+// heap, like the call site table.
+internal void
+Heap_EnableTimeline(heap *Heap, u32 Capacity)
+{
+	Heap_Lock(Heap);
+
+	heap_timeline *Timeline = Heap->Timeline;
+	if (Timeline) {
+		u64 EventsSize = Timeline->Capacity * sizeof(heap_event);
+		Platform_FreeMemory(Timeline, sizeof(heap_timeline) + EventsSize);
+		Heap->Timeline = NULL;
+	}
+
+	if (Capacity) {
+		u64 Size = sizeof(heap_timeline) + Capacity * sizeof(heap_event);
+		Timeline = Platform_AllocateMemory(Size);
+		Timeline->Count	   = 0;
+		Timeline->Capacity = Capacity;
+		Heap->Timeline	   = Timeline;
+	}
+
+	Heap_Unlock(Heap);
+}
+
+internal b08
+Heap_DumpTimeline(heap *Heap, c08 *FileName)
+{
+	Heap_Lock(Heap);
+
+	heap_timeline *Timeline = Heap->Timeline;
+	file_handle	   File;
+	file_mode	   Mode = FILE_WRITE | FILE_CREATE | FILE_CLEAR;
+	if (!Timeline || !Platform_OpenFile(&File, FileName, Mode)) {
+		Heap_Unlock(Heap);
+		return FALSE;
+	}
+
+	// Only the newest events are left once the ring wraps.
+	u64 Count = MIN(Timeline->Count, Timeline->Capacity);
+	heap_timeline_header Header = {
+		.Magic		  = HEAP_TIMELINE_MAGIC,
+		.Version	  = HEAP_TIMELINE_VERSION,
+		.HeapSize	  = Heap->ReservedSize,
+		.EventCount	  = Count,
+		.DroppedCount = Timeline->Count - Count,
+	};
+	u64 Offset = Platform_WriteFile(File, &Header, sizeof(Header), 0);
+
+	u64 First	   = (Timeline->Count - Count) % Timeline->Capacity;
+	u64 FirstCount = MIN(Count, Timeline->Capacity - First);
+	Offset		  += Platform_WriteFile(
+		 File,
+		 Timeline->Events + First,
+		 FirstCount * sizeof(heap_event),
+		 Offset
+	 );
+	Platform_WriteFile(
+		File,
+		Timeline->Events,
+		(Count - FirstCount) * sizeof(heap_event),
+		Offset
+	);
+
+	Platform_CloseFile(File);
+	Heap_Unlock(Heap);
+	return TRUE;
+}
+
+typedef struct heap_live_block {
+	u64 Time;
+	u32 Size;
+} heap_live_block;
+
+#define HEAP_REPORT_BUCKET_COUNT 64
+
+internal void
+Heap_PrintHistogram(c08 *Title, c08 *Unit, u64 *Buckets)
+{
+	Printf("%s\n", CString(Title));
+	for (u32 I = 0; I < HEAP_REPORT_BUCKET_COUNT; I++) {
+		if (!Buckets[I]) continue;
+		Printf("  Under 2^%u %s: %lu\n", I + 1, CString(Unit), Buckets[I]);
+	}
+}
+
+// Replays a file from Heap_DumpTimeline and prints how long blocks lived,
+// how big they were, and how scattered the ones left at the end are. The
+// heap is only used for scratch memory.
+internal b08
+Heap_ReportTimeline(heap *Heap, c08 *FileName)
+{
+	file_handle File;
+	if (!Platform_OpenFile(&File, FileName, FILE_READ)) return FALSE;
+
+	u64					  Length = Platform_GetFileLength(File);
+	u08					 *Data	 = Platform_MapFile(File, Length);
+	heap_timeline_header *Header = (heap_timeline_header *) Data;
+	heap_event			 *Events = (heap_event *) (Header + 1);
+
+	b08 IsValid = Length >= sizeof(heap_timeline_header)
+			   && Header->Magic == HEAP_TIMELINE_MAGIC
+			   && Header->Version == HEAP_TIMELINE_VERSION
+			   && (Length - sizeof(heap_timeline_header)) / sizeof(heap_event)
+					  >= Header->EventCount;
+	if (!IsValid) {
+		Platform_UnmapFile(Data, Length);
+		Platform_CloseFile(File);
+		return FALSE;
+	}
+
+	hashmap Live = HashMap_Init(Heap, sizeof(u64), sizeof(heap_live_block));
+	u64		TypeCounts[4]							   = { 0 };
+	u64		Lifetimes[HEAP_REPORT_BUCKET_COUNT] = { 0 };
+	u64		Sizes[HEAP_REPORT_BUCKET_COUNT]	   = { 0 };
+	u64		LiveSize = 0, PeakLiveSize = 0, LiveCount = 0;
+
+	for (u64 I = 0; I < Header->EventCount; I++) {
+		heap_event		Event = Events[I];
+		heap_live_block Block = { Event.Time, Event.Size };
+		u32				Bucket;
+		if (Event.Type > HEAP_EVENT_MOVE) continue;
+		TypeCounts[Event.Type]++;
+
+		// Blocks from before the first event are unknown, so their frees,
+		// resizes and moves are skipped.
+		switch (Event.Type) {
+			case HEAP_EVENT_ALLOCATE: {
+				Intrin_BitScanReverse64(&Bucket, Event.Size | 1);
+				Sizes[Bucket]++;
+				HashMap_Add(&Live, &Event.Offset, &Block);
+				LiveSize += Event.Size;
+				LiveCount++;
+			} break;
+
+			case HEAP_EVENT_FREE: {
+				if (!HashMap_Remove(&Live, &Event.Offset, NULL, &Block)) break;
+				Intrin_BitScanReverse64(&Bucket, (Event.Time - Block.Time) | 1);
+				Lifetimes[Bucket]++;
+				LiveSize -= Block.Size;
+				LiveCount--;
+			} break;
+
+			case HEAP_EVENT_RESIZE:
+			case HEAP_EVENT_MOVE: {
+				if (!HashMap_Remove(&Live, &Event.PrevOffset, NULL, &Block))
+					break;
+				LiveSize   += (s64) Event.Size - (s64) Block.Size;
+				Block.Size	= Event.Size;
+				HashMap_Add(&Live, &Event.Offset, &Block);
+			} break;
+		}
+		PeakLiveSize = MAX(PeakLiveSize, LiveSize);
+	}
+
+	u64 LowOffset = U64_MAX, HighOffset = 0;
+	HASHMAP_FOREACH (I, Hash, u64, Offset, heap_live_block, Block, &Live) {
+		LowOffset  = MIN(LowOffset, Offset);
+		HighOffset = MAX(HighOffset, Offset + Block.Size);
+	}
+	u64 Span = (HighOffset > LowOffset) ? HighOffset - LowOffset : 0;
+
+	Printf(
+		"%lu events, %lu dropped from before the ring wrapped\n",
+		Header->EventCount,
+		Header->DroppedCount
+	);
+	Printf(
+		"%lu allocations, %lu frees, %lu resizes, %lu moves\n",
+		TypeCounts[HEAP_EVENT_ALLOCATE],
+		TypeCounts[HEAP_EVENT_FREE],
+		TypeCounts[HEAP_EVENT_RESIZE],
+		TypeCounts[HEAP_EVENT_MOVE]
+	);
+	Printf(
+		"%lu bytes live at the peak, %lu in %lu blocks at the end\n",
+		PeakLiveSize,
+		LiveSize,
+		LiveCount
+	);
+	if (Span) {
+		Printf(
+			"%.1f%% of the %lu bytes spanned by the live blocks is free\n",
+			100.0 * (Span - LiveSize) / Span,
+			Span
+		);
+	}
+	Heap_PrintHistogram("Allocation sizes:", "bytes", Sizes);
+	Heap_PrintHistogram("Lifetimes of freed blocks:", "cycles", Lifetimes);
+
+	HashMap_Free(&Live);
+	Platform_UnmapFile(Data, Length);
+	Platform_CloseFile(File);
+	return TRUE;
+}
 
 internal void
 Heap_Dump(heap *Heap)
 {
-	Platform_LockMutex(&Heap->Mutex);
+	Heap_Lock(Heap);
 
 	file_handle FileHandle;
 	Platform_OpenFile(&FileHandle, "heap_dump.txt", FILE_WRITE);
@@ -609,20 +1993,12 @@ Heap_Dump(heap *Heap)
 			);
 			if (Width < CurrWidth) Width = CurrWidth;
 
-			string NextHandleStr = FStringL(
-				"---Next %s---> %'d",
-				UsageStr,
-				(Handles[I].Free) ? Handles[I].NextFree : Handles[I].NextUsed
-			);
-			string PrevHandleStr = FStringL(
-				"---Prev %s---> %'d",
-				UsageStr,
-				(Handles[I].Free) ? Handles[I].PrevFree : Handles[I].PrevUsed
-			);
-			string NextBlockStr =
-				FStringL("---Next Block--> %'d", Handles[I].NextBlock);
-			string PrevBlockStr =
-				FStringL("---Prev Block--> %'d", Handles[I].PrevBlock);
+			// Free handles use the block links for the free list.
+			string LinkStr = (Handles[I].Free) ? FreeStr : CStringL("Block");
+			string NextLinkStr =
+				FStringL("---Next %s--> %'u", LinkStr, Handles[I].NextBlock);
+			string PrevLinkStr =
+				FStringL("---Prev %s--> %'u", LinkStr, Handles[I].PrevBlock);
 
 			string BorderTop	= FStringL(".-%*s-.", Width, NoneStr);
 			string BorderBottom = FStringL("'-%*s-'", Width, NoneStr);
@@ -643,10 +2019,10 @@ Heap_Dump(heap *Heap)
 				Size,
 				Offset,
 				Flags,
-				NextHandleStr,
-				PrevHandleStr,
-				NextBlockStr,
-				PrevBlockStr,
+				NextLinkStr,
+				PrevLinkStr,
+				NoneStr,
+				NoneStr,
 				BorderBottom
 			);
 		}
@@ -656,7 +2032,18 @@ Heap_Dump(heap *Heap)
 	}
 	Stack_Pop();
 
-	Platform_UnlockMutex(&Heap->Mutex);
+	Heap_Unlock(Heap);
+}
+
+// Commits from Committed through Cursor in whole steps from Base, without
+// going past End, and returns the new end of the committed memory.
+internal u08 *
+Mem_CommitThrough(u08 *Base, u08 *Committed, u08 *Cursor, u08 *End)
+{
+	usize Used	 = (usize) (Cursor - Base);
+	u08	 *Target = MIN(Base + ALIGN_UP(Used, STACK_COMMIT_SIZE), End);
+	Platform_CommitMemory(Committed, (usize) (Target - Committed));
+	return Target;
 }
 
 internal stack *
@@ -668,7 +2055,24 @@ Stack_Init(vptr Mem, usize Size)
 	Result->Size		= Size - sizeof(stack);
 	Result->FirstMarker = NULL;
 	Result->Cursor		= (u08 *) Mem + sizeof(stack);
+	Result->Committed	= (u08 *) Mem + Size;
+	Result->HighWater	= Result->Cursor;
+
+	return Result;
+}
 
+// The guard region is never committed, so writes that run past the end
+// fault instead of landing in whatever's mapped next.
+internal stack *
+Stack_Reserve(usize Size)
+{
+	Size	 = ALIGN_UP(Size, STACK_COMMIT_SIZE);
+	vptr Mem = Platform_ReserveMemory(Size + STACK_GUARD_SIZE);
+	Platform_CommitMemory(Mem, STACK_COMMIT_SIZE);
+
+	stack *Result	  = Stack_Init(Mem, Size);
+	Result->Committed = (u08 *) Mem + STACK_COMMIT_SIZE;
+	Result->Reserved  = TRUE;
 	return Result;
 }
 
@@ -677,10 +2081,9 @@ Stack_Push(void)
 {
 	stack *Stack = Stack_Get();
 
-	vptr *Marker		= (vptr *) Stack->Cursor;
-	*Marker				= Stack->FirstMarker;
-	Stack->FirstMarker	= Marker;
-	Stack->Cursor	   += sizeof(vptr);
+	vptr *Marker	   = Stack_Allocate(sizeof(vptr));
+	*Marker			   = Stack->FirstMarker;
+	Stack->FirstMarker = Marker;
 }
 
 internal vptr
@@ -698,35 +2101,58 @@ Stack_SetCursor(vptr Cursor)
 internal stack *
 Stack_Get(void)
 {
-	util_tls *Tls = Tls_Get(&_G.Tls, NULL);
+	stack *Stack = Platform_GetThreadSlot(THREAD_SLOT_STACK);
 
-	if (!Tls->Stack) {
-		vptr Mem   = Platform_AllocateMemory(_G.StackSize);
-		Tls->Stack = Stack_Init(Mem, _G.StackSize);
+	if (!Stack) {
+		Stack = Stack_Reserve(_G.StackSize);
+		Platform_SetThreadSlot(THREAD_SLOT_STACK, Stack);
 	}
 
-	return Tls->Stack;
+	return Stack;
 }
 
 internal void
 Stack_Set(stack *Stack)
-{
-	util_tls *Tls = Tls_Get(&_G.Tls, NULL);
-	Tls->Stack	  = Stack;
-}
+{ Platform_SetThreadSlot(THREAD_SLOT_STACK, Stack); }
 
 internal vptr
 Stack_Allocate(usize Size)
 {
 	stack *Stack = Stack_Get();
+	u08	  *End	 = (u08 *) (Stack + 1) + Stack->Size;
+
+	// This is checked in release builds too, since a big enough allocation
+	// would jump straight over the guard region.
+	if (Size > (usize) (End - Stack->Cursor))
+		Platform_WriteError(CStringL("Scratch stack overflow\n"), 1);
 
 	vptr Result	   = Stack->Cursor;
 	Stack->Cursor += Size;
-	Assert(Stack->Cursor <= (u08 *) (Stack + 1) + Stack->Size);
+
+	if (Stack->Cursor > Stack->HighWater) {
+		Stack->HighWater = Stack->Cursor;
+
+		if (Stack->Cursor > Stack->Committed)
+			Stack->Committed = Mem_CommitThrough(
+				(u08 *) Stack,
+				Stack->Committed,
+				Stack->Cursor,
+				End
+			);
+	}
 
 	return Result;
 }
 
+// The most this thread's stack has held, which is what the stack size can
+// be cut down to.
+internal usize
+Stack_GetHighWater(void)
+{
+	stack *Stack = Stack_Get();
+	return (usize) (Stack->HighWater - (u08 *) (Stack + 1));
+}
+
 internal void
 Stack_Pop(void)
 {
@@ -736,4 +2162,634 @@ Stack_Pop(void)
 	Stack->FirstMarker = *Stack->FirstMarker;
 }
 
+// Frees the calling thread's stack if Stack_Get reserved it. Threads call
+// this on their way out.
+internal void
+Stack_Release(void)
+{
+	stack *Stack = Platform_GetThreadSlot(THREAD_SLOT_STACK);
+	if (!Stack || !Stack->Reserved) return;
+
+	Platform_FreeMemory(Stack, sizeof(stack) + Stack->Size + STACK_GUARD_SIZE);
+	Platform_SetThreadSlot(THREAD_SLOT_STACK, NULL);
+}
+
+internal arena *
+Arena_Init(vptr Mem, usize Size)
+{
+	Assert(Size > sizeof(arena));
+
+	arena *Arena	 = Mem;
+	*Arena			 = (arena){ 0 };
+	Arena->Cursor	 = (u08 *) (Arena + 1);
+	Arena->Committed = (u08 *) Mem + Size;
+	Arena->End		 = (u08 *) Mem + Size;
+	return Arena;
+}
+
+internal arena *
+Arena_Create(heap *Heap, usize Size)
+{
+	arena *Arena = Arena_Init(Heap_AllocateA(Heap, Size), Size);
+	Arena->Heap	 = Heap;
+	return Arena;
+}
+
+// Only address space is taken up front, and pages are committed as the
+// arena grows into them.
+internal arena *
+Arena_Reserve(usize Size)
+{
+	Size	 = ALIGN_UP(Size, STACK_COMMIT_SIZE);
+	vptr Mem = Platform_ReserveMemory(Size);
+	Platform_CommitMemory(Mem, STACK_COMMIT_SIZE);
+
+	arena *Arena	 = Arena_Init(Mem, Size);
+	Arena->Reserved	 = TRUE;
+	Arena->Committed = (u08 *) Mem + STACK_COMMIT_SIZE;
+	return Arena;
+}
+
+// Allocations are 8 byte aligned, like the heap's. Returns NULL if the arena
+// is full.
+internal vptr
+Arena_Allocate(arena *Arena, usize Size)
+{
+	Assert(Arena);
+
+	u08 *Result = (u08 *) ALIGN_UP((usize) Arena->Cursor, 8);
+	if (Size > (usize) (Arena->End - Result)) return NULL;
+	Arena->Cursor = Result + Size;
+
+	if (Arena->Cursor > Arena->Committed)
+		Arena->Committed = Mem_CommitThrough(
+			(u08 *) Arena,
+			Arena->Committed,
+			Arena->Cursor,
+			Arena->End
+		);
+
+	return Result;
+}
+
+internal arena_checkpoint
+Arena_Save(arena *Arena)
+{ return (arena_checkpoint){ Arena, Arena->Cursor }; }
+
+// Checkpoints have to be restored in the reverse order they were saved.
+internal void
+Arena_Restore(arena_checkpoint Checkpoint)
+{
+	Assert(Checkpoint.Cursor <= Checkpoint.Arena->Cursor);
+	Checkpoint.Arena->Cursor = Checkpoint.Cursor;
+}
+
+// Pages stay committed, so an arena that's reset every frame doesn't keep
+// paying to commit them.
+internal void
+Arena_Reset(arena *Arena)
+{ Arena->Cursor = (u08 *) (Arena + 1); }
+
+// Arenas made with Arena_Init don't own their memory, so there's nothing to
+// free.
+internal void
+Arena_Free(arena *Arena)
+{
+	if (Arena->Heap) Heap_FreeA(Arena);
+	else if (Arena->Reserved)
+		Platform_FreeMemory(Arena, (usize) (Arena->End - (u08 *) Arena));
+}
+
+// Frees a cached heap while another thread still has an entry for it.
+internal s32
+Heap_FreeCachedThread(vptr Param)
+{
+	heap *Heap = Param;
+	u64	  Size = Heap_GetStats(Heap).ReservedSize;
+	Heap_DisableThreadCaches(Heap);
+	Platform_FreeMemory(Heap, Size);
+	return 0;
+}
+
+#ifndef REGION_MEMORY_TESTS
+
+#define MEMORY_TESTS                                                          \
+	TEST(Mem_Cpy, HandlesOverlap, (                                           \
+		u08 *Buffer = Stack_Allocate(16384);                                  \
+		u08 *Expected = Stack_Allocate(16384);                                \
+		for (u32 Size = 0; Size < 12000; Size += (Size < 300) ? 1 : 1031) {   \
+			for (s32 Delta = -70; Delta <= 70; Delta += 7) {                  \
+				u32 Length = Size + 160, Src = 80, Dest = Src + Delta;        \
+				for (u32 I = 0; I < Length; I++)                              \
+					Buffer[I] = Expected[I] = I * 7 + Size;                   \
+				for (u32 I = 0; I < Size; I++)                                \
+					Expected[Dest + I] = Buffer[Src + I];                     \
+				Mem_Cpy(Buffer + Dest, Buffer + Src, Size);                   \
+				for (u32 I = 0; I < Length; I++)                              \
+					Assert(Buffer[I] == Expected[I]);                         \
+			}                                                                 \
+		}                                                                     \
+	))                                                                        \
+	TEST(Mem_Set, StaysInBounds, (                                            \
+		u08 Buffer[400];                                                      \
+		for (u32 Size = 0; Size <= 300; Size++) {                             \
+			for (u32 Offset = 0; Offset < 16; Offset += 5) {                  \
+				for (u32 I = 0; I < 400; I++) Buffer[I] = 0xAA;               \
+				Mem_Set(Buffer + 32 + Offset, Size, Size);                    \
+				for (u32 I = 0; I < 400; I++) {                               \
+					b08 Inside = I >= 32 + Offset && I < 32 + Offset + Size;  \
+					Assert(Buffer[I] == (Inside ? (u08) Size : 0xAA));        \
+				}                                                             \
+			}                                                                 \
+		}                                                                     \
+	))                                                                        \
+	TEST(Mem_Cmp, FindsFirstDifference, (                                     \
+		u08 A[100], B[100];                                                   \
+		for (u32 I = 0; I < 100; I++) A[I] = B[I] = I;                        \
+		Assert(Mem_Cmp(A, B, 100) == EQUAL);                                  \
+		for (u32 I = 0; I < 100; I++) {                                       \
+			B[I] = I + 1;                                                     \
+			Assert(Mem_Cmp(A, B, 100) == LESS);                               \
+			Assert(Mem_Cmp(B, A, 100) == GREATER);                            \
+			Assert(Mem_Cmp(A, B, I) == EQUAL);                                \
+			B[99] = 0;                                                        \
+			Assert(I == 99 || Mem_Cmp(A, B, 100) == LESS);                    \
+			B[I] = I, B[99] = 99;                                             \
+		}                                                                     \
+	))                                                                        \
+	TEST(Mem_Hash, ReadsOnlyItsBytes, (                                       \
+		u08 Buffer[80];                                                       \
+		for (u32 I = 0; I < 80; I++) Buffer[I] = I * 37;                      \
+		for (u32 Size = 0; Size < 72; Size++) {                               \
+			u64 Hash = Mem_Hash(Buffer + 4, Size, 1);                         \
+			Buffer[3]++, Buffer[Size + 4]++;                                  \
+			Assert(Mem_Hash(Buffer + 4, Size, 1) == Hash);                    \
+			Assert(Mem_Hash(Buffer + 4, Size, 2) != Hash);                    \
+		}                                                                     \
+	))                                                                        \
+	TEST(Mem_Hash, Avalanches, (                                              \
+		u08 Buffer[64];                                                       \
+		for (u32 I = 0; I < 64; I++) Buffer[I] = I * 37;                      \
+		u64 Flipped = 0, Trials = 0;                                          \
+		for (u32 Size = 1; Size <= 64; Size++) {                              \
+			u64 Hash = Mem_Hash(Buffer, Size, 1);                             \
+			for (u32 Bit = 0; Bit < Size * 8; Bit++, Trials++) {              \
+				Buffer[Bit / 8] ^= 1 << Bit % 8;                              \
+				u64 Flips  = Hash ^ Mem_Hash(Buffer, Size, 1);                \
+				Flipped	  += Intrin_Popcount64(Flips);                        \
+				Buffer[Bit / 8] ^= 1 << Bit % 8;                              \
+			}                                                                 \
+		}                                                                     \
+		/* Each output bit should flip about half the time */                 \
+		r64 Rate = (r64) Flipped / (Trials * 64);                             \
+		Assert(Rate > 0.49 && Rate < 0.51);                                   \
+	))                                                                        \
+	TEST(Mem_BytesUntil, StopsAtPageEnd, (                                    \
+		/* Only the first page is readable */                                 \
+		u08 *Page = Platform_ReserveMemory(8192);                             \
+		Platform_CommitMemory(Page, 4096);                                    \
+		for (u32 Length = 0; Length < 40; Length++) {                         \
+			u08 *Text = Page + 4096 - Length - 1;                             \
+			Mem_Set(Text, 'a', Length);                                       \
+			Text[Length] = 0;                                                 \
+			Assert(Mem_BytesUntil(Text, 0) == Length);                        \
+			Assert(Mem_FindByte(Text, 0, Length + 1) == Length);              \
+			Assert(Mem_FindByte(Text, 'b', Length) == Length);                \
+			if (Length) Assert(Mem_FindByte(Text, 'a', Length) == 0);         \
+		}                                                                     \
+		Platform_FreeMemory(Page, 8192);                                      \
+	))                                                                        \
+	TEST(Heap_AllocateA, ReusesSlabObjects, (                                 \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u08 *A = Heap_AllocateA(Heap, 24);                                    \
+		u08 *B = Heap_AllocateA(Heap, 24);                                    \
+		Assert(B - A == 32);                                                  \
+		Heap_FreeA(A);                                                        \
+		Assert(Heap_AllocateA(Heap, 20) == A);                                \
+		Assert(((usize) Heap_AllocateA(Heap, 100) & 7) == 0);                 \
+	))                                                                        \
+	TEST(Heap_FreeA, FreesFromUnalignedHeaps, (                               \
+		u32 HeapSize = 64 * 1024;                                             \
+		u08 *Memory = Stack_Allocate(HeapSize + 8);                           \
+		u08 *HeapBase = (u08 *) ALIGN_UP((usize) Memory, 8) + 1;              \
+		heap *Heap = Heap_Init(HeapBase, HeapSize);                           \
+		vptr Data = Heap_AllocateA(Heap, 8192);                               \
+		Assert(Heap_GetStats(Heap).Counters.UsedSize >= 8192);                \
+		Heap_FreeA(Data);                                                     \
+		Assert(Heap_GetStats(Heap).Counters.UsedSize < 8192);                 \
+	))                                                                        \
+	TEST(Heap_FreeA, ReleasesEmptySlabs, (                                    \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		vptr Objects[600];                                                    \
+		for (u32 I = 0; I < 600; I++) Objects[I] = Heap_AllocateA(Heap, 8);   \
+		for (u32 I = 0; I < 600; I++) Heap_FreeA(Objects[I]);                 \
+                                                                              \
+		/* Only one of the three slabs is kept */                             \
+		Assert(Heap->Slabs[0] && !Heap->Slabs[0]->Next);                      \
+		Assert(!Heap->Slabs[0]->UsedCount);                                   \
+	))                                                                        \
+	TEST(Heap_EnableThreadCaches, DropsStaleMagazines, (                      \
+		u32 HeapSize = 64 * 1024;                                             \
+		vptr HeapBase = Stack_Allocate(HeapSize);                             \
+		heap *Heap = Heap_Init(HeapBase, HeapSize);                           \
+		Heap_EnableThreadCaches(Heap);                                        \
+		Heap_FreeA(Heap_AllocateA(Heap, 24));                                 \
+                                                                              \
+		/* The magazine isn't empty, but the new heap has no slabs yet */     \
+		Heap = Heap_Init(HeapBase, HeapSize);                                 \
+		Heap_EnableThreadCaches(Heap);                                        \
+		vptr Data = Heap_AllocateA(Heap, 24);                                 \
+		Assert(Heap->Slabs[Heap_GetSlabClass(32)]);                           \
+		Heap_FreeA(Data);                                                     \
+		Heap_ReleaseThreadCache();                                            \
+	))                                                                        \
+	TEST(Heap_DisableThreadCaches, RecyclesEntries, (                         \
+		/* More dead heaps than a thread has entries */                       \
+		for (u32 I = 0; I < 2 * HEAP_CACHE_HEAP_COUNT; I++) {                 \
+			heap *Heap = Heap_Reserve(64 * 1024);                             \
+			Heap_EnableThreadCaches(Heap);                                    \
+			Heap_FreeA(Heap_AllocateA(Heap, 24));                             \
+			Assert(Heap_GetCacheEntry(Heap));                                 \
+                                                                              \
+			thread_handle Thread;                                             \
+			Platform_CreateThread(&Thread, Heap_FreeCachedThread, Heap);      \
+			Platform_JoinThread(Thread);                                      \
+		}                                                                     \
+                                                                              \
+		/* The entries left behind don't touch their unmapped heaps */        \
+		Heap_ReleaseThreadCache();                                            \
+	))                                                                        \
+	TEST(Heap_ResizeA, MovesBetweenClasses, (                                 \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		u08 *Data = Heap_AllocateA(Heap, 8);                                  \
+		for (u32 I = 0; I < 8; I++) Data[I] = I;                              \
+		Heap_ResizeA((vptr *) &Data, 100);                                    \
+		Heap_ResizeA((vptr *) &Data, 10000);                                  \
+		for (u32 I = 0; I < 8; I++) Assert(Data[I] == I);                     \
+		Assert(Heap_GetHandleA(Data)->Size == 10000 + sizeof(vptr));          \
+		Heap_FreeA(Data);                                                     \
+	))                                                                        \
+	TEST(Heap_GetStats, CountsAllocations, (                                  \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		vptr A = Heap_AllocateA(Heap, 24);                                    \
+		heap_handle *B = Heap_Allocate(Heap, 1000);                           \
+		heap_counters Counters = Heap_GetStats(Heap).Counters;                \
+		Assert(Counters.AllocationCount == 2);                                \
+		Assert(Counters.UsedSize == 32 + 1000);                               \
+		Heap_FreeA(A);                                                        \
+		Heap_Free(B);                                                         \
+		Counters = Heap_GetStats(Heap).Counters;                              \
+		Assert(Counters.FreeCount == 2 && Counters.UsedSize == 0);            \
+		Assert(Counters.PeakUsedSize == 32 + 1000);                           \
+	))                                                                        \
+	TEST(Heap_EnableTimeline, KeepsNewestEvents, (                            \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		Heap_EnableTimeline(Heap, 2);                                         \
+		heap_handle *Handle = Heap_Allocate(Heap, 100);                       \
+		Heap_Resize(Handle, 5000);                                            \
+		Heap_Free(Handle);                                                    \
+		heap_event *Events = Heap->Timeline->Events;                          \
+		Assert(Heap->Timeline->Count == 3);                                   \
+		Assert(Events[1].Type == HEAP_EVENT_RESIZE);                          \
+		Assert(Events[1].Size == 5000);                                       \
+		Assert(Events[0].Type == HEAP_EVENT_FREE);                            \
+		Assert(Events[0].Offset == Events[1].Offset);                         \
+		Heap_EnableTimeline(Heap, 0);                                         \
+	))                                                                        \
+	TEST(Heap_Reserve, CommitsOnDemand, (                                     \
+		heap *Heap = Heap_Reserve(64 * 1024 * 1024);                          \
+		Assert(Heap_GetStats(Heap).CommittedSize == HEAP_COMMIT_SIZE);        \
+		u08 *Data = Heap_AllocateA(Heap, 1024 * 1024);                        \
+		Mem_Set(Data, 0xFF, 1024 * 1024);                                     \
+		heap_stats Stats = Heap_GetStats(Heap);                               \
+		Assert(Stats.ReservedSize == 64 * 1024 * 1024);                       \
+		Assert(Stats.CommittedSize == 1024 * 1024 + 2 * HEAP_COMMIT_SIZE);    \
+		Heap_FreeA(Data);                                                     \
+		Heap_Trim(Heap);                                                      \
+		Assert(Heap_GetStats(Heap).CommittedSize == HEAP_COMMIT_SIZE);        \
+		Platform_FreeMemory(Heap, Stats.ReservedSize);                        \
+	))                                                                        \
+	TEST(Heap_Trim, TracksPagesAfterFullCommit, (                             \
+		u64 Size = 4 * 1024 * 1024;                                           \
+		heap *Heap = Heap_Reserve(Size);                                      \
+		heap_handle **Handles = Stack_Allocate(Size / 64 * sizeof(vptr));     \
+		u32 Count = 0;                                                        \
+		while (Heap_GetStats(Heap).CommittedSize < Size)                      \
+			Handles[Count++] = Heap_Allocate(Heap, 32);                       \
+		u64 Middle = Heap->CommittedLow;                                      \
+                                                                              \
+		/* Free the lowest blocks, then reach below the high part */          \
+		for (u32 I = 0; I < 16384; I++) Heap_Free(Handles[--Count]);          \
+		heap_handle *Block = Heap_Allocate(Heap, 640 * 1024);                 \
+		Assert((u08 *) Block->Data < (u08 *) Heap + Middle);                  \
+                                                                              \
+		heap_handle *Null = Heap->Handles;                                    \
+		u64 GapStart = (u08 *) Null->Data + Null->Size - (u08 *) Heap;        \
+		u64 GapEnd = GapStart + Null->Offset;                                 \
+		u64 Trimmed = (GapEnd & ~(u64) (HEAP_COMMIT_SIZE - 1))                \
+			- ALIGN_UP(GapStart, HEAP_COMMIT_SIZE);                           \
+		Heap_Trim(Heap);                                                      \
+		Assert(Heap_GetStats(Heap).CommittedSize == Size - Trimmed);          \
+                                                                              \
+		/* The trimmed pages are committed again when they're needed */       \
+		Heap_Free(Block);                                                     \
+		Block = Heap_Allocate(Heap, 900 * 1024);                              \
+		Mem_Set(Block->Data, 1, 900 * 1024);                                  \
+		Platform_FreeMemory(Heap, Size);                                      \
+	))                                                                        \
+	TEST(Heap_Allocate, HasNoHandleLimit, (                                   \
+		heap *Heap = Heap_Reserve(64 * 1024 * 1024);                          \
+		u32 Count = 100000;                                                   \
+		heap_handle *Last = NULL;                                             \
+		for (u32 I = 0; I < Count; I++) Last = Heap_Allocate(Heap, 8);        \
+		Assert(Last->Index == Count);                                         \
+		Heap_Free(Heap->Handles + 70000);                                     \
+		Assert(Heap_Allocate(Heap, 8)->Index == 70000);                       \
+		for (u32 I = 1; I <= Count; I++) Heap_Free(Heap->Handles + I);        \
+		Assert(Heap->Handles[0].Size == sizeof(heap_handle));                 \
+		Assert(!Heap->FreeHandles);                                           \
+		Platform_FreeMemory(Heap, Heap_GetStats(Heap).ReservedSize);          \
+	))                                                                        \
+	TEST(Heap_Allocate, DefragmentsWhenFull, (                                \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		heap_handle *Handles[32];                                             \
+		for (u32 I = 0; I < 32; I++) {                                        \
+			Handles[I] = Heap_Allocate(Heap, 1500);                           \
+			Mem_Set(Handles[I]->Data, I, 1500);                               \
+		}                                                                     \
+		for (u32 I = 0; I < 32; I += 2) Heap_Free(Handles[I]);                \
+                                                                              \
+		/* Only fits once the freed blocks are squeezed out */                \
+		Assert(!Heap_FindGap(Heap, 20000));                                   \
+		Assert(Heap_Allocate(Heap, 20000));                                   \
+		for (u32 I = 1; I < 32; I += 2) {                                     \
+			u08 *Data = Handles[I]->Data;                                     \
+			Assert(Data[0] == I && Data[1499] == I);                          \
+		}                                                                     \
+	))                                                                        \
+	TEST(Heap_Resize, KeepsDataWhenOnlyItsSpaceFits, (                        \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		heap_handle *Block = Heap_Allocate(Heap, 1000);                       \
+		heap_handle *Below = Heap_Allocate(Heap, 1000);                       \
+		u32 FillSize = Heap->Handles[0].Offset - sizeof(heap_handle) - 500;   \
+		heap_handle *Fill = Heap_Allocate(Heap, FillSize);                    \
+		Mem_Set(Block->Data, 1, 1000);                                        \
+		Mem_Set(Below->Data, 2, 1000);                                        \
+		Mem_Set(Fill->Data, 3, FillSize);                                     \
+                                                                              \
+		/* Needs the block's own space and the gap under the others */        \
+		Heap_Resize(Block, 1400);                                             \
+		u08 *Data = Block->Data;                                              \
+		Assert(Data[0] == 1 && Data[999] == 1);                               \
+		Data = Below->Data;                                                   \
+		Assert(Data[0] == 2 && Data[999] == 2);                               \
+		Data = Fill->Data;                                                    \
+		Assert(Data[0] == 3 && Data[FillSize - 1] == 3);                      \
+	))                                                                        \
+	TEST(Heap_DefragmentStep, ResumesWhereItLeftOff, (                        \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		heap_handle *Handles[32];                                             \
+		for (u32 I = 0; I < 32; I++) {                                        \
+			Handles[I] = Heap_Allocate(Heap, 1500);                           \
+			Mem_Set(Handles[I]->Data, I, 1500);                               \
+		}                                                                     \
+		for (u32 I = 0; I < 32; I += 2) Heap_Free(Handles[I]);                \
+		u64 FreeSize = Heap->Handles[0].Offset + 16 * 1500;                   \
+                                                                              \
+		u32 StepCount = 1;                                                    \
+		while (!Heap_DefragmentStep(Heap, 1e-12)) {                           \
+			if (StepCount++ == 4) Heap_Free(Handles[9]);                      \
+		}                                                                     \
+		Assert(StepCount > 4);                                                \
+		Heap_Defragment(Heap);                                                \
+		Assert(Heap->Handles[0].Offset == FreeSize + 1500);                   \
+		for (u32 I = 1; I < 32; I += 2) {                                     \
+			if (I == 9) continue;                                             \
+			u08 *Data = Handles[I]->Data;                                     \
+			Assert(Data[0] == I && Data[1499] == I);                          \
+		}                                                                     \
+	))                                                                        \
+	TEST(Stack_Allocate, CommitsAsItGrows, (                                  \
+		stack *Previous = Stack_Get();                                        \
+		stack *Stack = Stack_Reserve(1024 * 1024);                            \
+		Stack_Set(Stack);                                                     \
+		Assert(Stack_GetHighWater() == 0);                                    \
+		Assert(Stack->Committed == (u08 *) Stack + STACK_COMMIT_SIZE);        \
+                                                                              \
+		Stack_Push();                                                         \
+		Mem_Set(Stack_Allocate(200000), 1, 200000);                           \
+		Stack_Pop();                                                          \
+		Assert(Stack_GetHighWater() == 200000 + sizeof(vptr));                \
+		Assert(Stack->Committed == (u08 *) Stack + 4 * STACK_COMMIT_SIZE);    \
+                                                                              \
+		Stack_Set(Previous);                                                  \
+		Platform_FreeMemory(Stack, 1024 * 1024 + STACK_GUARD_SIZE);           \
+	))                                                                        \
+	TEST(Stack_Release, FreesOnlyReservedStacks, (                            \
+		stack *Previous = Stack_Get();                                        \
+		Stack_Set(NULL);                                                      \
+		Stack_Allocate(16);                                                   \
+		Assert(Stack_Get()->Reserved);                                        \
+		Stack_Release();                                                      \
+		Assert(!Platform_GetThreadSlot(THREAD_SLOT_STACK));                   \
+                                                                              \
+		u08 Mem[1024];                                                        \
+		stack *Stack = Stack_Init(Mem, sizeof(Mem));                          \
+		Stack_Set(Stack);                                                     \
+		Stack_Release();                                                      \
+		Assert(Stack_Get() == Stack);                                         \
+		Stack_Set(Previous);                                                  \
+	))                                                                        \
+	TEST(Arena_Allocate, RestoresCheckpoints, (                               \
+		arena *Arena = Arena_Reserve(1024 * 1024);                            \
+		u08   *A = Arena_Allocate(Arena, 3);                                  \
+		u08   *B = Arena_Allocate(Arena, 8);                                  \
+		Assert(B - A == 8);                                                   \
+                                                                              \
+		arena_checkpoint Checkpoint = Arena_Save(Arena);                      \
+		u08 *C = Arena_Allocate(Arena, 200000);                               \
+		Mem_Set(C, 1, 200000);                                                \
+		Arena_Restore(Checkpoint);                                            \
+		Assert(Arena_Allocate(Arena, 8) == C);                                \
+		Assert(!Arena_Allocate(Arena, 1024 * 1024));                          \
+                                                                              \
+		Arena_Reset(Arena);                                                   \
+		Assert(Arena_Allocate(Arena, 3) == A);                                \
+		Arena_Free(Arena);                                                    \
+	))                                                                        \
+	//
+
+#endif
+
+
+#define HEAP_CHURN_COUNT 200000
+
+// Frees and replaces random objects from a small working set, for measuring
+// how the heap holds up when many threads share it.
+internal s32
+Heap_ChurnThread(vptr Param)
+{
+	heap *Heap = Param;
+	vptr  Objects[256];
+	u32	  Seed = Platform_GetThreadId(NULL) | 1;
+
+	for (u32 I = 0; I < 256; I++) Objects[I] = Heap_AllocateA(Heap, 8 + I);
+	for (u32 I = 0; I < HEAP_CHURN_COUNT; I++) {
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+
+		u32 Index = Seed % 256;
+		Heap_FreeA(Objects[Index]);
+		Objects[Index] = Heap_AllocateA(Heap, 8 + (Seed >> 8) % 256);
+	}
+	for (u32 I = 0; I < 256; I++) Heap_FreeA(Objects[I]);
+
+	Heap_ReleaseThreadCache();
+	return 0;
+}
+
+#ifndef REGION_MEMORY_BENCHMARKS
+
+#define MEMORY_BENCHMARKS                                                     \
+	BENCH(Mem_Cpy, Sizes, (                                                   \
+		usize MaxSize = 64 * 1024 * 1024;                                     \
+		u08  *A = Platform_AllocateMemory(MaxSize + 64);                      \
+		u08  *B = Platform_AllocateMemory(MaxSize + 64);                      \
+		Mem_Set(A, 1, MaxSize + 64);                                          \
+		Mem_Set(B, 1, MaxSize + 64);                                          \
+		for (usize Size = 1; Size <= MaxSize; Size *= 4) {                    \
+			usize Repeats = MAX(256 * 1024 * 1024 / Size, 4);                 \
+			r64	  Rates[3];                                                   \
+			volatile s32 Result;                                              \
+			for (u32 Op = 0; Op < 3; Op++) {                                  \
+				if (Op == 2) Mem_Cpy(A + 3, B + 3, Size);                     \
+				timestamp Start = Platform_GetTimestamp();                    \
+				for (usize I = 0; I < Repeats; I++) {                         \
+					/* Misaligned, so the setup paths are measured too */     \
+					if (Op == 0) Mem_Cpy(A + 3, B + (I & 31), Size);          \
+					else if (Op == 1) Mem_Set(A + 3, I, Size);                \
+					else Result = Mem_Cmp(A + 3, B + 3, Size);                \
+				}                                                             \
+				r64 Time =                                                    \
+					Platform_GetSecondsElapsed(Start, Platform_GetTimestamp());\
+				Rates[Op] = (r64) Size * Repeats / Time / 1e9;                \
+			}                                                                 \
+			Printf(                                                           \
+				"%u bytes: copy %.2f, set %.2f, compare %.2f GB/s\n",         \
+				(u32) Size,                                                   \
+				Rates[0],                                                     \
+				Rates[1],                                                     \
+				Rates[2]                                                      \
+			);                                                                \
+		}                                                                     \
+		Platform_FreeMemory(A, MaxSize + 64);                                 \
+		Platform_FreeMemory(B, MaxSize + 64);                                 \
+	))                                                                        \
+	BENCH(Mem_Hash, KeySets, (                                                \
+		u32	   Count	 = 4096, Slots = 8192, Repeats = 256;                 \
+		string Names[]	 = { CStringL("util"), CStringL("platform"),          \
+							 CStringL("base"), CStringL("loader") };          \
+		string EnvKeys[] = { CStringL("PATH"), CStringL("XDG_RUNTIME_DIR"),   \
+							 CStringL("WAYLAND_DISPLAY"), CStringL("LANG") }; \
+		string *Sets[4];                                                      \
+		u32	   *Ids = Stack_Allocate(2 * Count * sizeof(u32));                \
+		for (u32 S = 0; S < 4; S++)                                           \
+			Sets[S] = Stack_Allocate(Count * sizeof(string));                 \
+		for (u32 I = 0; I < Count; I++) {                                     \
+			Sets[0][I] = FStringL("%s%u", Names[I % 4], I / 4);               \
+			Sets[1][I] = FStringL("%s_%u", EnvKeys[I % 4], I / 4);            \
+			/* Thread ids are handed out in order, and so are wayland ids, */ \
+			/* with the server's starting at 0xFF000000 */                    \
+			Ids[I]		   = 80000 + I;                                       \
+			Ids[Count + I] = I % 2 ? 0xFF000000 + I / 2 : 1 + I / 2;          \
+			Sets[2][I]	   = (string){ .Length = 4 };                         \
+			Sets[2][I].Text = (c08 *) (Ids + I);                              \
+			Sets[3][I]	   = Sets[2][I];                                      \
+			Sets[3][I].Text = (c08 *) (Ids + Count + I);                      \
+		}                                                                     \
+		/* The collisions a uniform hash would give */                        \
+		r64 Empty = 1;                                                        \
+		for (u32 I = 0; I < Count; I++) Empty *= 1 - 1.0 / Slots;             \
+		r64	 Expected = Count - Slots * (1 - Empty);                          \
+		c08 *SetNames[] = { "module names", "env keys", "thread ids",         \
+							"wayland ids" };                                  \
+		u08 *Table	= Stack_Allocate(Slots);                                  \
+		u64 *Hashes = Stack_Allocate(Count * sizeof(u64));                    \
+		u64	 Seed	= Mem_GetHashSeed();                                      \
+		for (u32 S = 0; S < 4; S++) {                                         \
+			for (u32 H = 0; H < 2; H++) {                                     \
+				timestamp Start = Platform_GetTimestamp();                    \
+				for (u32 R = 0; R < Repeats; R++) {                           \
+					for (u32 I = 0; I < Count; I++) {                         \
+						u08	 *Text = (u08 *) Sets[S][I].Text;                 \
+						usize Size = Sets[S][I].Length;                       \
+						if (H) Hashes[I] = Mem_Hash(Text, Size, Seed);        \
+						else {                                                \
+							/* The old byte at a time DJB2, for comparison */ \
+							u32 Old = 5381;                                   \
+							for (usize C = 0; C < Size; C++)                  \
+								Old = (Old << 5) + Old + Text[C];             \
+							Hashes[I] = Old;                                  \
+						}                                                     \
+					}                                                         \
+				}                                                             \
+				timestamp End  = Platform_GetTimestamp();                     \
+				r64		  Time = Platform_GetSecondsElapsed(Start, End);      \
+				u32 Collisions = 0;                                           \
+				Mem_Set(Table, 0, Slots);                                     \
+				for (u32 I = 0; I < Count; I++)                               \
+					Collisions += Table[Hashes[I] & (Slots - 1)]++ != 0;      \
+				Printf(                                                       \
+					"%s, %s: %.2f ns per key, %u collisions (uniform %.1f)\n", \
+					CString(SetNames[S]),                                     \
+					CString(H ? "Mem_Hash" : "DJB2"),                         \
+					Time * 1e9 / ((r64) Repeats * Count),                     \
+					Collisions,                                               \
+					Expected                                                  \
+				);                                                            \
+			}                                                                 \
+		}                                                                     \
+	))                                                                        \
+	BENCH(Heap_AllocateA, ThreadContention, (                                 \
+		usize HeapSize = 256 * 1024 * 1024;                                   \
+		vptr  HeapBase = Platform_AllocateMemory(HeapSize);                   \
+		for (u32 Cached = 0; Cached < 2; Cached++) {                          \
+			for (u32 ThreadCount = 1; ThreadCount <= 32; ThreadCount *= 2) {  \
+				heap *Heap = Heap_Init(HeapBase, HeapSize);                   \
+				if (Cached) Heap_EnableThreadCaches(Heap);                    \
+                                                                              \
+				thread_handle Threads[32];                                    \
+				timestamp	  Start = Platform_GetTimestamp();                \
+				for (u32 I = 0; I < ThreadCount; I++)                         \
+					Platform_CreateThread(Threads + I, Heap_ChurnThread, Heap);\
+				for (u32 I = 0; I < ThreadCount; I++)                         \
+					Platform_JoinThread(Threads[I]);                          \
+				r64 Time =                                                    \
+					Platform_GetSecondsElapsed(Start, Platform_GetTimestamp());\
+				Heap_DisableThreadCaches(Heap);                               \
+                                                                              \
+				r64 Pairs = (r64) ThreadCount * HEAP_CHURN_COUNT;             \
+				Printf(                                                       \
+					"%s, %u threads: %.1f million pairs per second\n",        \
+					Cached ? CStringL("Cached") : CStringL("Locked"),         \
+					ThreadCount,                                              \
+					Pairs / Time / 1000000                                    \
+				);                                                            \
+			}                                                                 \
+		}                                                                     \
+		Platform_FreeMemory(HeapBase, HeapSize);                              \
+	))                                                                        \
+	//
+
+#endif
+
 #endif
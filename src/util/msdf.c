@@ -45,8 +45,17 @@ typedef struct msdf_shape {
 	v4s16 Bounds;
 } msdf_shape;
 
+// One glyph in a batch for MSDF_DrawAtlas. Like with MSDF_DrawShape, the slot
+// includes a one pixel border, and is shrunk to exclude it once drawn.
+typedef struct msdf_atlas_slot {
+	msdf_shape Shape;
+	v2u32	   Pos;
+	v2u32	   Size;
+} msdf_atlas_slot;
+
 #define MSDF_FUNCS \
-    EXPORT(void, MSDF_DrawShape, msdf_shape Shape, v2u32 *_SlotPos, v2u32 *_SlotSize, v4u08 *Bitmap, v2u32 BitmapOffset, u32 BitmapIndex, v2u32 BitmapSize)
+    EXPORT(void, MSDF_DrawShape, msdf_shape Shape, v2u32 *_SlotPos, v2u32 *_SlotSize, v4u08 *Bitmap, v2u32 BitmapOffset, u32 BitmapIndex, v2u32 BitmapSize) \
+    EXPORT(void, MSDF_DrawAtlas, msdf_atlas_slot *Slots, u32 SlotCount, v4u08 *Bitmap, v2u32 BitmapSize)
 
 #endif
 
@@ -236,6 +245,372 @@ MSDF_SignedPseudoDistance(v2r32 P, msdf_segment Segment)
 	return MinDist;
 }
 
+// The shape's segments as a structure of arrays, in the order that the edges
+// visit them, with the terms that only depend on the segment worked out up
+// front. D is P2-P1 for lines and C1-P1 for curves, and E is P2-2*C1+P1. For
+// lines, A is the squared length, and for curves, A, B, and C are the cubic's
+// coefficients without the terms that depend on the pixel.
+typedef struct msdf_segment_soa {
+	r32			 *P1X;
+	r32			 *P1Y;
+	r32			 *DX;
+	r32			 *DY;
+	r32			 *EX;
+	r32			 *EY;
+	r32			 *DirX;
+	r32			 *DirY;
+	r32			 *A;
+	r32			 *B;
+	r32			 *C;
+	v4r32		 *Bounds;
+	u08			 *CPCount;
+	msdf_segment *Segments;
+	u32			  Count;
+} msdf_segment_soa;
+
+// The closest distance so far for each of four pixels.
+typedef struct msdf_dist4 {
+	r32x4 Distance;
+	r32x4 Orthogonality;
+} msdf_dist4;
+
+internal msdf_segment_soa
+MSDF_InitSegments(msdf_shape Shape)
+{
+	msdf_segment_soa Soa = { 0 };
+	for (u32 C = 0; C < Shape.ContourCount; C++)
+		for (u32 E = 0; E < Shape.Contours[C].EdgeCount; E++)
+			Soa.Count += Shape.Contours[C].Edges[E].SegmentCount;
+
+	r32 *Floats	 = Stack_Allocate(11 * Soa.Count * sizeof(r32));
+	Soa.P1X		 = Floats + 0 * Soa.Count;
+	Soa.P1Y		 = Floats + 1 * Soa.Count;
+	Soa.DX		 = Floats + 2 * Soa.Count;
+	Soa.DY		 = Floats + 3 * Soa.Count;
+	Soa.EX		 = Floats + 4 * Soa.Count;
+	Soa.EY		 = Floats + 5 * Soa.Count;
+	Soa.DirX	 = Floats + 6 * Soa.Count;
+	Soa.DirY	 = Floats + 7 * Soa.Count;
+	Soa.A		 = Floats + 8 * Soa.Count;
+	Soa.B		 = Floats + 9 * Soa.Count;
+	Soa.C		 = Floats + 10 * Soa.Count;
+	Soa.Bounds	 = Stack_Allocate(Soa.Count * sizeof(v4r32));
+	Soa.CPCount	 = Stack_Allocate(Soa.Count);
+	Soa.Segments = Stack_Allocate(Soa.Count * sizeof(msdf_segment));
+
+	u32 I = 0;
+	for (u32 C = 0; C < Shape.ContourCount; C++) {
+		msdf_contour Contour = Shape.Contours[C];
+		for (u32 E = 0; E < Contour.EdgeCount; E++) {
+			msdf_edge Edge = Contour.Edges[E];
+			for (u32 S = 0; S < Edge.SegmentCount; S++, I++) {
+				msdf_segment Segment = Edge.Segments[S];
+				v2r32		 P1		 = Segment.P1;
+				v2r32		 P2		 = Segment.P2;
+				v2r32		 C1		 = Segment.C1;
+
+				Soa.Segments[I] = Segment;
+				Soa.CPCount[I]	= Segment.CPCount;
+				Soa.P1X[I]		= P1.X;
+				Soa.P1Y[I]		= P1.Y;
+
+				// Curves stay inside the hull of their points, so nothing on
+				// the segment is outside this box.
+				v2r32 Min = { MIN(P1.X, P2.X), MIN(P1.Y, P2.Y) };
+				v2r32 Max = { MAX(P1.X, P2.X), MAX(P1.Y, P2.Y) };
+				if (Segment.CPCount) {
+					Min = (v2r32){ MIN(Min.X, C1.X), MIN(Min.Y, C1.Y) };
+					Max = (v2r32){ MAX(Max.X, C1.X), MAX(Max.Y, C1.Y) };
+				}
+				Soa.Bounds[I] = (v4r32){ Min.X, Min.Y, Max.X, Max.Y };
+
+				if (Segment.CPCount == 0) {
+					v2r32 D		= V2r32_Sub(P2, P1);
+					v2r32 Dir	= V2r32_Norm(D);
+					Soa.DX[I]	= D.X;
+					Soa.DY[I]	= D.Y;
+					Soa.DirX[I] = Dir.X;
+					Soa.DirY[I] = Dir.Y;
+					Soa.A[I]	= V2r32_Dot(D, D);
+				} else {
+					v2r32 D	  = V2r32_Sub(C1, P1);
+					v2r32 E	  = V2r32_Add(V2r32_Sub(P2, V2r32_MulS(C1, 2)), P1);
+					Soa.DX[I] = D.X;
+					Soa.DY[I] = D.Y;
+					Soa.EX[I] = E.X;
+					Soa.EY[I] = E.Y;
+					Soa.A[I]  = V2r32_Dot(E, E);
+					Soa.B[I]  = 3 * V2r32_Dot(D, E);
+					Soa.C[I]  = 2 * V2r32_Dot(D, D);
+				}
+			}
+		}
+	}
+
+	return Soa;
+}
+
+internal r32x4
+MSDF_Select4(s32x4 Mask, r32x4 A, r32x4 B)
+{ return (r32x4) (((s32x4) A & Mask) | ((s32x4) B & ~Mask)); }
+
+internal b08
+MSDF_Any4(s32x4 Mask)
+{ return Intrin_MoveMask_R32x4((r32x4) Mask) != 0; }
+
+internal r32x4
+MSDF_Abs4(r32x4 N)
+{ return (r32x4) ((s32x4) N & 0x7FFFFFFF); }
+
+internal r32
+MSDF_MaxAbs4(r32x4 N)
+{
+	N = MSDF_Abs4(N);
+	return MAX(MAX(N[0], N[1]), MAX(N[2], N[3]));
+}
+
+// A lower bound on the distance from anything in a box to any point from Min
+// to Max. It's shrunk a little, so rounding in the distance kernel can't put
+// something closer than its bound.
+internal r32
+MSDF_BoxDistance(v4r32 Box, v2r32 Min, v2r32 Max)
+{
+	r32 DX = MAX(0, MAX(Box.X - Max.X, Min.X - Box.Z));
+	r32 DY = MAX(0, MAX(Box.Y - Max.Y, Min.Y - Box.W));
+	return R32_sqrt(DX * DX + DY * DY) * 0.999f;
+}
+
+internal r32x4
+MSDF_Sign4(r32x4 N)
+{ return (r32x4) (((s32x4) N & (s32) 0x80000000) | 0x3F800000); }
+
+// The same as R32_cbrt, for each lane.
+internal r32x4
+MSDF_Cbrt4(r32x4 N)
+{
+	s32x4 Binary   = (s32x4) N;
+	s32x4 Exponent = ((Binary & R32_EXPONENT_MASK) >> 23) - 127;
+	Exponent	   = Exponent / 3 + 127;
+	Binary		   = (Binary & ~R32_EXPONENT_MASK) | (Exponent << 23);
+	r32x4 X		   = (r32x4) Binary;
+	for (u32 I = 0; I < R32_CBRT_ITERATIONS; I++) X = (N / (X * X) + 2 * X) / 3;
+	return X;
+}
+
+// Equivalent to MSDF_Cmp(A, B) == LESS, for each lane.
+internal s32x4
+MSDF_Less4(msdf_dist4 A, msdf_dist4 B)
+{
+	r32x4 ADist = MSDF_Abs4(A.Distance);
+	r32x4 BDist = MSDF_Abs4(B.Distance);
+	return (ADist < BDist)
+		 | ((ADist == BDist) & (A.Orthogonality > B.Orthogonality));
+}
+
+// Equivalent to MSDF_Cmp(A, B) == EQUAL, for each lane.
+internal s32x4
+MSDF_Equal4(msdf_dist4 A, msdf_dist4 B)
+{
+	r32x4 ADist = MSDF_Abs4(A.Distance);
+	r32x4 BDist = MSDF_Abs4(B.Distance);
+	return (ADist == BDist) & (A.Orthogonality == B.Orthogonality);
+}
+
+// R32_SolveCubic across four pixels. All four share the leading coefficients,
+// since those only depend on the segment, so the degenerate case is uniform.
+// Returns the most roots any lane has, with Valid marking which lanes have
+// each one.
+internal u32
+MSDF_SolveCubic4(r32 C3, r32 C2, r32x4 C1, r32x4 C0, r32x4 *Roots, s32x4 *Valid)
+{
+	Roots[0] = Roots[1] = Roots[2] = (r32x4){ 0 };
+	Valid[0] = Valid[1] = Valid[2] = (s32x4){ 0 };
+
+	// Flat curves are rare enough that the lanes can go one at a time.
+	if (C3 == 0) {
+		u32 MaxCount = 0;
+		for (u32 L = 0; L < 4; L++) {
+			r32 LaneRoots[2] = { 0 };
+			u32 Count		 = R32_SolveQuadratic(C2, C1[L], C0[L], LaneRoots);
+			for (u32 R = 0; R < Count; R++) {
+				Roots[R][L] = LaneRoots[R];
+				Valid[R][L] = -1;
+			}
+			MaxCount = MAX(MaxCount, Count);
+		}
+		return MaxCount;
+	}
+
+	C0 /= C3;
+	C1 /= C3;
+	C2 /= C3;
+
+	r32	  C2C2 = C2 * C2;
+	r32x4 Q	   = (3 * C1 - C2C2) / 9;
+	r32x4 R	   = (9 * C2 * C1 - 27 * C0 - 2 * C2C2 * C2) / 54;
+	r32x4 QQQ  = Q * Q * Q;
+	r32x4 D	   = QQQ + R * R;
+	r32	  C2d3 = C2 / 3;
+
+	s32x4 Positive = D > 0;
+	s32x4 Zero	   = D == 0;
+	s32x4 Negative = D < 0;
+	u32	  Count	   = 1;
+	Valid[0]	   = Positive | Zero | Negative;
+
+	if (MSDF_Any4(Positive)) {
+		r32x4 sqrtD = Intrin_Sqrt_R32x4(D);
+		r32x4 S		= MSDF_Cbrt4(R + sqrtD);
+		r32x4 T		= MSDF_Cbrt4(R - sqrtD);
+		Roots[0]	= MSDF_Select4(Positive, S + T - C2d3, Roots[0]);
+	}
+
+	if (MSDF_Any4(Zero)) {
+		r32x4 SpT = 2 * MSDF_Cbrt4(R);
+		Roots[0]  = MSDF_Select4(Zero, SpT - C2d3, Roots[0]);
+		Roots[1]  = MSDF_Select4(Zero, -SpT / 2 - C2d3, Roots[1]);
+		Valid[1] |= Zero & (SpT != 0);
+		Count	  = 2;
+	}
+
+	// The trig functions are table lookups, so they're done lane by lane.
+	if (MSDF_Any4(Negative)) {
+		r32x4 Ratio	   = R / Intrin_Sqrt_R32x4(-QQQ);
+		r32x4 sqrtnQt2 = 2 * Intrin_Sqrt_R32x4(-Q);
+		r32x4 Cos[3]   = { 0 };
+		for (u32 L = 0; L < 4; L++) {
+			if (!Negative[L]) continue;
+			r32 Theta = R32_arccos(Ratio[L]);
+			Cos[0][L] = R32_cos(Theta / 3);
+			Cos[1][L] = R32_cos((Theta + 2 * R32_PI) / 3);
+			Cos[2][L] = R32_cos((Theta + 4 * R32_PI) / 3);
+		}
+		for (u32 I = 0; I < 3; I++)
+			Roots[I] =
+				MSDF_Select4(Negative, sqrtnQt2 * Cos[I] - C2d3, Roots[I]);
+		Valid[1] |= Negative;
+		Valid[2]  = Negative;
+		Count	  = 3;
+	}
+
+	return Count;
+}
+
+// MSDF_SegmentDistances for four pixels at once.
+internal u32
+MSDF_SegmentDistances4(
+	msdf_segment_soa *Soa,
+	u32				  I,
+	r32x4			  PX,
+	r32x4			  PY,
+	r32x4			 *ts,
+	s32x4			 *Valid
+)
+{
+	r32x4 pX = PX - Soa->P1X[I];
+	r32x4 pY = PY - Soa->P1Y[I];
+
+	if (Soa->CPCount[I] == 0) {
+		ts[0]	 = (pX * Soa->DX[I] + pY * Soa->DY[I]) / Soa->A[I];
+		Valid[0] = (s32x4){ -1, -1, -1, -1 };
+		return 1;
+	}
+
+	r32x4 C = Soa->C[I] - (Soa->EX[I] * pX + Soa->EY[I] * pY);
+	r32x4 D = -(Soa->DX[I] * pX + Soa->DY[I] * pY);
+	return MSDF_SolveCubic4(Soa->A[I], Soa->B[I], C, D, ts, Valid);
+}
+
+// Checks the point at t on segment I against the closest one so far, like the
+// body of the loop in MSDF_EdgeSignedDistance.
+internal void
+MSDF_CheckCandidate4(
+	msdf_segment_soa *Soa,
+	u32				  I,
+	r32x4			  PX,
+	r32x4			  PY,
+	r32x4			  t,
+	s32x4			  Valid,
+	msdf_dist4		 *MinDist,
+	s32x4			 *SegmentOut
+)
+{
+	Valid &= (t >= 0) & (t <= 1);
+	if (!MSDF_Any4(Valid)) return;
+
+	r32x4 PointX, PointY, DirX, DirY;
+	if (Soa->CPCount[I] == 0) {
+		PointX = Soa->P1X[I] + Soa->DX[I] * t;
+		PointY = Soa->P1Y[I] + Soa->DY[I] * t;
+		DirX   = Soa->DirX[I] + (r32x4){ 0 };
+		DirY   = Soa->DirY[I] + (r32x4){ 0 };
+	} else {
+		r32x4 tt2 = 2 * t;
+		PointX	  = (Soa->P1X[I] + Soa->DX[I] * tt2) + Soa->EX[I] * (t * t);
+		PointY	  = (Soa->P1Y[I] + Soa->DY[I] * tt2) + Soa->EY[I] * (t * t);
+		DirX	  = Soa->EX[I] * tt2 + Soa->DX[I] * 2;
+		DirY	  = Soa->EY[I] * tt2 + Soa->DY[I] * 2;
+		r32x4 Len = Intrin_Sqrt_R32x4(DirX * DirX + DirY * DirY);
+		DirX	 /= Len;
+		DirY	 /= Len;
+	}
+
+	r32x4 DistX = PX - PointX;
+	r32x4 DistY = PY - PointY;
+	r32x4 Dist	= Intrin_Sqrt_R32x4(DistX * DistX + DistY * DistY);
+	r32x4 Ortho = MSDF_Abs4(DirX * (DistY / Dist) - DirY * (DistX / Dist));
+	r32x4 Sign	= DirX * (PointY - PY) - DirY * (PointX - PX);
+	Dist	   *= MSDF_Sign4(Sign);
+
+	msdf_dist4 NewDist = { Dist, Ortho };
+	s32x4	   Less	   = MSDF_Less4(NewDist, *MinDist) & Valid;
+	MinDist->Distance  = MSDF_Select4(Less, Dist, MinDist->Distance);
+	MinDist->Orthogonality =
+		MSDF_Select4(Less, Ortho, MinDist->Orthogonality);
+	*SegmentOut = ((s32) I & Less) | (*SegmentOut & ~Less);
+}
+
+// MSDF_EdgeSignedDistance for four pixels at once, where the edge's segments
+// are the Count starting at First. The segments come back as indices. The
+// pixels are between Min and Max, and segments that are farther than Limit
+// from all of them are skipped, since they can't be the closest.
+internal msdf_dist4
+MSDF_EdgeSignedDistance4(
+	r32x4			  PX,
+	r32x4			  PY,
+	v2r32			  Min,
+	v2r32			  Max,
+	r32				  Limit,
+	msdf_segment_soa *Soa,
+	u32				  First,
+	u32				  Count,
+	s32x4			 *SegmentOut
+)
+{
+	msdf_dist4 MinDist = { R32_MAX + (r32x4){ 0 }, (r32x4){ 0 } };
+	s32x4	   All	   = { -1, -1, -1, -1 };
+	*SegmentOut		   = (s32) First + (s32x4){ 0 };
+
+	for (u32 I = First; I < First + Count; I++) {
+		Limit = MIN(Limit, MSDF_MaxAbs4(MinDist.Distance));
+		if (MSDF_BoxDistance(Soa->Bounds[I], Min, Max) > Limit) continue;
+
+		r32x4 ts[3];
+		s32x4 Valid[3];
+		u32	  RootCount = MSDF_SegmentDistances4(Soa, I, PX, PY, ts, Valid);
+
+		r32x4 Zero = { 0 }, One = Zero + 1;
+		MSDF_CheckCandidate4(Soa, I, PX, PY, Zero, All, &MinDist, SegmentOut);
+		MSDF_CheckCandidate4(Soa, I, PX, PY, One, All, &MinDist, SegmentOut);
+		for (u32 R = 0; R < RootCount; R++) {
+			s32x4 V = Valid[R];
+			MSDF_CheckCandidate4(Soa, I, PX, PY, ts[R], V, &MinDist, SegmentOut);
+		}
+	}
+
+	return MinDist;
+}
+
 internal v4u08
 MSDF_DistanceColor(v4r32 Dists, r32 Range)
 {
@@ -330,114 +705,580 @@ MSDF_FixErrors(u08 *ErrorMap, v4r32 *FloatMap, v2u32 Size)
 	}
 }
 
-internal void
-MSDF_DrawShape(
-	msdf_shape Shape,
-	v2u32	  *_SlotPos,
-	v2u32	  *_SlotSize,
-	v4u08	  *Bitmap,
-	v2u32	   BitmapOffset,
-	u32		   BitmapIndex,
-	v2u32	   BitmapSize
-)
+// An edge's run of segments in the structure of arrays, along with a box
+// around all of them.
+typedef struct msdf_grid_edge {
+	v4r32 Bounds;
+	u32	  First;
+	u32	  Count;
+	u08	  Color;
+} msdf_grid_edge;
+
+// An edge along with a lower bound on its distance from a cell.
+typedef struct msdf_cell_edge {
+	r32 Bound;
+	u32 Edge;
+} msdf_cell_edge;
+
+// The state for rasterizing one shape, shared between the jobs that each
+// compute a band of its rows. Unless UseGrid is cleared, the slot is split
+// into a uniform grid of cells, and each cell visits the edges nearest first
+// so it can stop once none of the rest could be closer.
+typedef struct msdf_raster {
+	msdf_shape		 Shape;
+	msdf_segment_soa Segments;
+	msdf_grid_edge	*Edges;
+	u32				 EdgeCount;
+	b08				 UseGrid;
+	v2u32			 SlotSize;
+	v2r32			 Offset;
+	v2r32			 Scale;
+	r32				 Range;
+	v4r32			*FloatMap;
+} msdf_raster;
+
+typedef struct msdf_band_job {
+	msdf_raster *Raster;
+	u32			 StartY;
+	u32			 EndY;
+} msdf_band_job;
+
+typedef struct msdf_glyph_job {
+	msdf_atlas_slot *Slot;
+	v4u08			*Bitmap;
+	v2u32			 BitmapSize;
+} msdf_glyph_job;
+
+// Glyphs with more pixels than this get split into bands of rows.
+#define MSDF_BAND_MIN_PIXELS 4096
+#define MSDF_BAND_HEIGHT	 16
+
+// The width and height of a grid cell, in pixels. This has to be a multiple
+// of four so that cells are made of whole groups of pixels.
+#define MSDF_CELL_SIZE 8
+
+internal msdf_grid_edge *
+MSDF_InitEdges(msdf_shape Shape, msdf_segment_soa *Soa, u32 *EdgeCountOut)
 {
-	/* TODO Possible things to add
-	   - Short edge merging
-	*/
+	u32 EdgeCount = 0;
+	for (u32 C = 0; C < Shape.ContourCount; C++)
+		EdgeCount += Shape.Contours[C].EdgeCount;
 
-	v2u32 SlotSize	= *_SlotSize;
+	msdf_grid_edge *Edges = Stack_Allocate(EdgeCount * sizeof(msdf_grid_edge));
+
+	u32 I = 0, First = 0;
+	for (u32 C = 0; C < Shape.ContourCount; C++) {
+		msdf_contour Contour = Shape.Contours[C];
+		for (u32 E = 0; E < Contour.EdgeCount; E++, I++) {
+			msdf_edge Edge = Contour.Edges[E];
+			v4r32	  Box  = { R32_MAX, R32_MAX, -R32_MAX, -R32_MAX };
+			for (u32 S = First; S < First + Edge.SegmentCount; S++) {
+				v4r32 SegmentBox = Soa->Bounds[S];
+				Box.X			 = MIN(Box.X, SegmentBox.X);
+				Box.Y			 = MIN(Box.Y, SegmentBox.Y);
+				Box.Z			 = MAX(Box.Z, SegmentBox.Z);
+				Box.W			 = MAX(Box.W, SegmentBox.W);
+			}
+
+			Edges[I] = (msdf_grid_edge){
+				.Bounds = Box,
+				.First	= First,
+				.Count	= Edge.SegmentCount,
+				.Color	= Edge.Color,
+			};
+			First += Edge.SegmentCount;
+		}
+	}
+
+	*EdgeCountOut = EdgeCount;
+	return Edges;
+}
+
+internal msdf_raster
+MSDF_InitRaster(msdf_shape Shape, v2u32 SlotSize)
+{
 	v4s16 Bounds	= Shape.Bounds;
 	v2r32 Offset	= { 1, 1 };
-	*_SlotPos		= V2u32_Add(*_SlotPos, (v2u32){ 1, 1 });
-	*_SlotSize		= V2u32_Sub(*_SlotSize, (v2u32){ 2, 2 });
 	v2r32 SlotSizeR = { SlotSize.X, SlotSize.Y };
 	v2r32 Size		= V2r32_Sub(SlotSizeR, V2r32_MulS(Offset, 2));
 	v2r32 MaxBounds = { Bounds.Z - Bounds.X, Bounds.W - Bounds.Y };
 	v2r32 Scale		= V2r32_Div(Size, MaxBounds);
-	r32	  Range		= 4 / (Scale.X + Scale.Y);
 
-	v4r32 *FloatMap = Stack_Allocate(SlotSize.X * SlotSize.Y * sizeof(v4r32));
+	msdf_raster Raster = { 0 };
+	Raster.Shape	   = Shape;
+	Raster.Segments	   = MSDF_InitSegments(Shape);
+	Raster.Edges = MSDF_InitEdges(Shape, &Raster.Segments, &Raster.EdgeCount);
+	Raster.UseGrid	   = TRUE;
+	Raster.SlotSize	   = SlotSize;
+	Raster.Offset	   = Offset;
+	Raster.Scale	   = Scale;
+	Raster.Range	   = 4 / (Scale.X + Scale.Y);
+	Raster.FloatMap	   = Stack_Allocate(SlotSize.X * SlotSize.Y * sizeof(v4r32));
+	return Raster;
+}
 
-	for (u32 Y = 0; Y < SlotSize.Y; Y++) {
-		for (u32 X = 0; X < SlotSize.X; X++) {
-			v2r32 P = { (X - Offset.X + 0.5) / Scale.X + Bounds.X,
-				(Y - Offset.Y + 0.5) / Scale.Y + Bounds.Y };
+// The point in shape space at the center of a pixel.
+internal v2r32
+MSDF_RasterPoint(msdf_raster *Raster, u32 X, u32 Y)
+{
+	v2r32 Offset = Raster->Offset;
+	v2r32 Scale	 = Raster->Scale;
+	v4s16 Bounds = Raster->Shape.Bounds;
+	return (v2r32){ (X - Offset.X + 0.5) / Scale.X + Bounds.X,
+		(Y - Offset.Y + 0.5) / Scale.Y + Bounds.Y };
+}
 
-			msdf_dist Dists[3] = {
-				{ R32_MAX, 1 },
-				{ R32_MAX, 1 },
-				{ R32_MAX, 1 }
-			};
-			msdf_edge Edges[3] = {
-				Shape.Contours[0].Edges[0],
-				Shape.Contours[0].Edges[0],
-				Shape.Contours[0].Edges[0],
-			};
-			msdf_segment Segments[3] = {
-				Edges[0].Segments[0],
-				Edges[0].Segments[0],
-				Edges[0].Segments[0],
-			};
+// The scalar reference for one pixel, which MSDF_ComputeRows does four at a
+// time.
+internal v4r32
+MSDF_ComputePixel(msdf_shape Shape, v2r32 P)
+{
+	msdf_dist Dists[3] = {
+		{ R32_MAX, 1 },
+		{ R32_MAX, 1 },
+		{ R32_MAX, 1 }
+	};
+	msdf_edge Edges[3] = {
+		Shape.Contours[0].Edges[0],
+		Shape.Contours[0].Edges[0],
+		Shape.Contours[0].Edges[0],
+	};
+	msdf_segment Segments[3] = {
+		Edges[0].Segments[0],
+		Edges[0].Segments[0],
+		Edges[0].Segments[0],
+	};
 
-			for (u32 C = 0; C < Shape.ContourCount; C++) {
-				msdf_contour Contour = Shape.Contours[C];
-				for (u32 E = 0; E < Contour.EdgeCount; E++) {
-					msdf_edge	 Edge = Contour.Edges[E];
-					msdf_segment Segment;
-					msdf_dist Dist = MSDF_EdgeSignedDistance(P, Edge, &Segment);
-					if ((Edge.Color & 0b100)
-						&& MSDF_Cmp(Dist, Dists[0]) == LESS)
-					{
-						Dists[0]	= Dist;
-						Edges[0]	= Edge;
-						Segments[0] = Segment;
-					}
-					if ((Edge.Color & 0b010)
-						&& MSDF_Cmp(Dist, Dists[1]) == LESS)
-					{
-						Dists[1]	= Dist;
-						Edges[1]	= Edge;
-						Segments[1] = Segment;
-					}
-					if ((Edge.Color & 0b001)
-						&& MSDF_Cmp(Dist, Dists[2]) == LESS)
-					{
-						Dists[2]	= Dist;
-						Edges[2]	= Edge;
-						Segments[2] = Segment;
-					}
-				}
+	for (u32 C = 0; C < Shape.ContourCount; C++) {
+		msdf_contour Contour = Shape.Contours[C];
+		for (u32 E = 0; E < Contour.EdgeCount; E++) {
+			msdf_edge	 Edge = Contour.Edges[E];
+			msdf_segment Segment;
+			msdf_dist	 Dist = MSDF_EdgeSignedDistance(P, Edge, &Segment);
+			if ((Edge.Color & 0b100) && MSDF_Cmp(Dist, Dists[0]) == LESS) {
+				Dists[0]	= Dist;
+				Edges[0]	= Edge;
+				Segments[0] = Segment;
+			}
+			if ((Edge.Color & 0b010) && MSDF_Cmp(Dist, Dists[1]) == LESS) {
+				Dists[1]	= Dist;
+				Edges[1]	= Edge;
+				Segments[1] = Segment;
 			}
+			if ((Edge.Color & 0b001) && MSDF_Cmp(Dist, Dists[2]) == LESS) {
+				Dists[2]	= Dist;
+				Edges[2]	= Edge;
+				Segments[2] = Segment;
+			}
+		}
+	}
+
+	v4r32 FinalDists;
+	FinalDists.X = MSDF_SignedPseudoDistance(P, Segments[0]);
+	FinalDists.Y = MSDF_SignedPseudoDistance(P, Segments[1]);
+	FinalDists.Z = MSDF_SignedPseudoDistance(P, Segments[2]);
+
+	msdf_dist TrueDist = Dists[0];
+	if (MSDF_Cmp(Dists[1], TrueDist) == LESS) TrueDist = Dists[1];
+	if (MSDF_Cmp(Dists[2], TrueDist) == LESS) TrueDist = Dists[2];
+	FinalDists.W = TrueDist.Distance;
+
+	return FinalDists;
+}
+
+internal s08
+MSDF_CmpCellEdges(vptr A, vptr B)
+{
+	r32 ABound = ((msdf_cell_edge *) A)->Bound;
+	r32 BBound = ((msdf_cell_edge *) B)->Bound;
+	if (ABound < BBound) return LESS;
+	if (ABound > BBound) return GREATER;
+	return EQUAL;
+}
+
+// Orders the edges by how close they could be to any pixel from Start up to
+// End. Without the grid, the edges stay in order with no bounds.
+internal void
+MSDF_SortCellEdges(
+	msdf_raster	   *Raster,
+	v2u32			Start,
+	v2u32			End,
+	msdf_cell_edge *Order
+)
+{
+	if (!Raster->UseGrid) {
+		for (u32 I = 0; I < Raster->EdgeCount; I++)
+			Order[I] = (msdf_cell_edge){ 0, I };
+		return;
+	}
+
+	v2r32 Min = MSDF_RasterPoint(Raster, Start.X, Start.Y);
+	v2r32 Max = MSDF_RasterPoint(Raster, End.X - 1, End.Y - 1);
+
+	for (u32 I = 0; I < Raster->EdgeCount; I++) {
+		r32 Bound = MSDF_BoxDistance(Raster->Edges[I].Bounds, Min, Max);
+		Order[I]  = (msdf_cell_edge){ Bound, I };
+	}
+
+	usize Size = sizeof(msdf_cell_edge);
+	QuickSort(Order, Size, Raster->EdgeCount, MSDF_CmpCellEdges);
+}
+
+// Computes the four pixels starting at X, Y, visiting the edges in the given
+// order. Past the end of the row, the extra lanes are computed and thrown
+// away.
+internal void
+MSDF_ComputeGroup(msdf_raster *Raster, u32 X, u32 Y, msdf_cell_edge *Order)
+{
+	msdf_segment_soa *Soa	   = &Raster->Segments;
+	v2u32			  SlotSize = Raster->SlotSize;
+
+	r32x4 PX, PY;
+	for (u32 L = 0; L < 4; L++) {
+		v2r32 P = MSDF_RasterPoint(Raster, X + L, Y);
+		PX[L]	= P.X;
+		PY[L]	= P.Y;
+	}
+
+	// Worst is the farthest any lane's closest edge is in each channel, so an
+	// edge that's farther than that can't change the channel.
+	msdf_dist4 Dists[3];
+	s32x4	   Segments[3];
+	r32		   Worst[3];
+	for (u32 Ch = 0; Ch < 3; Ch++) {
+		Dists[Ch].Distance		= R32_MAX + (r32x4){ 0 };
+		Dists[Ch].Orthogonality = 1 + (r32x4){ 0 };
+		Segments[Ch]			= (s32x4){ 0 };
+		Worst[Ch]				= R32_MAX;
+	}
+
+	// Without the grid, the pixels are treated as covering everything, so no
+	// segments get skipped either.
+	v2r32 Min = { PX[0], PY[0] };
+	v2r32 Max = { PX[3], PY[3] };
+	if (!Raster->UseGrid) {
+		Min = (v2r32){ -R32_MAX, -R32_MAX };
+		Max = (v2r32){ R32_MAX, R32_MAX };
+	}
+
+	for (u32 I = 0; I < Raster->EdgeCount; I++) {
+		msdf_cell_edge	Entry = Order[I];
+		msdf_grid_edge *Edge  = Raster->Edges + Entry.Edge;
+		if (Entry.Bound > MAX(Worst[0], MAX(Worst[1], Worst[2]))) break;
+
+		u08 Channels = 0;
+		r32 Limit	 = 0;
+		for (u32 Ch = 0; Ch < 3; Ch++) {
+			if (!(Edge->Color & (0b100 >> Ch))) continue;
+			if (Entry.Bound > Worst[Ch]) continue;
+			Channels |= 0b100 >> Ch;
+			Limit	  = MAX(Limit, Worst[Ch]);
+		}
+		if (!Channels) continue;
+
+		s32x4	   Segment;
+		msdf_dist4 Dist = MSDF_EdgeSignedDistance4(
+			PX,
+			PY,
+			Min,
+			Max,
+			Limit,
+			Soa,
+			Edge->First,
+			Edge->Count,
+			&Segment
+		);
+
+		for (u32 Ch = 0; Ch < 3; Ch++) {
+			if (!(Channels & (0b100 >> Ch))) continue;
+
+			// Ties go to whichever edge comes first in the shape, the same as
+			// if they had all been visited in order.
+			msdf_dist4 *Best  = Dists + Ch;
+			s32x4		First = Segment < Segments[Ch];
+			s32x4		Tie	  = MSDF_Equal4(Dist, *Best) & First;
+			s32x4		Less  = MSDF_Less4(Dist, *Best) | Tie;
+			Best->Distance	  = MSDF_Select4(Less, Dist.Distance, Best->Distance);
+			Best->Orthogonality =
+				MSDF_Select4(Less, Dist.Orthogonality, Best->Orthogonality);
+			Segments[Ch] = (Segment & Less) | (Segments[Ch] & ~Less);
+			Worst[Ch]	 = MSDF_MaxAbs4(Best->Distance);
+		}
+	}
+
+	// Only three segments per pixel are left, so the pseudo-distances are done
+	// one pixel at a time.
+	for (u32 L = 0; L < 4 && X + L < SlotSize.X; L++) {
+		v2r32 P = { PX[L], PY[L] };
+
+		v4r32 FinalDists;
+		for (u32 Ch = 0; Ch < 3; Ch++) {
+			msdf_segment Segment = Soa->Segments[Segments[Ch][L]];
+			FinalDists.E[Ch]	 = MSDF_SignedPseudoDistance(P, Segment);
+		}
+
+		msdf_dist TrueDist = { R32_MAX, 0 };
+		for (u32 Ch = 0; Ch < 3; Ch++) {
+			msdf_dist Dist = {
+				Dists[Ch].Distance[L],
+				Dists[Ch].Orthogonality[L],
+			};
+			if (Ch == 0 || MSDF_Cmp(Dist, TrueDist) == LESS) TrueDist = Dist;
+		}
+		FinalDists.W = TrueDist.Distance;
+
+		Raster->FloatMap[INDEX_2D(X + L, Y, SlotSize.X)] = FinalDists;
+	}
+}
+
+internal void
+MSDF_ComputeRows(msdf_raster *Raster, u32 StartY, u32 EndY)
+{
+	Stack_Push();
+
+	v2u32			SlotSize = Raster->SlotSize;
+	msdf_cell_edge *Order =
+		Stack_Allocate(Raster->EdgeCount * sizeof(msdf_cell_edge));
 
-			v4r32 FinalDists;
-			FinalDists.X = MSDF_SignedPseudoDistance(P, Segments[0]);
-			FinalDists.Y = MSDF_SignedPseudoDistance(P, Segments[1]);
-			FinalDists.Z = MSDF_SignedPseudoDistance(P, Segments[2]);
+	for (u32 CellY = StartY; CellY < EndY; CellY += MSDF_CELL_SIZE) {
+		u32 CellEndY = MIN(CellY + MSDF_CELL_SIZE, EndY);
+		for (u32 CellX = 0; CellX < SlotSize.X; CellX += MSDF_CELL_SIZE) {
+			u32 CellEndX = MIN(CellX + MSDF_CELL_SIZE, SlotSize.X);
 
-			msdf_dist TrueDist = Dists[0];
-			if (MSDF_Cmp(Dists[1], TrueDist) == LESS) TrueDist = Dists[1];
-			if (MSDF_Cmp(Dists[2], TrueDist) == LESS) TrueDist = Dists[2];
-			FinalDists.W = TrueDist.Distance;
+			v2u32 Start = { CellX, CellY };
+			v2u32 End	= { CellEndX, CellEndY };
+			MSDF_SortCellEdges(Raster, Start, End, Order);
 
-			FloatMap[INDEX_2D(X, Y, (u32) SlotSize.X)] = FinalDists;
+			for (u32 Y = CellY; Y < CellEndY; Y++)
+				for (u32 X = CellX; X < CellEndX; X += 4)
+					MSDF_ComputeGroup(Raster, X, Y, Order);
 		}
 	}
 
+	Stack_Pop();
+}
+
+internal void
+MSDF_ResolveRaster(msdf_raster *Raster, v4u08 *Bitmap, u32 BitmapWidth)
+{
+	v2u32  SlotSize = Raster->SlotSize;
+	v4r32 *FloatMap = Raster->FloatMap;
+
 	u08 *ErrorMap = Stack_Allocate(SlotSize.X * SlotSize.Y);
 	Mem_Set(ErrorMap, 0, SlotSize.X * SlotSize.Y);
 
 	r32 ThresholdModifier = 0.72;
-	r32 Threshold		  = Range * ThresholdModifier;
+	r32 Threshold		  = Raster->Range * ThresholdModifier;
 	MSDF_FindErrors(ErrorMap, FloatMap, SlotSize, Threshold);
 	MSDF_FixErrors(ErrorMap, FloatMap, SlotSize);
 
 	for (u32 Y = 0; Y < SlotSize.Y; Y++) {
 		for (u32 X = 0; X < SlotSize.X; X++) {
 			v4r32 Floats = FloatMap[INDEX_2D(X, Y, SlotSize.X)];
-			v4u08 Color	 = MSDF_DistanceColor(Floats, Range);
-			Bitmap[INDEX_2D(X, Y, BitmapSize.X)] = Color;
+			v4u08 Color	 = MSDF_DistanceColor(Floats, Raster->Range);
+			Bitmap[INDEX_2D(X, Y, BitmapWidth)] = Color;
 		}
 	}
 }
 
+internal void
+MSDF_DrawShape(
+	msdf_shape Shape,
+	v2u32	  *_SlotPos,
+	v2u32	  *_SlotSize,
+	v4u08	  *Bitmap,
+	v2u32	   BitmapOffset,
+	u32		   BitmapIndex,
+	v2u32	   BitmapSize
+)
+{
+	/* TODO Possible things to add
+	   - Short edge merging
+	*/
+
+	msdf_raster Raster = MSDF_InitRaster(Shape, *_SlotSize);
+	*_SlotPos		   = V2u32_Add(*_SlotPos, (v2u32){ 1, 1 });
+	*_SlotSize		   = V2u32_Sub(*_SlotSize, (v2u32){ 2, 2 });
+
+	MSDF_ComputeRows(&Raster, 0, Raster.SlotSize.Y);
+	MSDF_ResolveRaster(&Raster, Bitmap, BitmapSize.X);
+}
+
+internal void
+MSDF_BandJob(vptr Param)
+{
+	msdf_band_job *Job = Param;
+	MSDF_ComputeRows(Job->Raster, Job->StartY, Job->EndY);
+}
+
+internal void
+MSDF_GlyphJob(vptr Param)
+{
+	msdf_glyph_job	*Job  = Param;
+	msdf_atlas_slot *Slot = Job->Slot;
+
+	msdf_raster Raster = MSDF_InitRaster(Slot->Shape, Slot->Size);
+	v2u32		Size   = Raster.SlotSize;
+
+	if (Size.X * Size.Y < MSDF_BAND_MIN_PIXELS || !Platform_GetWorkerCount()) {
+		MSDF_ComputeRows(&Raster, 0, Size.Y);
+	} else {
+		// Waiting on the bands runs other jobs on this thread in the meantime,
+		// which is fine since they leave the scratch stack as they found it.
+		u32			   BandCount = (Size.Y + MSDF_BAND_HEIGHT - 1) / MSDF_BAND_HEIGHT;
+		msdf_band_job *Bands	 = Stack_Allocate(BandCount * sizeof(msdf_band_job));
+		platform_job  *Jobs		 = Stack_Allocate(BandCount * sizeof(platform_job));
+
+		for (u32 I = 0; I < BandCount; I++) {
+			Bands[I] = (msdf_band_job){
+				.Raster = &Raster,
+				.StartY = I * MSDF_BAND_HEIGHT,
+				.EndY	= MIN((I + 1) * MSDF_BAND_HEIGHT, Size.Y),
+			};
+			Jobs[I] = (platform_job){ MSDF_BandJob, Bands + I };
+		}
+
+		job_counter Counter = { 0 };
+		Platform_RunJobs(Jobs, BandCount, &Counter);
+		Platform_WaitForCounter(&Counter, 0);
+	}
+
+	v4u08 *Bitmap = Job->Bitmap + INDEX_2D(Slot->Pos.X, Slot->Pos.Y, Job->BitmapSize.X);
+	MSDF_ResolveRaster(&Raster, Bitmap, Job->BitmapSize.X);
+
+	Slot->Pos  = V2u32_Add(Slot->Pos, (v2u32){ 1, 1 });
+	Slot->Size = V2u32_Sub(Slot->Size, (v2u32){ 2, 2 });
+}
+
+// Draws a batch of shapes into a shared bitmap across the job system. Each
+// glyph gets a job, and large glyphs are further split into bands of rows.
+internal void
+MSDF_DrawAtlas(
+	msdf_atlas_slot *Slots,
+	u32				 SlotCount,
+	v4u08			*Bitmap,
+	v2u32			 BitmapSize
+)
+{
+	Stack_Push();
+
+	msdf_glyph_job *GlyphJobs = Stack_Allocate(SlotCount * sizeof(msdf_glyph_job));
+	platform_job   *Jobs	  = Stack_Allocate(SlotCount * sizeof(platform_job));
+
+	for (u32 I = 0; I < SlotCount; I++) {
+		Assert(Slots[I].Pos.X + Slots[I].Size.X <= BitmapSize.X);
+		Assert(Slots[I].Pos.Y + Slots[I].Size.Y <= BitmapSize.Y);
+
+		GlyphJobs[I] = (msdf_glyph_job){
+			.Slot		= Slots + I,
+			.Bitmap		= Bitmap,
+			.BitmapSize = BitmapSize,
+		};
+		Jobs[I] = (platform_job){ MSDF_GlyphJob, GlyphJobs + I };
+	}
+
+	job_counter Counter = { 0 };
+	Platform_RunJobs(Jobs, SlotCount, &Counter);
+	Platform_WaitForCounter(&Counter, 0);
+
+	Stack_Pop();
+}
+
+
+#ifndef REGION_MSDF_TESTS
+
+#define MSDF_TESTS                                                            \
+	TEST(MSDF_ComputeRows, MatchesScalarReference, (                          \
+		msdf_segment Segments[3] = {                                          \
+			{ { 0, 0 }, { 40, 0 }, { 0, 0 }, 0 },                             \
+			{ { 40, 0 }, { 20, 50 }, { 50, 40 }, 1 },                         \
+			{ { 20, 50 }, { 0, 0 }, { 0, 0 }, 0 },                            \
+		};                                                                    \
+		msdf_edge Edges[3] = {                                                \
+			{ Segments + 0, 1, 0b110 },                                       \
+			{ Segments + 1, 1, 0b011 },                                       \
+			{ Segments + 2, 1, 0b101 },                                       \
+		};                                                                    \
+		msdf_contour Contour = { Edges, 3 };                                  \
+		msdf_shape Shape = {                                                  \
+			&Contour, Edges, Segments, 1, 3, 3, { 0, 0, 50, 50 }              \
+		};                                                                    \
+                                                                              \
+		/* The width isn't a multiple of four, to cover the partial group */  \
+		v2u32 Size = { 23, 17 };                                              \
+		msdf_raster Raster = MSDF_InitRaster(Shape, Size);                    \
+		MSDF_ComputeRows(&Raster, 0, Size.Y);                                 \
+		for (u32 Y = 0; Y < Size.Y; Y++) {                                    \
+			for (u32 X = 0; X < Size.X; X++) {                                \
+				v2r32 P = MSDF_RasterPoint(&Raster, X, Y);                    \
+				v4r32 Expected = MSDF_ComputePixel(Shape, P);                 \
+				v4r32 Result = Raster.FloatMap[INDEX_2D(X, Y, Size.X)];       \
+				for (u32 C = 0; C < 4; C++)                                   \
+					Assert(                                                   \
+						R32_Abs(Result.E[C] - Expected.E[C])                  \
+						<= Raster.Range / 64                                  \
+					);                                                        \
+			}                                                                 \
+		}                                                                     \
+	))                                                                        \
+	//
+
+#endif
+
+#ifndef REGION_MSDF_BENCHMARKS
+
+#define MSDF_BENCHMARKS                                                       \
+	BENCH(MSDF_ComputeRows, GridAgainstBruteForce, (                          \
+		string Path = Util_FindArg(Platform, CStringL("-BenchFont"));         \
+		if (!Path.Length) {                                                   \
+			Printf("Skipped, since no font was given with -BenchFont\n");     \
+			return;                                                           \
+		}                                                                     \
+		usize HeapSize = 1 << 20;                                             \
+		vptr  HeapBase = Platform_AllocateMemory(HeapSize);                   \
+		heap *Heap     = Heap_Init(HeapBase, HeapSize);                       \
+		font  Font     = Font_Open(Heap, Path.Text);                          \
+                                                                              \
+		u32 Sizes[] = { 32, 64, 128, 256 };                                   \
+		for (u32 S = 0; S < 4; S++) {                                         \
+			v2u32 Size = { Sizes[S], Sizes[S] };                              \
+			r64	  BruteTime = 0, GridTime = 0;                                \
+			for (u32 C = '!'; C <= '~'; C++) {                                \
+				Stack_Push();                                                 \
+				font_glyph Glyph = Font_GetGlyph(Font, C, 1);                 \
+				if (Glyph.Shape.ContourCount) {                               \
+					msdf_raster Grid  = MSDF_InitRaster(Glyph.Shape, Size);   \
+					msdf_raster Brute = Grid;                                 \
+					usize Bytes = Size.X * Size.Y * sizeof(v4r32);            \
+					Brute.UseGrid  = FALSE;                                   \
+					Brute.FloatMap = Stack_Allocate(Bytes);                   \
+                                                                              \
+					timestamp T0 = Platform_GetTimestamp();                   \
+					MSDF_ComputeRows(&Brute, 0, Size.Y);                      \
+					timestamp T1 = Platform_GetTimestamp();                   \
+					MSDF_ComputeRows(&Grid, 0, Size.Y);                       \
+					timestamp T2 = Platform_GetTimestamp();                   \
+                                                                              \
+					BruteTime += Platform_GetSecondsElapsed(T0, T1);          \
+					GridTime  += Platform_GetSecondsElapsed(T1, T2);          \
+					s32 Cmp = Mem_Cmp(Brute.FloatMap, Grid.FloatMap, Bytes);  \
+					Assert(Cmp == 0, "The grid changed the result");          \
+				}                                                             \
+				Stack_Pop();                                                  \
+			}                                                                 \
+			Printf(                                                           \
+				"%ux%u: brute force %fs, grid %fs\n",                         \
+				Size.X,                                                       \
+				Size.Y,                                                       \
+				BruteTime,                                                    \
+				GridTime                                                      \
+			);                                                                \
+		}                                                                     \
+		Font_Close(&Font);                                                    \
+		Platform_FreeMemory(HeapBase, HeapSize);                              \
+	))                                                                        \
+	//
+
+#endif
+
 #endif
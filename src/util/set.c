@@ -12,15 +12,22 @@
 #define HASH_VACANT  0
 #define HASH_DELETED 1
 
+// Removed entries leave tombstones, which count toward the load until the
+// next rehash clears them. If ShrinkThresh is set, removing entries shrinks
+// the map once the live load drops below it, down to MinCapacity. It should
+// be well under ResizeThresh / ResizeRate, or the map will keep resizing.
 typedef struct hashmap {
 	heap_handle *Data;
 	u32			 Capacity;
+	u32			 MinCapacity;
 	u32			 EntryCount;
+	u32			 DeletedCount;
 	u32			 EntrySize;
 	u32			 KeySize;
 	u32			 ValueSize;
 	r32			 ResizeRate;
 	r32			 ResizeThresh;
+	r32			 ShrinkThresh;
 
 	vptr	 CmpParam;
 	cmp_func Cmp;
@@ -35,21 +42,217 @@ typedef struct hashmap {
 			for (key Key = *(key*) ((Map)->Data->Data + (Map)->EntrySize * I + sizeof(usize)); Hash; ) \
 				for (value Value = *(value*) ((Map)->Data->Data + (Map)->EntrySize * I + sizeof(usize) + (Map)->KeySize); Hash; Hash = 0)
 
+// Control bytes for flatmap slots. Full slots hold seven bits of the hash,
+// so the high bit alone says whether a slot is free.
+#define FLATMAP_EMPTY	   0x80
+#define FLATMAP_DELETED	   0xFE
+#define FLATMAP_GROUP_SIZE 16
+
+// An open addressing table that keeps a control byte per slot apart from the
+// entries, so sixteen slots are probed with one compare. The capacity is a
+// power of two, and the control bytes for the first group are mirrored past
+// the end, so a group can start at any slot. The entries follow the control
+// bytes.
+typedef struct flatmap {
+	heap_handle *Data;
+	u32			 Capacity;
+	u32			 EntryCount;
+	u32			 GrowthLeft;
+	u32			 EntrySize;
+	u32			 KeySize;
+	u32			 ValueSize;
+
+	vptr	 CmpParam;
+	cmp_func Cmp;
+
+	vptr	  HashParam;
+	hash_func Hash;
+} flatmap;
+
+#define FLATMAP_FOREACH(I, key, Key, value, Value, Map) \
+	for (usize I = 0; I < (Map)->Capacity; I++) \
+		for (u08 *_Entry = (Map)->Data->Data + (Map)->Capacity + FLATMAP_GROUP_SIZE + (Map)->EntrySize * I; \
+			_Entry && ((u08 *) (Map)->Data->Data)[I] < FLATMAP_EMPTY; ) \
+			for (key Key = *(key *) _Entry; _Entry; ) \
+				for (value Value = *(value *) (_Entry + (Map)->KeySize); _Entry; _Entry = NULL)
+
+// The probe helpers are in the header, so typed maps defined in any module
+// can inline them.
+
+// Custom hashes, like the identity of an integer key, can leave the high bits
+// empty, so they're spread out before being split into the probe start and
+// the control byte.
+intrin u64
+FlatMap_MixHash(usize Hash)
+{
+	u64 Mixed = Hash * 0x9E3779B97F4A7C15ull;
+	return Mixed ^ (Mixed >> 32);
+}
+
+intrin u08 *
+FlatMap_GetEntry(flatmap *Map, u32 Index)
+{
+	u08 *Entries = (u08 *) Map->Data->Data + Map->Capacity + FLATMAP_GROUP_SIZE;
+	return Entries + (usize) Index * Map->EntrySize;
+}
+
+intrin u32
+FlatMap_MatchGroup(u08 *Control, u08 Byte)
+{
+	u08x16 Group = *(u08x16_unaligned *) Control;
+	return Intrin_MoveMask_U08x16((u08x16) (Group == (u08x16){ 0 } + Byte));
+}
+
+// Empty and deleted slots both have the high bit set.
+intrin u32
+FlatMap_MatchFree(u08 *Control)
+{ return Intrin_MoveMask_U08x16(*(u08x16_unaligned *) Control); }
+
+intrin void
+FlatMap_SetControl(flatmap *Map, u32 Index, u08 Byte)
+{
+	u08 *Control   = Map->Data->Data;
+	Control[Index] = Byte;
+	if (Index < FLATMAP_GROUP_SIZE) Control[Map->Capacity + Index] = Byte;
+}
+
+// Claims the first free slot along the key's probe. The caller has to know
+// the key isn't already there.
+intrin u32
+FlatMap_Insert(flatmap *Map, u64 Hash)
+{
+	u08 *Control = Map->Data->Data;
+	u32	 Mask	 = Map->Capacity - 1;
+	u32	 Pos	 = (Hash >> 7) & Mask;
+
+	u32 Free;
+	for (u32 Step = FLATMAP_GROUP_SIZE;; Step += FLATMAP_GROUP_SIZE) {
+		Free = FlatMap_MatchFree(Control + Pos);
+		if (Free) break;
+		Pos = (Pos + Step) & Mask;
+	}
+
+	u32 Bit;
+	Intrin_BitScanForward64(&Bit, Free);
+	u32 Index = (Pos + Bit) & Mask;
+
+	if (Control[Index] == FLATMAP_EMPTY) Map->GrowthLeft--;
+	FlatMap_SetControl(Map, Index, Hash & 0x7F);
+	Map->EntryCount++;
+	return Index;
+}
+
+// Generates a flatmap specialized for integer or pointer keys, with the hash
+// and compare inlined and the entries copied by type. It's still a flatmap,
+// so the generic functions and FLATMAP_FOREACH work on it, and growing and
+// removing go through them.
+#define DEFINE_FLATMAP(Name, key, value)                                      \
+	internal usize                                                            \
+	Name##_Hash(key *Key, vptr Param)                                         \
+	{ return (usize) *Key; }                                                  \
+                                                                              \
+	internal s08                                                              \
+	Name##_Cmp(key *A, key *B, vptr Param)                                    \
+	{ return *A == *B ? EQUAL : *A < *B ? LESS : GREATER; }                   \
+                                                                              \
+	internal flatmap                                                          \
+	Name##_Init(heap *Heap, u32 InitialCount)                                 \
+	{                                                                         \
+		return FlatMap_InitCustom(                                            \
+			Heap,                                                             \
+			sizeof(key),                                                      \
+			sizeof(value),                                                    \
+			InitialCount,                                                     \
+			(hash_func) Name##_Hash,                                          \
+			NULL,                                                             \
+			(cmp_func) Name##_Cmp,                                            \
+			NULL                                                              \
+		);                                                                    \
+	}                                                                         \
+                                                                              \
+	internal value *                                                          \
+	Name##_GetRef(flatmap *Map, key Key)                                      \
+	{                                                                         \
+		u08 *Control = Map->Data->Data;                                       \
+		u32	 Mask	 = Map->Capacity - 1;                                     \
+		u64	 Hash	 = FlatMap_MixHash((usize) Key);                          \
+		u32	 Pos	 = (Hash >> 7) & Mask;                                    \
+                                                                              \
+		for (u32 Step = FLATMAP_GROUP_SIZE;; Step += FLATMAP_GROUP_SIZE) {    \
+			u32 Matches = FlatMap_MatchGroup(Control + Pos, Hash & 0x7F);     \
+			while (Matches) {                                                 \
+				u32 Bit;                                                      \
+				Intrin_BitScanForward64(&Bit, Matches);                       \
+				u08 *Entry = FlatMap_GetEntry(Map, (Pos + Bit) & Mask);       \
+				if (*(key *) Entry == Key)                                    \
+					return (value *) (Entry + sizeof(key));                   \
+				Matches &= Matches - 1;                                       \
+			}                                                                 \
+                                                                              \
+			if (FlatMap_MatchGroup(Control + Pos, FLATMAP_EMPTY))             \
+				return NULL;                                                  \
+			Pos = (Pos + Step) & Mask;                                        \
+		}                                                                     \
+	}                                                                         \
+                                                                              \
+	internal b08                                                              \
+	Name##_Get(flatmap *Map, key Key, value *ValueOut)                        \
+	{                                                                         \
+		value *Value = Name##_GetRef(Map, Key);                               \
+		if (Value && ValueOut) *ValueOut = *Value;                            \
+		return !!Value;                                                       \
+	}                                                                         \
+                                                                              \
+	internal value *                                                          \
+	Name##_Add(flatmap *Map, key Key, value Value)                            \
+	{                                                                         \
+		value *Ref = Name##_GetRef(Map, Key);                                 \
+		if (!Ref && !Map->GrowthLeft)                                         \
+			return (value *) FlatMap_Add(Map, &Key, &Value);                  \
+                                                                              \
+		if (!Ref) {                                                           \
+			u32	 Index = FlatMap_Insert(Map, FlatMap_MixHash((usize) Key));   \
+			u08 *Entry = FlatMap_GetEntry(Map, Index);                        \
+			*(key *) Entry = Key;                                             \
+			Ref			   = (value *) (Entry + sizeof(key));                 \
+		}                                                                     \
+		*Ref = Value;                                                         \
+		return Ref;                                                           \
+	}                                                                         \
+                                                                              \
+	internal b08                                                              \
+	Name##_Remove(flatmap *Map, key Key, value *ValueOut)                     \
+	{ return FlatMap_Remove(Map, &Key, NULL, ValueOut); }
+
 #define SET_FUNCS \
    EXPORT(vptr,    BinarySearchArray,    vptr *Array, u32 Start, u32 End, vptr Target, type Type, cmp_func Func, vptr Param, u32 *IndexOut) \
    EXPORT(void,    QuickSort,            vptr Data, usize ElementSize, usize ElementCount, s08 (*Cmp)(vptr A, vptr B)) \
+   EXPORT(void,    RadixSort,            vptr Data, usize ElementSize, usize ElementCount, usize KeyOffset, type_id KeyType) \
    EXPORT(hashmap, HashMap_InitCustom,   heap *Heap, u32 KeySize, u32 ValueSize, u32 InitialCapacity, r32 ResizeThresh, r32 ResizeRate, hash_func HashFunc, vptr HashParam, cmp_func CmpFunc, vptr CmpParam) \
    EXPORT(hashmap, HashMap_Init,         heap *Heap, u32 KeySize, u32 ValueSize) \
    EXPORT(vptr,    HashMap_GetRef,       hashmap *Map, vptr Key) \
    EXPORT(b08,     HashMap_Get,          hashmap *Map, vptr Key, vptr ValueOut) \
    EXPORT(b08,     HashMap_Remove,       hashmap *Map, vptr Key, vptr KeyOut, vptr ValueOut) \
    EXPORT(vptr,    HashMap_Add,          hashmap *Map, vptr Key, vptr Value) \
-   EXPORT(void,    HashMap_Free,         hashmap *Map)
+   EXPORT(u32,     HashMap_CountProbes,  hashmap *Map, vptr Key) \
+   EXPORT(void,    HashMap_Free,         hashmap *Map) \
+   \
+   EXPORT(flatmap, FlatMap_InitCustom,   heap *Heap, u32 KeySize, u32 ValueSize, u32 InitialCount, hash_func HashFunc, vptr HashParam, cmp_func CmpFunc, vptr CmpParam) \
+   EXPORT(flatmap, FlatMap_Init,         heap *Heap, u32 KeySize, u32 ValueSize) \
+   EXPORT(vptr,    FlatMap_GetRef,       flatmap *Map, vptr Key) \
+   EXPORT(b08,     FlatMap_Get,          flatmap *Map, vptr Key, vptr ValueOut) \
+   EXPORT(b08,     FlatMap_Remove,       flatmap *Map, vptr Key, vptr KeyOut, vptr ValueOut) \
+   EXPORT(vptr,    FlatMap_Add,          flatmap *Map, vptr Key, vptr Value) \
+   EXPORT(void,    FlatMap_Free,         flatmap *Map)
 
 #endif
 
 #ifdef INCLUDE_SOURCE
 
+// Past this many elements, QuickSort splits the range instead of insertion
+// sorting it.
+#define SORT_INSERTION_MAX 16
+
 internal vptr
 BinarySearchArray(
 	vptr	*Array,
@@ -117,6 +320,89 @@ BinarySearchArray(
 	return Curr;
 }
 
+// Swaps a word at a time, so most elements take a step or two.
+internal void
+Sort_Swap(u08 *A, u08 *B, usize Size)
+{
+	usize I = 0;
+	for (; I + 8 <= Size; I += 8) {
+		u64 Temp				   = *(u64_unaligned *) (A + I);
+		*(u64_unaligned *) (A + I) = *(u64_unaligned *) (B + I);
+		*(u64_unaligned *) (B + I) = Temp;
+	}
+	if (I + 4 <= Size) {
+		u32 Temp				   = *(u32_unaligned *) (A + I);
+		*(u32_unaligned *) (A + I) = *(u32_unaligned *) (B + I);
+		*(u32_unaligned *) (B + I) = Temp;
+		I						  += 4;
+	}
+	for (; I < Size; I++) {
+		u08 Temp = A[I];
+		A[I]	 = B[I];
+		B[I]	 = Temp;
+	}
+}
+
+internal void
+Sort_Insertion(
+	u08	 *Data,
+	usize ElementSize,
+	usize ElementCount,
+	s08 (*Cmp)(vptr A, vptr B)
+)
+{
+	for (usize I = 1; I < ElementCount; I++) {
+		u08 *Element = Data + I * ElementSize;
+		for (; Element > Data; Element -= ElementSize) {
+			u08 *Prev = Element - ElementSize;
+			if (Cmp(Element, Prev) >= 0) break;
+			Sort_Swap(Element, Prev, ElementSize);
+		}
+	}
+}
+
+internal void
+Sort_SiftDown(
+	u08	 *Data,
+	usize ElementSize,
+	usize Root,
+	usize ElementCount,
+	s08 (*Cmp)(vptr A, vptr B)
+)
+{
+	for (usize Child; (Child = 2 * Root + 1) < ElementCount; Root = Child) {
+		u08 *C = Data + Child * ElementSize;
+		if (Child + 1 < ElementCount && Cmp(C, C + ElementSize) < 0) {
+			Child++;
+			C += ElementSize;
+		}
+
+		u08 *R = Data + Root * ElementSize;
+		if (Cmp(R, C) >= 0) break;
+		Sort_Swap(R, C, ElementSize);
+	}
+}
+
+internal void
+Sort_Heap(
+	u08	 *Data,
+	usize ElementSize,
+	usize ElementCount,
+	s08 (*Cmp)(vptr A, vptr B)
+)
+{
+	for (usize I = ElementCount / 2; I-- > 0;)
+		Sort_SiftDown(Data, ElementSize, I, ElementCount, Cmp);
+
+	for (usize End = ElementCount - 1; End > 0; End--) {
+		Sort_Swap(Data, Data + End * ElementSize, ElementSize);
+		Sort_SiftDown(Data, ElementSize, 0, End, Cmp);
+	}
+}
+
+// An introsort. Ranges up to SORT_INSERTION_MAX elements are insertion
+// sorted, and a range that has been split more than twice the log of the
+// count switches to heapsort, so adversarial input is still n log n.
 internal void
 QuickSort(
 	vptr  Data,
@@ -125,75 +411,195 @@ QuickSort(
 	s08 (*Cmp)(vptr A, vptr B)
 )
 {
-#define QSORT_SWAP(A, B) \
-	do { \
-		Mem_Cpy(Stack + SP, A, ElementSize); \
-		Mem_Cpy(A, B, ElementSize); \
-		Mem_Cpy(B, Stack + SP, ElementSize); \
-	} while (0)
+	if (ElementCount < 2) return;
 
+	// Each range is a start, count, and depth left. The smaller half always
+	// runs first, so each level leaves at most one range waiting.
 	vptr   Cursor = Stack_GetCursor();
-	ssize *Stack  = Cursor;
+	usize *Stack  = Stack_Allocate(3 * 65 * sizeof(usize) + ElementSize);
+	u08	  *Pivot  = (u08 *) (Stack + 3 * 65);
 	usize  SP	  = 0;
 
+	u32 Log;
+	Intrin_BitScanReverse64(&Log, ElementCount);
 	Stack[SP++] = 0;
-	Stack[SP++] = ElementCount - 1;
+	Stack[SP++] = ElementCount;
+	Stack[SP++] = 2 * Log;
 
 	while (SP > 0) {
-		// Retrieve high and low
-		ssize H = Stack[--SP];
-		ssize L = Stack[--SP];
-		if (L < 0 || H < 0 || L >= H) continue;
-
-		// Select middle element as pivot
-		vptr First	= Data + ElementSize * L;
-		vptr Last	= Data + ElementSize * H;
-		vptr Middle = Data + ElementSize * (L + (H - L) / 2);
-		if (Cmp(Middle, First) < 0) QSORT_SWAP(First, Middle);
-		if (Cmp(Last, First) < 0) QSORT_SWAP(First, Last);
-		if (Cmp(Middle, Last) < 0) QSORT_SWAP(Middle, Last);
-		vptr Pivot = Last;
-
-		// Partition
-		ssize I = L - 1;
-		ssize J = H + 1;
+		usize DepthLeft = Stack[--SP];
+		usize Count		= Stack[--SP];
+		u08	 *Base		= (u08 *) Data + Stack[--SP] * ElementSize;
+
+		if (Count <= SORT_INSERTION_MAX) {
+			Sort_Insertion(Base, ElementSize, Count, Cmp);
+			continue;
+		}
+		if (!DepthLeft) {
+			Sort_Heap(Base, ElementSize, Count, Cmp);
+			continue;
+		}
+
+		// The median of three also leaves elements at both ends that stop
+		// the scans below.
+		u08 *First	= Base;
+		u08 *Middle = Base + Count / 2 * ElementSize;
+		u08 *Last	= Base + (Count - 1) * ElementSize;
+		if (Cmp(Middle, First) < 0) Sort_Swap(Middle, First, ElementSize);
+		if (Cmp(Last, Middle) < 0) {
+			Sort_Swap(Last, Middle, ElementSize);
+			if (Cmp(Middle, First) < 0) Sort_Swap(Middle, First, ElementSize);
+		}
+		Mem_Cpy(Pivot, Middle, ElementSize);
+
+		ssize I = -1;
+		ssize J = Count;
 		while (1) {
 			do I++;
-			while (Cmp(Data + ElementSize * I, Pivot) < 0);
+			while (Cmp(Base + I * ElementSize, Pivot) < 0);
 			do J--;
-			while (Cmp(Data + ElementSize * J, Pivot) > 0);
+			while (Cmp(Base + J * ElementSize, Pivot) > 0);
 			if (I >= J) break;
-			QSORT_SWAP(Data + ElementSize * I, Data + ElementSize * J);
+			u08 *A = Base + I * ElementSize;
+			Sort_Swap(A, Base + J * ElementSize, ElementSize);
 		}
 
-		if (J - L < H - (J + 1)) {
-			// Upper half (larger, runs second)
-			Stack[SP++] = J + 1;
-			Stack[SP++] = H;
-			// Lower half (smaller, runs first)
-			Stack[SP++] = L;
-			Stack[SP++] = J;
+		usize Start		= (Base - (u08 *) Data) / ElementSize;
+		usize LowCount	= J + 1;
+		usize HighCount = Count - LowCount;
+		if (LowCount < HighCount) {
+			Stack[SP++] = Start + LowCount;
+			Stack[SP++] = HighCount;
+			Stack[SP++] = DepthLeft - 1;
+			Stack[SP++] = Start;
+			Stack[SP++] = LowCount;
+			Stack[SP++] = DepthLeft - 1;
 		} else {
-			// Lower half (larger, runs second)
-			Stack[SP++] = L;
-			Stack[SP++] = J;
-			// Upper half (smaller, runs first)
-			Stack[SP++] = J + 1;
-			Stack[SP++] = H;
+			Stack[SP++] = Start;
+			Stack[SP++] = LowCount;
+			Stack[SP++] = DepthLeft - 1;
+			Stack[SP++] = Start + LowCount;
+			Stack[SP++] = HighCount;
+			Stack[SP++] = DepthLeft - 1;
 		}
 	}
 
 	Stack_SetCursor(Cursor);
-#undef QSORT_SWAP
+}
+
+// Maps a key to an unsigned integer that sorts the same way. Negative floats
+// have every bit flipped, since their magnitude bits run backwards.
+internal u64
+Sort_GetRadixKey(u08 *Key, type_id KeyType)
+{
+	switch (KeyType) {
+		case TYPEID_U08: return *Key;
+		case TYPEID_U16: return *(u16_unaligned *) Key;
+		case TYPEID_U32: return *(u32_unaligned *) Key;
+		case TYPEID_U64: return *(u64_unaligned *) Key;
+		case TYPEID_S08: return *Key ^ 0x80;
+		case TYPEID_S16: return *(u16_unaligned *) Key ^ 0x8000;
+		case TYPEID_S32: return *(u32_unaligned *) Key ^ 0x80000000;
+		case TYPEID_S64: return *(u64_unaligned *) Key ^ 0x8000000000000000ull;
+		case TYPEID_R32: {
+			u32 Bits = *(u32_unaligned *) Key;
+			return Bits & 0x80000000 ? ~Bits : Bits ^ 0x80000000;
+		}
+		case TYPEID_R64: {
+			u64 Bits = *(u64_unaligned *) Key;
+			u64 Sign = 0x8000000000000000ull;
+			return Bits & Sign ? ~Bits : Bits ^ Sign;
+		}
+		default: Assert(FALSE, "Radix sort keys have to be integers or floats");
+	}
+	return 0;
+}
+
+internal void
+Sort_Move(u08 *Dest, u08 *Src, usize Size)
+{
+	if (Size == 8) *(u64_unaligned *) Dest = *(u64_unaligned *) Src;
+	else if (Size == 4) *(u32_unaligned *) Dest = *(u32_unaligned *) Src;
+	else Mem_Cpy(Dest, Src, Size);
+}
+
+// A stable LSD radix sort on an integer or float key at KeyOffset in each
+// element. It takes a pass per key byte, and skips bytes that every key
+// shares. The elements are copied back and forth through scratch space on
+// the stack, so this is for arrays that fit there.
+internal void
+RadixSort(
+	vptr	Data,
+	usize	ElementSize,
+	usize	ElementCount,
+	usize	KeyOffset,
+	type_id KeyType
+)
+{
+	usize KeySize = 0;
+	switch (KeyType) {
+		case TYPEID_U08:
+		case TYPEID_S08: KeySize = 1; break;
+		case TYPEID_U16:
+		case TYPEID_S16: KeySize = 2; break;
+		case TYPEID_U32:
+		case TYPEID_S32:
+		case TYPEID_R32: KeySize = 4; break;
+		case TYPEID_U64:
+		case TYPEID_S64:
+		case TYPEID_R64: KeySize = 8; break;
+		default: Assert(FALSE, "Radix sort keys have to be integers or floats");
+	}
+	if (ElementCount < 2 || !KeySize) return;
+
+	vptr   Cursor  = Stack_GetCursor();
+	usize  Size	   = ElementSize * ElementCount;
+	u08	  *Scratch = Stack_Allocate(Size);
+	usize *Counts  = Stack_Allocate(KeySize * 256 * sizeof(usize));
+	Mem_Set(Counts, 0, KeySize * 256 * sizeof(usize));
+
+	// Every pass's histogram comes from one read.
+	u08 *Src = Data;
+	for (usize I = 0; I < ElementCount; I++) {
+		u64 Key = Sort_GetRadixKey(Src + I * ElementSize + KeyOffset, KeyType);
+		for (usize B = 0; B < KeySize; B++)
+			Counts[B * 256 + ((Key >> (B * 8)) & 0xFF)]++;
+	}
+
+	u08 *Dest	 = Scratch;
+	u64	 KeyZero = Sort_GetRadixKey(Src + KeyOffset, KeyType);
+	for (usize B = 0; B < KeySize; B++) {
+		usize *Offsets = Counts + B * 256;
+		u32	   Shift   = B * 8;
+		if (Offsets[(KeyZero >> Shift) & 0xFF] == ElementCount) continue;
+
+		usize Offset = 0;
+		for (usize D = 0; D < 256; D++) {
+			usize Count = Offsets[D];
+			Offsets[D]	= Offset;
+			Offset	   += Count;
+		}
+
+		for (usize I = 0; I < ElementCount; I++) {
+			u08	 *Element = Src + I * ElementSize;
+			u64	  Key	  = Sort_GetRadixKey(Element + KeyOffset, KeyType);
+			usize Index	  = Offsets[(Key >> Shift) & 0xFF]++;
+			Sort_Move(Dest + Index * ElementSize, Element, ElementSize);
+		}
+
+		u08 *Temp = Src;
+		Src		  = Dest;
+		Dest	  = Temp;
+	}
+
+	if (Src != Data) Mem_Cpy(Data, Src, Size);
+	Stack_SetCursor(Cursor);
 }
 
 internal usize
 HashMap_MemHash(vptr Data, vptr Param)
 {
-	u32 Hash = 5381;
-	for (usize I = 0; I < (usize) Param; I++)
-		Hash = (Hash << 5) + Hash + ((u08 *) Data)[I];
-	return Hash;
+	return Mem_Hash(Data, (usize) Param, Mem_GetHashSeed());
 }
 
 internal hashmap
@@ -213,15 +619,18 @@ HashMap_InitCustom(
 	hashmap Map;
 	Map.EntrySize = sizeof(usize) + KeySize + ValueSize;
 
-	Map.Capacity = InitialCapacity;
-	Map.Data	 = Heap_Allocate(Heap, Map.EntrySize * Map.Capacity);
+	Map.Capacity	= InitialCapacity;
+	Map.MinCapacity = InitialCapacity;
+	Map.Data		= Heap_Allocate(Heap, Map.EntrySize * Map.Capacity);
 	Mem_Set(Map.Data->Data, 0, Map.Data->Size);
 
 	Map.KeySize		 = KeySize;
 	Map.ValueSize	 = ValueSize;
 	Map.EntryCount	 = 0;
+	Map.DeletedCount = 0;
 	Map.ResizeThresh = ResizeThresh <= 0 ? 0.1f : ResizeThresh;
 	Map.ResizeRate	 = ResizeRate <= 1 ? 1.1f : ResizeRate;
+	Map.ShrinkThresh = 0;
 
 	Map.HashParam = HashFunc ? HashParam : (vptr) (usize) Map.KeySize;
 	Map.Hash	  = HashFunc ? HashFunc : (hash_func) HashMap_MemHash;
@@ -249,32 +658,71 @@ HashMap_Init(heap *Heap, u32 KeySize, u32 ValueSize)
 	);
 }
 
+// Returns the key's entry if it's there. Otherwise, returns the first slot
+// its probe passed that a new entry could go in, which is a tombstone if
+// there was one, or NULL if the map is full. ProbeCountOut gets how many
+// slots were looked at.
 internal vptr
-HashMap_GetRef(hashmap *Map, vptr Key)
+HashMap_FindEntry(
+	hashmap *Map,
+	usize	 Hash,
+	vptr	 Key,
+	b08		*FoundOut,
+	u32		*ProbeCountOut
+)
 {
-	if (Map->EntryCount == 0) return NULL;
-
-	usize Hash = Map->Hash(Key, Map->HashParam);
-	if (Hash < 2) Hash = 2;
+	vptr Available = NULL;
+	u32	 Pow2Cap   = U32_RoundUpPow2(Map->Capacity);
+	u32	 Probes	   = 0;
+	*FoundOut	   = FALSE;
 
-	u32 Pow2Cap = U32_RoundUpPow2(Map->Capacity);
 	for (usize I = 0; I < Pow2Cap; I++) {
 		usize P = (Hash + (I + I * I) / 2) % Pow2Cap;
 		if (P >= Map->Capacity) continue;
+		Probes++;
 
-		vptr   Entry	 = Map->Data->Data + P * Map->EntrySize;
-		usize *EntryHash = (usize *) Entry;
-		if (*EntryHash == HASH_VACANT) break;
-		if (*EntryHash != Hash) continue;
+		vptr  Entry		= Map->Data->Data + P * Map->EntrySize;
+		usize EntryHash = *(usize *) Entry;
+		if (EntryHash == HASH_VACANT) {
+			if (!Available) Available = Entry;
+			break;
+		}
+		if (EntryHash == HASH_DELETED) {
+			if (!Available) Available = Entry;
+			continue;
+		}
+		if (EntryHash != Hash) continue;
 
 		vptr EntryKey = Entry + sizeof(usize);
 		if (Map->Cmp(Key, EntryKey, Map->CmpParam)) continue;
 
-		vptr EntryValue = EntryKey + Map->KeySize;
-		return EntryValue;
+		Available = Entry;
+		*FoundOut = TRUE;
+		break;
 	}
 
-	return NULL;
+	if (ProbeCountOut) *ProbeCountOut = Probes;
+	return Available;
+}
+
+internal usize
+HashMap_GetHash(hashmap *Map, vptr Key)
+{
+	usize Hash = Map->Hash(Key, Map->HashParam);
+	return Hash < 2 ? 2 : Hash;
+}
+
+internal vptr
+HashMap_GetRef(hashmap *Map, vptr Key)
+{
+	if (Map->EntryCount == 0) return NULL;
+
+	b08	  Found;
+	usize Hash  = HashMap_GetHash(Map, Key);
+	vptr  Entry = HashMap_FindEntry(Map, Hash, Key, &Found, NULL);
+	if (!Found) return NULL;
+
+	return Entry + sizeof(usize) + Map->KeySize;
 }
 
 internal b08
@@ -285,6 +733,85 @@ HashMap_Get(hashmap *Map, vptr Key, vptr ValueOut)
 	return !!Value;
 }
 
+// Clears out tombstones without a second table. Each entry goes to the first
+// slot along its probe that isn't settled yet, swapping out any unsettled
+// entry there to be placed next. Settled entries never move, so every slot
+// a lookup passes before reaching its key stays full.
+internal void
+HashMap_RehashInPlace(hashmap *Map)
+{
+	u32	 Pow2Cap = U32_RoundUpPow2(Map->Capacity);
+	u08 *Data	 = Map->Data->Data;
+
+	Stack_Push();
+	u08 *Settled = Stack_Allocate((Map->Capacity + 7) / 8);
+	vptr Swap	 = Stack_Allocate(Map->EntrySize);
+	Mem_Set(Settled, 0, (Map->Capacity + 7) / 8);
+
+	for (usize I = 0; I < Map->Capacity; I++) {
+		usize *Hash = (usize *) (Data + Map->EntrySize * I);
+		if (*Hash == HASH_DELETED) *Hash = HASH_VACANT;
+	}
+
+	for (usize I = 0; I < Map->Capacity;) {
+		vptr  Entry = Data + Map->EntrySize * I;
+		usize Hash	= *(usize *) Entry;
+		if (Hash == HASH_VACANT || (Settled[I / 8] & (1 << I % 8))) {
+			I++;
+			continue;
+		}
+
+		// The probe gets back to this slot at worst, since it's unsettled.
+		usize P = Hash % Pow2Cap, J = 0;
+		while (P >= Map->Capacity || (Settled[P / 8] & (1 << P % 8))) {
+			J++;
+			P = (Hash + (J + J * J) / 2) % Pow2Cap;
+		}
+		Settled[P / 8] |= 1 << P % 8;
+		if (P == I) continue;
+
+		vptr Target = Data + Map->EntrySize * P;
+		Mem_Cpy(Swap, Target, Map->EntrySize);
+		Mem_Cpy(Target, Entry, Map->EntrySize);
+		Mem_Cpy(Entry, Swap, Map->EntrySize);
+	}
+
+	Map->DeletedCount = 0;
+	Stack_Pop();
+}
+
+// Rebuilds the map at the given capacity, which also clears out tombstones.
+internal void
+HashMap_Rehash(hashmap *Map, u32 Capacity)
+{
+	if (Capacity == Map->Capacity) {
+		HashMap_RehashInPlace(Map);
+		return;
+	}
+
+	u32			 OldCapacity = Map->Capacity;
+	heap_handle *OldData	 = Map->Data;
+
+	Map->Capacity	  = Capacity;
+	Map->DeletedCount = 0;
+	Map->Data =
+		Heap_Allocate(Heap_GetHeap(Map->Data), Map->Capacity * Map->EntrySize);
+	Mem_Set(Map->Data->Data, 0, Map->Data->Size);
+
+	for (usize I = 0; I < OldCapacity; I++) {
+		vptr  OldEntry = OldData->Data + Map->EntrySize * I;
+		usize Hash	   = *(usize *) OldEntry;
+		if (Hash < 2) continue;
+
+		b08	 Found;
+		vptr Key   = OldEntry + sizeof(usize);
+		vptr Entry = HashMap_FindEntry(Map, Hash, Key, &Found, NULL);
+		Mem_Cpy(Entry, OldEntry, Map->EntrySize);
+	}
+
+	Heap_Free(OldData);
+}
+
 internal b08
 HashMap_Remove(hashmap *Map, vptr Key, vptr KeyOut, vptr ValueOut)
 {
@@ -299,77 +826,603 @@ HashMap_Remove(hashmap *Map, vptr Key, vptr KeyOut, vptr ValueOut)
 	if (ValueOut) Mem_Cpy(ValueOut, Value, Map->ValueSize);
 	Mem_Set(StoredKey, 0, Map->KeySize + Map->ValueSize);
 
+	Map->EntryCount--;
+	Map->DeletedCount++;
+
+	if (Map->ShrinkThresh > 0 && Map->Capacity > Map->MinCapacity
+		&& (r32) Map->EntryCount / Map->Capacity < Map->ShrinkThresh)
+	{
+		u32 Capacity = (u32) (Map->Capacity / Map->ResizeRate);
+		HashMap_Rehash(Map, MAX(Capacity, Map->MinCapacity));
+	}
+
 	return TRUE;
 }
 
+// Adds the key, or overwrites its value if it's already there. A null value
+// is stored as zeros.
 internal vptr
-HashMap_AddWithHash(hashmap *Map, usize Hash, vptr Key, vptr Value)
+HashMap_Add(hashmap *Map, vptr Key, vptr Value)
 {
-	if (Hash < 2) Hash = 2;
+	b08	  Found;
+	usize Hash  = HashMap_GetHash(Map, Key);
+	vptr  Entry = HashMap_FindEntry(Map, Hash, Key, &Found, NULL);
 
-	u32 Pow2Cap = U32_RoundUpPow2(Map->Capacity);
-	for (usize I = 0; I < Pow2Cap; I++) {
-		usize P = (Hash + (I + I * I) / 2) % Pow2Cap;
-		if (P >= Map->Capacity) continue;
-
-		vptr   Entry	 = Map->Data->Data + P * Map->EntrySize;
-		usize *EntryHash = (usize *) Entry;
-		vptr   EntryKey	 = Entry + sizeof(usize);
-		if (*EntryHash == Hash && Map->Cmp(Key, EntryKey, Map->CmpParam)) break;
-		if (*EntryHash >= 2) continue;
+	if (!Found) {
+		// Tombstones count toward the load, since probes have to step over
+		// them. If the live entries would leave at least half of the load
+		// free, rehashing at the same size is enough to clear them out.
+		u32 Load = Map->EntryCount + Map->DeletedCount + 1;
+		if (!Entry || (r32) Load / Map->Capacity >= Map->ResizeThresh) {
+			u32 Capacity = Map->Capacity;
+			r32 LiveLoad = (r32) Map->EntryCount / Capacity;
+			if (LiveLoad > Map->ResizeThresh / 2)
+				Capacity = (u32) (Capacity * Map->ResizeRate);
+			HashMap_Rehash(Map, Capacity);
+			Entry = HashMap_FindEntry(Map, Hash, Key, &Found, NULL);
+		}
 
+		if (*(usize *) Entry == HASH_DELETED) Map->DeletedCount--;
+		Map->EntryCount++;
 		*(usize *) Entry = Hash;
+		Mem_Cpy(Entry + sizeof(usize), Key, Map->KeySize);
+	}
 
-		Mem_Cpy(EntryKey, Key, Map->KeySize);
+	vptr EntryValue = Entry + sizeof(usize) + Map->KeySize;
+	if (Value) Mem_Cpy(EntryValue, Value, Map->ValueSize);
+	else Mem_Set(EntryValue, 0, Map->ValueSize);
+	return EntryValue;
+}
 
-		vptr EntryValue = EntryKey + Map->KeySize;
-		if (Value) Mem_Cpy(EntryValue, Value, Map->ValueSize);
-		else Mem_Set(EntryValue, 0, Map->ValueSize);
+// The number of slots a lookup of the key looks at.
+internal u32
+HashMap_CountProbes(hashmap *Map, vptr Key)
+{
+	b08 Found;
+	u32 ProbeCount;
+	HashMap_FindEntry(Map, HashMap_GetHash(Map, Key), Key, &Found, &ProbeCount);
+	return ProbeCount;
+}
 
-		return EntryValue;
-	}
+internal void
+HashMap_Free(hashmap *Map)
+{
+	Heap_Free(Map->Data);
+	Mem_Set(Map, 0, sizeof(hashmap));
+}
+
+// Probes a group at a time, stepping by one more group each time, which
+// visits every group when the capacity is a power of two. Returns U32_MAX
+// if the key isn't there.
+internal u32
+FlatMap_Find(flatmap *Map, vptr Key, u64 Hash)
+{
+	u08 *Control = Map->Data->Data;
+	u32	 Mask	 = Map->Capacity - 1;
+	u32	 Pos	 = (Hash >> 7) & Mask;
 
-	return NULL;
+	for (u32 Step = FLATMAP_GROUP_SIZE;; Step += FLATMAP_GROUP_SIZE) {
+		u32 Matches = FlatMap_MatchGroup(Control + Pos, Hash & 0x7F);
+		while (Matches) {
+			u32 Bit;
+			Intrin_BitScanForward64(&Bit, Matches);
+			u32	 Index = (Pos + Bit) & Mask;
+			vptr Entry = FlatMap_GetEntry(Map, Index);
+			if (Map->Cmp(Key, Entry, Map->CmpParam) == EQUAL) return Index;
+			Matches &= Matches - 1;
+		}
+
+		// There's always an empty slot, so the probe ends.
+		if (FlatMap_MatchGroup(Control + Pos, FLATMAP_EMPTY)) return U32_MAX;
+		Pos = (Pos + Step) & Mask;
+	}
 }
 
+// Tables are kept at most 7/8 full, counting deleted slots, so probes always
+// hit an empty slot.
 internal void
-HashMap_Grow(hashmap *Map)
+FlatMap_Resize(flatmap *Map, u32 Capacity)
 {
-	u32 OldCapacity		 = Map->Capacity;
-	Map->Capacity		 = (u32) (Map->Capacity * Map->ResizeRate);
-	heap_handle *OldData = Map->Data;
+	heap_handle *OldData	 = Map->Data;
+	u32			 OldCapacity = Map->Capacity;
 
-	Map->Data =
-		Heap_Allocate(Heap_GetHeap(Map->Data), Map->Capacity * Map->EntrySize);
-	Mem_Set(Map->Data->Data, 0, Map->Data->Size);
+	Map->Capacity	= Capacity;
+	Map->EntryCount = 0;
+	Map->GrowthLeft = Capacity - Capacity / 8;
 
-	for (usize I = 0; I < OldCapacity; I++) {
-		vptr Hash = OldData->Data + Map->EntrySize * I;
-		if (*(usize *) Hash < 2) continue;
-		vptr Key   = Hash + sizeof(usize);
-		vptr Value = Key + Map->KeySize;
-		HashMap_AddWithHash(Map, *(usize *) Hash, Key, Value);
+	heap *Heap		  = Heap_GetHeap(OldData);
+	usize ControlSize = Capacity + FLATMAP_GROUP_SIZE;
+	usize EntriesSize = (usize) Capacity * Map->EntrySize;
+	Map->Data		  = Heap_Allocate(Heap, ControlSize + EntriesSize);
+	Mem_Set(Map->Data->Data, FLATMAP_EMPTY, ControlSize);
+
+	u08 *OldControl = OldData->Data;
+	u08 *OldEntries = OldControl + OldCapacity + FLATMAP_GROUP_SIZE;
+	for (u32 I = 0; I < OldCapacity; I++) {
+		if (OldControl[I] & FLATMAP_EMPTY) continue;
+
+		u08 *Entry = OldEntries + (usize) I * Map->EntrySize;
+		u64	 Hash  = FlatMap_MixHash(Map->Hash(Entry, Map->HashParam));
+		u32	 Index = FlatMap_Insert(Map, Hash);
+		Mem_Cpy(FlatMap_GetEntry(Map, Index), Entry, Map->EntrySize);
 	}
 
 	Heap_Free(OldData);
 }
 
+internal flatmap
+FlatMap_InitCustom(
+	heap	 *Heap,
+	u32		  KeySize,
+	u32		  ValueSize,
+	u32		  InitialCount,
+	hash_func HashFunc,
+	vptr	  HashParam,
+	cmp_func  CmpFunc,
+	vptr	  CmpParam
+)
+{
+	flatmap Map;
+	Map.KeySize	  = KeySize;
+	Map.ValueSize = ValueSize;
+	Map.EntrySize = KeySize + ValueSize;
+
+	// Leave room for the initial count without going over 7/8.
+	u32 Capacity   = (u32) ((u64) InitialCount * 8 / 7 + 1);
+	Map.Capacity   = U32_RoundUpPow2(MAX(Capacity, FLATMAP_GROUP_SIZE));
+	Map.EntryCount = 0;
+	Map.GrowthLeft = Map.Capacity - Map.Capacity / 8;
+
+	usize ControlSize = Map.Capacity + FLATMAP_GROUP_SIZE;
+	usize EntriesSize = (usize) Map.Capacity * Map.EntrySize;
+	Map.Data		  = Heap_Allocate(Heap, ControlSize + EntriesSize);
+	Mem_Set(Map.Data->Data, FLATMAP_EMPTY, ControlSize);
+
+	Map.HashParam = HashFunc ? HashParam : (vptr) (usize) KeySize;
+	Map.Hash	  = HashFunc ? HashFunc : (hash_func) HashMap_MemHash;
+
+	Map.CmpParam = CmpFunc ? CmpParam : (vptr) (usize) KeySize;
+	Map.Cmp		 = CmpFunc ? CmpFunc : (cmp_func) Mem_Cmp;
+
+	return Map;
+}
+
+internal flatmap
+FlatMap_Init(heap *Heap, u32 KeySize, u32 ValueSize)
+{
+	return FlatMap_InitCustom(
+		Heap,
+		KeySize,
+		ValueSize,
+		0,
+		NULL,
+		NULL,
+		NULL,
+		NULL
+	);
+}
+
 internal vptr
-HashMap_Add(hashmap *Map, vptr Key, vptr Value)
+FlatMap_GetRef(flatmap *Map, vptr Key)
 {
-	Map->EntryCount++;
-	if ((float) Map->EntryCount / Map->Capacity >= Map->ResizeThresh)
-		HashMap_Grow(Map);
+	if (!Map->EntryCount) return NULL;
 
-	usize Hash = Map->Hash(Key, Map->HashParam);
-	return HashMap_AddWithHash(Map, Hash, Key, Value);
+	u64 Hash  = FlatMap_MixHash(Map->Hash(Key, Map->HashParam));
+	u32 Index = FlatMap_Find(Map, Key, Hash);
+	if (Index == U32_MAX) return NULL;
+	return FlatMap_GetEntry(Map, Index) + Map->KeySize;
+}
+
+internal b08
+FlatMap_Get(flatmap *Map, vptr Key, vptr ValueOut)
+{
+	vptr Value = FlatMap_GetRef(Map, Key);
+	if (Value && ValueOut) Mem_Cpy(ValueOut, Value, Map->ValueSize);
+	return !!Value;
+}
+
+// Adds the key, or overwrites its value if it's already there. A null value
+// is stored as zeros.
+internal vptr
+FlatMap_Add(flatmap *Map, vptr Key, vptr Value)
+{
+	u64 Hash  = FlatMap_MixHash(Map->Hash(Key, Map->HashParam));
+	u32 Index = FlatMap_Find(Map, Key, Hash);
+
+	if (Index == U32_MAX) {
+		// When most of the used slots are deleted, rehashing at the same
+		// size is enough to clear them out.
+		if (!Map->GrowthLeft) {
+			u32 Capacity = Map->Capacity;
+			if (Map->EntryCount >= Capacity * 7 / 16) Capacity *= 2;
+			FlatMap_Resize(Map, Capacity);
+		}
+
+		Index = FlatMap_Insert(Map, Hash);
+		Mem_Cpy(FlatMap_GetEntry(Map, Index), Key, Map->KeySize);
+	}
+
+	u08 *EntryValue = FlatMap_GetEntry(Map, Index) + Map->KeySize;
+	if (Value) Mem_Cpy(EntryValue, Value, Map->ValueSize);
+	else Mem_Set(EntryValue, 0, Map->ValueSize);
+	return EntryValue;
+}
+
+internal b08
+FlatMap_Remove(flatmap *Map, vptr Key, vptr KeyOut, vptr ValueOut)
+{
+	if (!Map->EntryCount) return FALSE;
+
+	u64 Hash  = FlatMap_MixHash(Map->Hash(Key, Map->HashParam));
+	u32 Index = FlatMap_Find(Map, Key, Hash);
+	if (Index == U32_MAX) return FALSE;
+
+	u08 *Entry = FlatMap_GetEntry(Map, Index);
+	if (KeyOut) Mem_Cpy(KeyOut, Entry, Map->KeySize);
+	if (ValueOut) Mem_Cpy(ValueOut, Entry + Map->KeySize, Map->ValueSize);
+
+	// If every group that covers this slot has seen an empty slot on both
+	// sides of it, no probe could have passed it, so it can go back to
+	// empty instead of leaving a tombstone.
+	u08 *Control = Map->Data->Data;
+	u32	 Mask	 = Map->Capacity - 1;
+	u32	 Before	 = FlatMap_MatchGroup(
+		  Control + ((Index - FLATMAP_GROUP_SIZE) & Mask),
+		  FLATMAP_EMPTY
+	  );
+	u32 After = FlatMap_MatchGroup(Control + Index, FLATMAP_EMPTY);
+
+	b08 WasNeverFull = FALSE;
+	if (Before && After) {
+		u32 First, Last;
+		Intrin_BitScanForward64(&First, After);
+		Intrin_BitScanReverse32(&Last, Before);
+		WasNeverFull = First + (FLATMAP_GROUP_SIZE - 1 - Last)
+					 < FLATMAP_GROUP_SIZE;
+	}
+
+	if (WasNeverFull) {
+		FlatMap_SetControl(Map, Index, FLATMAP_EMPTY);
+		Map->GrowthLeft++;
+	} else {
+		FlatMap_SetControl(Map, Index, FLATMAP_DELETED);
+	}
+	Map->EntryCount--;
+	return TRUE;
 }
 
 internal void
-HashMap_Free(hashmap *Map)
+FlatMap_Free(flatmap *Map)
 {
 	Heap_Free(Map->Data);
-	Mem_Set(Map, 0, sizeof(hashmap));
+	Mem_Set(Map, 0, sizeof(flatmap));
+}
+
+// For the tests and benchmarks below.
+DEFINE_FLATMAP(Set_TestMap, u32, u32)
+
+global usize Set_TestCmpCount;
+
+internal s08
+Set_TestCmpU32(vptr A, vptr B)
+{
+	u32 X = *(u32 *) A;
+	u32 Y = *(u32 *) B;
+	Set_TestCmpCount++;
+	return X < Y ? LESS : X > Y ? GREATER : EQUAL;
 }
 
+#ifndef REGION_SET_TESTS
+
+#define SET_TESTS                                                             \
+	TEST(QuickSort, HandlesPatterns, (                                        \
+		u32 Count = 10000, Log = 14;                                          \
+		u32 *Data = Stack_Allocate(Count * sizeof(u32));                      \
+		for (u32 Pattern = 0; Pattern < 6; Pattern++) {                       \
+			u32 Seed = 1, Sum = 0;                                            \
+			for (u32 I = 0; I < Count; I++) {                                 \
+				Seed ^= Seed << 13, Seed ^= Seed >> 17, Seed ^= Seed << 5;    \
+				u32 Values[] = { Seed, I, Count - I, 7, Seed % 4,             \
+								 I < Count / 2 ? I : Count - I };             \
+				Data[I]	 = Values[Pattern];                                   \
+				Sum		+= Data[I];                                           \
+			}                                                                 \
+			Set_TestCmpCount = 0;                                             \
+			QuickSort(Data, sizeof(u32), Count, Set_TestCmpU32);              \
+			Assert(Set_TestCmpCount < 4 * Count * Log);                       \
+			for (u32 I = 0; I < Count; I++) {                                 \
+				Assert(I == 0 || Data[I - 1] <= Data[I]);                     \
+				Sum -= Data[I];                                               \
+			}                                                                 \
+			Assert(Sum == 0);                                                 \
+		}                                                                     \
+	))                                                                        \
+	TEST(QuickSort, MovesWholeElements, (                                     \
+		/* Twelve bytes, so swaps take a word and a half */                   \
+		typedef struct element { u32 Key, A, B; } element;                    \
+		u32 Count = 5000, Seed = 1;                                           \
+		element *Data = Stack_Allocate(Count * sizeof(element));              \
+		for (u32 I = 0; I < Count; I++) {                                     \
+			Seed ^= Seed << 13, Seed ^= Seed >> 17, Seed ^= Seed << 5;        \
+			Data[I] = (element){ Seed, ~Seed, Seed * 3 };                     \
+		}                                                                     \
+		QuickSort(Data, sizeof(element), Count, Set_TestCmpU32);              \
+		for (u32 I = 0; I < Count; I++) {                                     \
+			Assert(I == 0 || Data[I - 1].Key <= Data[I].Key);                 \
+			Assert(Data[I].A == ~Data[I].Key && Data[I].B == Data[I].Key * 3); \
+		}                                                                     \
+	))                                                                        \
+	TEST(RadixSort, SortsKeysStably, (                                        \
+		typedef struct element { u32 Index; s32 Int; r32 Float; } element;    \
+		u32 Count = 5000, Seed = 1;                                           \
+		element *Data = Stack_Allocate(Count * sizeof(element));              \
+		for (u32 I = 0; I < Count; I++) {                                     \
+			Seed ^= Seed << 13, Seed ^= Seed >> 17, Seed ^= Seed << 5;        \
+			s32 Value = (s32) (Seed % 64) - 32;                               \
+			Data[I]	  = (element){ 0, Value * 100000, Value * 0.5f };         \
+		}                                                                     \
+		for (u32 Key = 0; Key < 2; Key++) {                                   \
+			for (u32 I = 0; I < Count; I++) Data[I].Index = I;                \
+			usize	Offset = Key ? OFFSET_OF(element, Float)                  \
+								 : OFFSET_OF(element, Int);                   \
+			type_id Type   = Key ? TYPEID_R32 : TYPEID_S32;                   \
+			RadixSort(Data, sizeof(element), Count, Offset, Type);            \
+			for (u32 I = 1; I < Count; I++) {                                 \
+				element *Prev = Data + I - 1, *Curr = Data + I;               \
+				Assert(Prev->Int <= Curr->Int && Prev->Float <= Curr->Float); \
+				if (Prev->Int == Curr->Int) Assert(Prev->Index < Curr->Index); \
+			}                                                                 \
+		}                                                                     \
+	))                                                                        \
+	TEST(FlatMap_Add, MatchesReference, (                                     \
+		u32 HeapSize = 4 * 1024 * 1024;                                       \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		flatmap Map = FlatMap_Init(Heap, sizeof(u32), sizeof(u32));           \
+		u32 *Values = Stack_Allocate(4096 * sizeof(u32));                     \
+		Mem_Set(Values, 0, 4096 * sizeof(u32));                               \
+                                                                              \
+		u32 Count = 0, Seed = 1;                                              \
+		for (u32 I = 0; I < 200000; I++) {                                    \
+			Seed ^= Seed << 13, Seed ^= Seed >> 17, Seed ^= Seed << 5;        \
+			u32 Key = Seed % 4096;                                            \
+			if (Seed & 0x10000) {                                             \
+				b08 Removed = FlatMap_Remove(&Map, &Key, NULL, NULL);         \
+				Assert(Removed == !!Values[Key]);                             \
+				Count -= Removed;                                             \
+				Values[Key] = 0;                                              \
+			} else {                                                          \
+				u32 Value = I + 1;                                            \
+				Count += !Values[Key];                                        \
+				FlatMap_Add(&Map, &Key, &Value);                              \
+				Values[Key] = Value;                                          \
+			}                                                                 \
+			Assert(Map.EntryCount == Count);                                  \
+		}                                                                     \
+                                                                              \
+		for (u32 Key = 0; Key < 4096; Key++) {                                \
+			u32 Value = 0;                                                    \
+			FlatMap_Get(&Map, &Key, &Value);                                  \
+			Assert(Value == Values[Key]);                                     \
+		}                                                                     \
+		u32 Seen = 0;                                                         \
+		FLATMAP_FOREACH (I, u32, Key, u32, Value, &Map) {                     \
+			Assert(Values[Key] == Value);                                     \
+			Seen++;                                                           \
+		}                                                                     \
+		Assert(Seen == Count);                                                \
+		FlatMap_Free(&Map);                                                   \
+	))                                                                        \
+	TEST(FlatMap_Remove, ReusesSlots, (                                       \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		flatmap Map = FlatMap_Init(Heap, sizeof(u32), sizeof(u32));           \
+		for (u32 I = 0; I < 100000; I++) {                                    \
+			u32 Key = I % 1000;                                               \
+			FlatMap_Add(&Map, &Key, NULL);                                    \
+			if (I >= 10) {                                                    \
+				Key = (I - 10) % 1000;                                        \
+				FlatMap_Remove(&Map, &Key, NULL, NULL);                       \
+			}                                                                 \
+		}                                                                     \
+		Assert(Map.EntryCount == 10 && Map.Capacity == 16);                   \
+		FlatMap_Free(&Map);                                                   \
+	))                                                                        \
+	TEST(DEFINE_FLATMAP, MatchesGenericFunctions, (                           \
+		u32 HeapSize = 1024 * 1024;                                           \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		flatmap Map = Set_TestMap_Init(Heap, 0);                              \
+		u32 *Values = Stack_Allocate(4096 * sizeof(u32));                     \
+		Mem_Set(Values, 0, 4096 * sizeof(u32));                               \
+		u32 Seed = 1;                                                         \
+		for (u32 I = 0; I < 100000; I++) {                                    \
+			Seed ^= Seed << 13, Seed ^= Seed >> 17, Seed ^= Seed << 5;        \
+			u32 Key = Seed % 4096, Value = I + 1;                             \
+			/* Both kinds of call share one table */                          \
+			if (Seed & 0x10000) {                                             \
+				if (Seed & 0x20000) Set_TestMap_Remove(&Map, Key, NULL);      \
+				else FlatMap_Remove(&Map, &Key, NULL, NULL);                  \
+				Values[Key] = 0;                                              \
+			} else {                                                          \
+				if (Seed & 0x20000) Set_TestMap_Add(&Map, Key, Value);        \
+				else FlatMap_Add(&Map, &Key, &Value);                         \
+				Values[Key] = Value;                                          \
+			}                                                                 \
+		}                                                                     \
+		for (u32 Key = 0; Key < 4096; Key++) {                                \
+			u32 Typed = 0, Generic = 0;                                       \
+			b08 Found = Set_TestMap_Get(&Map, Key, &Typed);                   \
+			FlatMap_Get(&Map, &Key, &Generic);                                \
+			Assert(Found == !!Values[Key]);                                   \
+			Assert(Typed == Values[Key] && Generic == Values[Key]);           \
+		}                                                                     \
+		FlatMap_Free(&Map);                                                   \
+	))                                                                        \
+	TEST(HashMap_Add, OverwritesExistingKeys, (                               \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		/* Hashing none of the key makes every key collide */                 \
+		hashmap Map = HashMap_InitCustom(                                     \
+			Heap, sizeof(u32), sizeof(u32), 64, 0.5f, 2.0f,                   \
+			(hash_func) HashMap_MemHash, (vptr) 0, NULL, NULL                 \
+		);                                                                    \
+		for (u32 I = 0; I < 20; I++) {                                        \
+			u32 Key = I % 10, Value = I;                                      \
+			HashMap_Add(&Map, &Key, &Value);                                  \
+		}                                                                     \
+		Assert(Map.EntryCount == 10);                                         \
+		for (u32 Key = 0; Key < 10; Key++) {                                  \
+			u32 Value = 0;                                                    \
+			HashMap_Get(&Map, &Key, &Value);                                  \
+			Assert(Value == Key + 10);                                        \
+		}                                                                     \
+		HashMap_Free(&Map);                                                   \
+	))                                                                        \
+	TEST(HashMap_Remove, ReclaimsTombstones, (                                \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		hashmap Map = HashMap_Init(Heap, sizeof(u32), sizeof(u32));           \
+		heap_handle *Data = Map.Data;                                         \
+		for (u32 I = 0; I < 100000; I++) {                                    \
+			u32 Key = I;                                                      \
+			HashMap_Add(&Map, &Key, NULL);                                    \
+			if (I >= 10) {                                                    \
+				Key = I - 10;                                                 \
+				b08 Removed = HashMap_Remove(&Map, &Key, NULL, NULL);         \
+				Assert(Removed);                                              \
+			}                                                                 \
+			Assert(Map.EntryCount + Map.DeletedCount < 32);                   \
+			/* Clearing tombstones at the same size happens in place */       \
+			Assert(Map.Data == Data);                                         \
+		}                                                                     \
+		Assert(Map.EntryCount == 10 && Map.Capacity == 64);                   \
+		for (u32 Key = 100000 - 10; Key < 100000; Key++)                      \
+			Assert(HashMap_GetRef(&Map, &Key));                               \
+		HashMap_Free(&Map);                                                   \
+	))                                                                        \
+	TEST(HashMap_Remove, ShrinksToMinimum, (                                  \
+		u32 HeapSize = 1024 * 1024;                                           \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		hashmap Map = HashMap_Init(Heap, sizeof(u32), sizeof(u32));           \
+		Map.ShrinkThresh = 0.125f;                                            \
+		for (u32 Key = 0; Key < 10000; Key++) HashMap_Add(&Map, &Key, &Key);  \
+		Assert(Map.Capacity >= 16384);                                        \
+		for (u32 Key = 0; Key < 10000; Key++) {                               \
+			u32 Value   = 0;                                                  \
+			b08 Removed = HashMap_Remove(&Map, &Key, NULL, &Value);           \
+			Assert(Removed && Value == Key);                                  \
+		}                                                                     \
+		Assert(Map.EntryCount == 0 && Map.Capacity == 64);                    \
+		HashMap_Free(&Map);                                                   \
+	))                                                                        \
+	//
+
+#endif
+
+#ifndef REGION_SET_BENCHMARKS
+
+#define SET_BENCHMARKS                                                        \
+	BENCH(HashMap_Add, Churn, (                                               \
+		usize HeapSize = 16 * 1024 * 1024;                                    \
+		vptr  HeapBase = Platform_AllocateMemory(HeapSize);                   \
+		heap *Heap     = Heap_Init(HeapBase, HeapSize);                       \
+		u32 Windows[] = { 16, 1024, 65536 };                                  \
+		for (u32 W = 0; W < 3; W++) {                                         \
+			hashmap Map = HashMap_Init(Heap, sizeof(u32), sizeof(u32));       \
+			u32 Window = Windows[W], Cycles = 4 * 1024 * 1024;                \
+			timestamp Start = Platform_GetTimestamp();                        \
+			for (u32 I = 0; I < Cycles; I++) {                                \
+				u32 Key = I;                                                  \
+				HashMap_Add(&Map, &Key, &Key);                                \
+				if (I >= Window) {                                            \
+					Key = I - Window;                                         \
+					HashMap_Remove(&Map, &Key, NULL, NULL);                   \
+				}                                                             \
+			}                                                                 \
+			timestamp End = Platform_GetTimestamp();                          \
+			r64 Time = Platform_GetSecondsElapsed(Start, End);                \
+			u64 Probes = 0;                                                   \
+			for (u32 Key = Cycles - Window; Key < Cycles; Key++)              \
+				Probes += HashMap_CountProbes(&Map, &Key);                    \
+			Printf(                                                           \
+				"%u live keys: capacity %u, %.2f probes, %.1f Mops/s\n",      \
+				Window,                                                       \
+				Map.Capacity,                                                 \
+				(r64) Probes / Window,                                        \
+				Cycles / Time / 1e6                                           \
+			);                                                                \
+			HashMap_Free(&Map);                                               \
+		}                                                                     \
+		Platform_FreeMemory(HeapBase, HeapSize);                              \
+	))                                                                        \
+	BENCH(FlatMap_Get, Typed, (                                               \
+		usize HeapSize = 16 * 1024 * 1024;                                    \
+		vptr  HeapBase = Platform_AllocateMemory(HeapSize);                   \
+		heap *Heap     = Heap_Init(HeapBase, HeapSize);                       \
+		u32 Sizes[] = { 16, 1024, 65536 };                                    \
+		for (u32 S = 0; S < 3; S++) {                                         \
+			flatmap Map = Set_TestMap_Init(Heap, Sizes[S]);                   \
+			for (u32 Key = 0; Key < Sizes[S]; Key++)                          \
+				Set_TestMap_Add(&Map, Key * 7919, Key);                       \
+			u32 Lookups = 16 * 1024 * 1024;                                   \
+			r64 Rates[2];                                                     \
+			for (u32 Typed = 0; Typed < 2; Typed++) {                         \
+				volatile u32 Sink = 0;                                        \
+				timestamp Start = Platform_GetTimestamp();                    \
+				for (u32 I = 0; I < Lookups; I++) {                           \
+					u32 Key = (I % Sizes[S]) * 7919, Value = 0;               \
+					if (Typed) Set_TestMap_Get(&Map, Key, &Value);            \
+					else FlatMap_Get(&Map, &Key, &Value);                     \
+					Sink += Value;                                            \
+				}                                                             \
+				timestamp End = Platform_GetTimestamp();                      \
+				Rates[Typed] =                                                \
+					Lookups / Platform_GetSecondsElapsed(Start, End) / 1e6;   \
+			}                                                                 \
+			Printf(                                                           \
+				"%u keys: generic %.1f, typed %.1f Mlookups/s\n",             \
+				Sizes[S],                                                     \
+				Rates[0],                                                     \
+				Rates[1]                                                      \
+			);                                                                \
+			FlatMap_Free(&Map);                                               \
+		}                                                                     \
+		Platform_FreeMemory(HeapBase, HeapSize);                              \
+	))                                                                        \
+	BENCH(QuickSort, Patterns, (                                              \
+		u32	 MaxCount = 1 << 20;                                              \
+		u32 *Data	  = Platform_AllocateMemory(MaxCount * sizeof(u32));      \
+		c08 *Names[]  = { "random", "sorted", "reversed", "few unique" };     \
+		for (u32 Count = 1 << 10; Count <= MaxCount; Count <<= 5) {           \
+			for (u32 Pattern = 0; Pattern < 4; Pattern++) {                   \
+				r64 Rates[2];                                                 \
+				for (u32 Radix = 0; Radix < 2; Radix++) {                     \
+					u32 Seed = 1;                                             \
+					for (u32 I = 0; I < Count; I++) {                         \
+						Seed ^= Seed << 13, Seed ^= Seed >> 17;               \
+						Seed ^= Seed << 5;                                    \
+						u32 Values[] = { Seed, I, Count - I, Seed % 16 };     \
+						Data[I]		 = Values[Pattern];                       \
+					}                                                         \
+					timestamp Start = Platform_GetTimestamp();                \
+					if (Radix) RadixSort(Data, 4, Count, 0, TYPEID_U32);      \
+					else QuickSort(Data, 4, Count, Set_TestCmpU32);           \
+					timestamp End = Platform_GetTimestamp();                  \
+					Rates[Radix]  =                                           \
+						Count / Platform_GetSecondsElapsed(Start, End) / 1e6; \
+				}                                                             \
+				Printf(                                                       \
+					"%u %s: introsort %.1f, radix %.1f Melements/s\n",        \
+					Count,                                                    \
+					CString(Names[Pattern]),                                  \
+					Rates[0],                                                 \
+					Rates[1]                                                  \
+				);                                                            \
+			}                                                                 \
+		}                                                                     \
+		Platform_FreeMemory(Data, MaxCount * sizeof(u32));                    \
+	))                                                                        \
+	//
+
+#endif
+
 #endif
@@ -403,8 +403,12 @@ typedef struct fstring_format_list {
 	INTERN(fstring_format_status, FString_WriteFloat,             fstring_format *Format, string Buffer) \
 	INTERN(fstring_format_status, FString_WriteFormat,            fstring_format *Format, string Buffer) \
 	INTERN(fstring_format_status, FString_WriteFormats,           fstring_format_list *FormatList, string Buffer) \
+	INTERN(string,                FString_OutOfSpace,             string Format) \
+	INTERN(string,                FString_Format,                 arena *Arena, string Format, va_list Args) \
 	EXPORT(string,                FVString,                       string Format, va_list Args) \
 	EXPORT(string,                FString,                        string Format, ...) \
+	EXPORT(string,                FVStringA,                      arena *Arena, string Format, va_list Args) \
+	EXPORT(string,                FStringA,                       arena *Arena, string Format, ...) \
 	EXPORT(void,                  FPrint,                         string Format, ...) \
 	//
 
@@ -526,6 +530,39 @@ String_TrimWhitespace(string Str)
 internal usize
 String_FindCharFromLeft(string Str, c32 Target)
 {
+	if (!Str.Text) return (usize) -1;
+
+	// ASCII drops the high bit, so a byte with it set matches too. The second
+	// search stops at the first match, so it costs nothing on clean text.
+	if (Str.Encoding == STRING_ENCODING_ASCII) {
+		if (Target > 0x7F) return (usize) -1;
+		usize Index = Mem_FindByte(Str.Text, Target, Str.Length);
+		Index		= Mem_FindByte(Str.Text, Target | 0x80, Index);
+		return (Index < Str.Length) ? Index : (usize) -1;
+	}
+
+	// A UTF-8 lead byte can't appear inside another sequence, so it's enough
+	// to scan for the lead byte and check the rest. Replacement characters
+	// also come from malformed text, so those take the slow path.
+	b08 IsValid = Target <= 0x10FFFF && (Target < 0xD800 || Target > 0xDFFF);
+	if (Str.Encoding == STRING_ENCODING_UTF8 && IsValid && Target != 0xFFFD) {
+		c08	  Bytes[4];
+		usize Size =
+			String_WriteCodepoint(CLEString(Bytes, 4, Str.Encoding), Target);
+
+		usize Offset = 0;
+		while (Offset < Str.Length) {
+			usize Remaining = Str.Length - Offset;
+			usize Index		= Offset
+						+ Mem_FindByte(Str.Text + Offset, Bytes[0], Remaining);
+			if (Index + Size > Str.Length) break;
+			if (Mem_Cmp(Str.Text + Index + 1, Bytes + 1, Size - 1) == EQUAL)
+				return Index;
+			Offset = Index + 1;
+		}
+		return (usize) -1;
+	}
+
 	STRING_FOREACH (I, C, Cursor, Str)
 		if (C == Target) return (usize) (Cursor.Text - Str.Text);
 	return (usize) -1;
@@ -544,17 +581,16 @@ String_FindCharFromLeft(string Str, c32 Target)
 internal string
 String_SplitLeftByCodepoint(string *Str, c32 Codepoint)
 {
-	string Left = *Str;
+	string Left	 = *Str;
+	usize  Index = String_FindCharFromLeft(Left, Codepoint);
 
-	STRING_FOREACH (I, C, Cursor, Left) {
-		if (C == Codepoint) {
-			*Str = Cursor;
-			String_NextCodepoint(Str);
+	if (Index != (usize) -1) {
+		String_BumpBytes(Str, Index);
+		String_NextCodepoint(Str);
 
-			Left.Length = (usize) (Cursor.Text - Left.Text);
-			Left.Count	= I;
-			return Left;
-		}
+		Left.Length = Index;
+		Left.Count	= 0;
+		return Left;
 	}
 
 	Str->Length = 0;
@@ -598,15 +634,13 @@ String_Fill(string Dest, u32 Codepoint, usize Count)
 internal usize
 String_Hash(string S)
 {
-	u32 Hash = 5381;
-	for (usize I = 0; I < S.Length; I++) Hash = (Hash << 5) + Hash + S.Text[I];
-	return Hash;
+	return Mem_Hash(S.Text, S.Length, Mem_GetHashSeed());
 }
 
 internal usize
 String_HashPtr(string *S, vptr _)
 {
-	if (!S) return 5381;
+	if (!S) return 0;
 	return String_Hash(*S);
 }
 
@@ -2914,17 +2948,29 @@ FString_WriteFormats(fstring_format_list *FormatList, string Buffer)
 	return TooSmall ? FSTRING_FORMAT_BUFFER_TOO_SMALL : FSTRING_FORMAT_VALID;
 }
 
+// Arenas have a fixed size, so they can run out where the stack wouldn't.
+internal string
+FString_OutOfSpace(string Format)
+{
+	Platform_WriteError(CStringL("Not enough arena space to format\n"), FALSE);
+	string Result	= EString();
+	Result.Encoding = Format.Encoding;
+	return Result;
+}
+
 /// @brief Format the provided template string with the given args.
+/// @param[in] Arena The arena to allocate the result in, or NULL to use the
+/// stack. The parsed formats always go on the stack.
 /// @param[in] Format A template string to insert the parameters into. See
 /// `FString` for more details.
 /// @param[in] Args A va_list of parameters to insert into the format
 /// string. These must align with the patterns in `Format` or stack
 /// corruption may occur.
-/// @return A stack-backed formatted string. If any errors occurred during
-/// parsing, this will be a copy of the format string, and an error will be
-/// logged.
+/// @return The formatted string. If any errors occurred during parsing, this
+/// will be a copy of the format string, and an error will be logged. If the
+/// arena is too full, this will be empty, and an error will be logged.
 internal string
-FVString(string Format, va_list Args)
+FString_Format(arena *Arena, string Format, va_list Args)
 {
 	fstring_format_list	  FormatList;
 	fstring_format_status Status;
@@ -2963,10 +3009,11 @@ FVString(string Format, va_list Args)
 		goto failed;
 	}
 
-	// Allocate the buffer on the stack. We might support other allocators
-	// later.
+	// Allocate the buffer.
 	Buffer.Length = FormatList.TotalTextSize;
-	Buffer.Text	  = Stack_Allocate(Buffer.Length);
+	Buffer.Text	  = Arena ? Arena_Allocate(Arena, Buffer.Length)
+						  : Stack_Allocate(Buffer.Length);
+	if (!Buffer.Text) return FString_OutOfSpace(Format);
 
 	// Write into the buffer and return it.
 	Status = FString_WriteFormats(&FormatList, Buffer);
@@ -3010,11 +3057,46 @@ failed:
 	);
 
 	string Result = OriginalFormat;
-	Result.Text	  = Stack_Allocate(Result.Length);
+	Result.Text	  = Arena ? Arena_Allocate(Arena, Result.Length)
+						  : Stack_Allocate(Result.Length);
+	if (!Result.Text) return FString_OutOfSpace(OriginalFormat);
 	Mem_Cpy(Result.Text, OriginalFormat.Text, Result.Length);
 	return Result;
 }
 
+/// @brief Format the provided template string with the given args.
+/// @param[in] Format A template string to insert the parameters into. See
+/// `FString` for more details.
+/// @param[in] Args A va_list of parameters to insert into the format
+/// string. These must align with the patterns in `Format` or stack
+/// corruption may occur.
+/// @return A stack-backed formatted string. If any errors occurred during
+/// parsing, this will be a copy of the format string, and an error will be
+/// logged.
+internal string
+FVString(string Format, va_list Args)
+{ return FString_Format(NULL, Format, Args); }
+
+/// @brief Same as `FVString`, but the result is allocated in an arena, and
+/// nothing is left on the stack.
+/// @param[in] Arena The arena to allocate the result in.
+/// @param[in] Format A template string to insert the parameters into. See
+/// `FString` for more details.
+/// @param[in] Args A va_list of parameters to insert into the format
+/// string.
+/// @return An arena-backed formatted string, or an empty one if the arena is
+/// too full.
+internal string
+FVStringA(arena *Arena, string Format, va_list Args)
+{
+	Assert(Arena);
+
+	Stack_Push();
+	string Result = FString_Format(Arena, Format, Args);
+	Stack_Pop();
+	return Result;
+}
+
 /// @brief Format the provided template string with the given args.
 /// @param[in] Format A template string to insert the parameters into. It
 /// can be a string of any encoding, but special character sequences
@@ -3173,6 +3255,25 @@ FString(string Format, ...)
 	return Result;
 }
 
+/// @brief Same as `FString`, but the result is allocated in an arena, so it
+/// outlives the caller's `Stack_Pop`.
+/// @param[in] Arena The arena to allocate the result in.
+/// @param[in] Format A template string to insert the parameters into.
+/// @param[in] ... The parameters to insert into the format string.
+/// @return An arena-backed formatted string, or an empty one if the arena is
+/// too full.
+internal string
+FStringA(arena *Arena, string Format, ...)
+{
+	va_list Args;
+	VA_Start(Args, Format);
+
+	string Result = FVStringA(Arena, Format, Args);
+
+	VA_End(Args);
+	return Result;
+}
+
 internal void
 FPrint(string Format, ...)
 {
@@ -3197,6 +3298,33 @@ FPrint(string Format, ...)
 #ifndef SECTION_STRING_TESTS
 
 #define STRING_TESTS                                                                                        \
+	TEST(FStringA, LeavesNothingOnTheStack, (                                                               \
+		arena *Arena  = Arena_Reserve(64 * 1024);                                                           \
+		vptr   Cursor = Stack_GetCursor();                                                                  \
+		string Result = FStringA(Arena, CStringL("%d apples"), 12);                                         \
+		Assert(Stack_GetCursor() == Cursor);                                                                \
+		Assert(String_Cmp(Result, CStringL("12 apples")) == 0);                                             \
+		Arena_Free(Arena);                                                                                  \
+	))                                                                                                      \
+	TEST(FStringA, IsEmptyWhenTheArenaIsFull, (                                                             \
+		arena *Arena = Arena_Reserve(64 * 1024);                                                            \
+		Arena_Allocate(Arena, Arena->End - Arena->Cursor);                                                  \
+		string Result = FStringA(Arena, CStringL("%d apples"), 12);                                         \
+		Assert(Result.Length == 0);                                                                         \
+		Arena_Free(Arena);                                                                                  \
+	))                                                                                                      \
+	TEST(String_FindCharFromLeft, MatchesCodepoints, (                                                      \
+		string Str = CStringL_UTF8("a\xC3\xA9 long string with a \xE2\x82\xAC sign,");                      \
+		Assert(String_FindCharFromLeft(Str, 0xE9) == 1);                                                    \
+		Assert(String_FindCharFromLeft(Str, 0x20AC) == 23);                                                 \
+		Assert(String_FindCharFromLeft(Str, ',') == 31);                                                    \
+		Assert(String_FindCharFromLeft(Str, 'z') == (usize) -1);                                            \
+		string Ascii = CStringL("one\xA0two three");                                                        \
+		Assert(String_FindCharFromLeft(Ascii, ' ') == 3);                                                   \
+		String_SplitLeftByCodepoint(&Ascii, ' ');                                                           \
+		String_SplitLeftByCodepoint(&Ascii, ' ');                                                           \
+		Assert(String_Cmp(Ascii, CStringL("three")) == 0);                                                  \
+	))                                                                                                      \
 	TEST(FString_ParseFormatInt, ReportsNotPresentOnNonDigit, (                                             \
 	    fstring_format_status Result = FString_ParseFormatInt(NULL, NULL);                                  \
 		Assert(Result == FSTRING_FORMAT_INT_NOT_PRESENT);                                                   \
@@ -11,8 +11,25 @@
 
 typedef struct thread_handle thread_handle;
 
+// Entries live in a chain of open-addressed tables keyed by thread id. Slots
+// are claimed with a compare-exchange and never move, so threads can look
+// themselves up without a lock, and an entry pointer stays valid until its
+// thread is removed. Removed slots are reused by later claims. When a table
+// has half its slots in use, registration moves on to the next one, which is
+// twice as large.
+typedef struct tls_table {
+	struct tls_table *Next;
+
+	u32 Capacity;
+	u32 UsedCount;
+
+	// s32 ThreadIds[Capacity], then the entries
+} tls_table;
+
 typedef struct tls {
-	hashmap ThreadMap;
+	heap	  *Heap;
+	usize	   EntrySize;
+	tls_table *Tables;
 } tls;
 
 #define TLS_FUNCS \
@@ -26,6 +43,37 @@ typedef struct tls {
 
 #ifdef INCLUDE_SOURCE
 
+#define TLS_INITIAL_CAPACITY 64
+#define TLS_REMOVED			 -1
+
+// Left on a pending claim that lost to an earlier one. Only the claim's owner
+// turns it back into a removed slot, so it can't be claimed again while the
+// owner still thinks it holds it.
+#define TLS_CLEARED -2
+
+// Set on a thread id while its claim is being checked against other claims
+// for the same thread. Thread ids never get this high.
+#define TLS_PENDING 0x40000000
+
+internal usize
+Tls_GetEntriesOffset(u32 Capacity)
+{ return ALIGN_UP(sizeof(tls_table) + Capacity * sizeof(s32), 16); }
+
+internal usize
+Tls_GetEntryStride(tls *Tls)
+{ return ALIGN_UP(Tls->EntrySize, 16); }
+
+internal tls_table *
+Tls_CreateTable(tls *Tls, u32 Capacity)
+{
+	usize Size = Tls_GetEntriesOffset(Capacity) + Capacity * Tls_GetEntryStride(Tls);
+
+	tls_table *Table = Heap_AllocateA(Tls->Heap, Size);
+	Mem_Set(Table, 0, Size);
+	Table->Capacity = Capacity;
+	return Table;
+}
+
 internal tls
 Tls_Init(heap *Heap, usize EntrySize)
 {
@@ -33,42 +81,287 @@ Tls_Init(heap *Heap, usize EntrySize)
 	Assert(EntrySize > 0);
 
 	tls Tls		  = { 0 };
-	Tls.ThreadMap = HashMap_Init(Heap, sizeof(s32), EntrySize);
+	Tls.Heap	  = Heap;
+	Tls.EntrySize = EntrySize;
+	Tls.Tables	  = Tls_CreateTable(&Tls, TLS_INITIAL_CAPACITY);
 	return Tls;
 }
 
+internal u32
+Tls_HashThreadId(s32 ThreadId, u32 Capacity)
+{
+	u32 Bits;
+	Intrin_BitScanReverse32(&Bits, Capacity);
+	return ((u32) ThreadId * 0x9E3779B9) >> (32 - Bits);
+}
+
+internal vptr
+Tls_GetEntry(tls *Tls, tls_table *Table, u32 Index)
+{
+	u08 *Entries = (u08 *) Table + Tls_GetEntriesOffset(Table->Capacity);
+	return Entries + Index * Tls_GetEntryStride(Tls);
+}
+
+internal s32 *
+Tls_GetThreadIds(tls_table *Table)
+{ return (s32 *) (Table + 1); }
+
+internal b08
+Tls_FindSlot(tls *Tls, s32 ThreadId, tls_table **TableOut, u32 *IndexOut)
+{
+	volatile tls_table *Table = Tls->Tables;
+
+	for (; Table; Table = Table->Next) {
+		volatile s32 *ThreadIds = Tls_GetThreadIds((tls_table *) Table);
+		u32			  Mask		= Table->Capacity - 1;
+		u32			  Index		= Tls_HashThreadId(ThreadId, Table->Capacity);
+
+		for (u32 I = 0; I < Table->Capacity; I++, Index = (Index + 1) & Mask) {
+			if (ThreadIds[Index] == ThreadId) {
+				*TableOut = (tls_table *) Table;
+				*IndexOut = Index;
+				return TRUE;
+			}
+			if (!ThreadIds[Index]) break;
+		}
+	}
+
+	return FALSE;
+}
+
+// Turns a committed slot back into a removed one, unless someone else already
+// did. Whoever does it gives the slot back to the table's count.
+internal b08
+Tls_ReleaseSlot(tls_table *Table, u32 Index, s32 ThreadId)
+{
+	u32 *Slot = (u32 *) Tls_GetThreadIds(Table) + Index;
+	if (Intrin_CompareExchange32(Slot, ThreadId, TLS_REMOVED) != (u32) ThreadId)
+		return FALSE;
+	Intrin_AtomicAdd32(&Table->UsedCount, -1);
+	return TRUE;
+}
+
+// Gives up a claim that didn't commit, whether or not it was cleared.
+internal void
+Tls_DropClaim(tls_table *Table, u32 Index)
+{
+	volatile s32 *ThreadIds = Tls_GetThreadIds(Table);
+	ThreadIds[Index]		= TLS_REMOVED;
+	Intrin_AtomicAdd32(&Table->UsedCount, -1);
+}
+
+// Claims the first free or removed slot along the thread's probe, in the first
+// table with room. Counting the slot up front guarantees one will be free.
+internal void
+Tls_ClaimSlot(tls *Tls, s32 Pending, tls_table **TableOut, u32 *IndexOut)
+{
+	s32		   ThreadId = Pending & ~TLS_PENDING;
+	tls_table *Table	= Tls->Tables;
+
+	for (;; Table = ((volatile tls_table *) Table)->Next) {
+		u32 Capacity = Table->Capacity;
+		if (Intrin_AtomicAdd32(&Table->UsedCount, 1) < Capacity / 2) {
+			volatile s32 *ThreadIds = Tls_GetThreadIds(Table);
+			u32			  Index		= Tls_HashThreadId(ThreadId, Capacity);
+
+			for (;; Index = (Index + 1) & (Capacity - 1)) {
+				s32 Id = ThreadIds[Index];
+				if (Id && Id != TLS_REMOVED) continue;
+				u32 *Slot = (u32 *) &ThreadIds[Index];
+				if (Intrin_CompareExchange32(Slot, Id, Pending) == (u32) Id)
+					break;
+			}
+
+			*TableOut = Table;
+			*IndexOut = Index;
+			return;
+		}
+		Intrin_AtomicAdd32(&Table->UsedCount, -1);
+
+		if (!((volatile tls_table *) Table)->Next) {
+			tls_table *Next = Tls_CreateTable(Tls, 2 * Capacity);
+			if (Intrin_CompareExchange64((u64 *) &Table->Next, 0, (u64) Next))
+				Heap_FreeA(Next);
+		}
+	}
+}
+
+// Checks a pending claim against every other claim along the thread's probe,
+// which covers everywhere a claim for it could be. A committed claim always
+// wins. Between pending ones, the first along the probe wins, and clears the
+// others, so they can't commit. Returns whether the claim still stands.
+internal b08
+Tls_CheckClaim(tls *Tls, s32 Pending, tls_table *OwnTable, u32 OwnIndex)
+{
+	s32					ThreadId = Pending & ~TLS_PENDING;
+	b08					IsFirst	 = TRUE;
+	volatile tls_table *Table	 = Tls->Tables;
+
+	for (; Table; Table = Table->Next) {
+		volatile s32 *ThreadIds = Tls_GetThreadIds((tls_table *) Table);
+		u32			  Mask		= Table->Capacity - 1;
+		u32			  Index		= Tls_HashThreadId(ThreadId, Table->Capacity);
+
+		for (u32 I = 0; I < Table->Capacity; I++, Index = (Index + 1) & Mask) {
+			s32 Id = ThreadIds[Index];
+			if (!Id) break;
+			if (Table == OwnTable && Index == OwnIndex) IsFirst = FALSE;
+			else if (Id == ThreadId) return FALSE;
+			else if (Id == Pending) {
+				if (IsFirst) {
+					// Wait for the earlier claim to commit or be cleared.
+					while (ThreadIds[Index] == Pending) Intrin_Pause();
+					return FALSE;
+				}
+				u32 *Slot = (u32 *) &ThreadIds[Index];
+				u32	 Old  = Intrin_CompareExchange32(Slot, Pending, TLS_CLEARED);
+				if (Old == (u32) ThreadId) return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+// Finds the entry for a thread, claiming a slot if Insert is set. Returns NULL
+// if the thread isn't registered and Insert is not set. A thread registering
+// itself can race another thread registering it through its handle, so claims
+// go through Tls_CheckClaim, and only one of them commits.
+internal vptr
+Tls_FindEntry(tls *Tls, s32 ThreadId, b08 Insert)
+{
+	Assert(ThreadId > 0 && ThreadId < TLS_PENDING);
+
+	s32 Pending = ThreadId | TLS_PENDING;
+	for (;;) {
+		tls_table *Table;
+		u32		   Index;
+		if (Tls_FindSlot(Tls, ThreadId, &Table, &Index))
+			return Tls_GetEntry(Tls, Table, Index);
+		if (!Insert) return NULL;
+
+		Tls_ClaimSlot(Tls, Pending, &Table, &Index);
+		if (Tls_CheckClaim(Tls, Pending, Table, Index)) {
+			u32 *Slot = (u32 *) Tls_GetThreadIds(Table) + Index;
+			u32	 Old  = Intrin_CompareExchange32(Slot, Pending, ThreadId);
+			if (Old == (u32) Pending) return Tls_GetEntry(Tls, Table, Index);
+		}
+
+		// Another claim won, so this one is dropped, and the search finds the
+		// winner.
+		Tls_DropClaim(Table, Index);
+	}
+}
+
 internal vptr
 Tls_Get(tls *Tls, thread_handle *Thread)
 {
 	Assert(Tls);
-	Assert(Tls->ThreadMap.Data);
+	Assert(Tls->Tables);
 
-	s32	 ThreadId = Platform_GetThreadId(Thread);
-	vptr Entry	  = HashMap_GetRef(&Tls->ThreadMap, &ThreadId);
-	if (Entry) return Entry;
-
-	return HashMap_Add(&Tls->ThreadMap, &ThreadId, NULL);
+	s32 ThreadId = Platform_GetThreadId(Thread);
+	return Tls_FindEntry(Tls, ThreadId, TRUE);
 }
 
 internal b08
 Tls_Set(tls *Tls, vptr Entry, thread_handle *Thread)
 {
 	Assert(Tls);
-	Assert(Tls->ThreadMap.Data);
+	Assert(Tls->Tables);
 	Assert(Entry);
 
-	s32 ThreadId = Platform_GetThreadId(Thread);
-	return HashMap_Add(&Tls->ThreadMap, &ThreadId, Entry) != NULL;
+	s32	 ThreadId = Platform_GetThreadId(Thread);
+	vptr Dest	  = Tls_FindEntry(Tls, ThreadId, TRUE);
+	Mem_Cpy(Dest, Entry, Tls->EntrySize);
+	return TRUE;
 }
 
 internal b08
 Tls_Remove(tls *Tls, thread_handle *Thread)
 {
 	Assert(Tls);
-	Assert(Tls->ThreadMap.Data);
+	Assert(Tls->Tables);
 
-	s32 ThreadId = Platform_GetThreadId(Thread);
-	return HashMap_Remove(&Tls->ThreadMap, &ThreadId, NULL, NULL);
+	// The slot is marked removed rather than emptied, since other threads
+	// could be probing past it. Claims can reuse it, and expect its entry to
+	// be zeroed, like a new table's.
+	s32		   ThreadId = Platform_GetThreadId(Thread);
+	tls_table *Table;
+	u32		   Index;
+	if (!Tls_FindSlot(Tls, ThreadId, &Table, &Index)) return FALSE;
+
+	Mem_Set(Tls_GetEntry(Tls, Table, Index), 0, Tls->EntrySize);
+	return Tls_ReleaseSlot(Table, Index, ThreadId);
+}
+
+
+#define TLS_TEST_ID_COUNT 512
+
+typedef struct tls_test_thread {
+	tls	*Tls;
+	vptr Self;
+	vptr Entries[TLS_TEST_ID_COUNT];
+} tls_test_thread;
+
+// Registers itself while the test registers it through its handle, then
+// registers the same made-up ids as every other test thread.
+internal s32
+Tls_TestThread(vptr Param)
+{
+	tls_test_thread *Test = Param;
+	Test->Self			  = Tls_Get(Test->Tls, NULL);
+	for (u32 I = 0; I < TLS_TEST_ID_COUNT; I++) {
+		thread_handle Thread = { .ThreadId = 1000000 + I };
+		Test->Entries[I]	 = Tls_Get(Test->Tls, &Thread);
+	}
+	return 0;
 }
 
+#ifndef REGION_TLS_TESTS
+
+#define TLS_TESTS                                                             \
+	TEST(Tls_Remove, ReusesSlots, (                                           \
+		u32 HeapSize = 64 * 1024;                                             \
+		heap *Heap = Heap_Init(Stack_Allocate(HeapSize), HeapSize);           \
+		tls Tls = Tls_Init(Heap, sizeof(u64));                                \
+		for (s32 Id = 1; Id <= 20000; Id++) {                                 \
+			thread_handle Thread = { .ThreadId = Id };                        \
+			u64 *Entry = Tls_Get(&Tls, &Thread);                              \
+			Assert(*Entry == 0);                                              \
+			*Entry = Id;                                                      \
+			if (Id > 16) {                                                    \
+				thread_handle Old = { .ThreadId = Id - 16 };                  \
+				Assert(*(u64 *) Tls_Get(&Tls, &Old) == Id - 16);              \
+				b08 Removed = Tls_Remove(&Tls, &Old);                         \
+				Assert(Removed);                                              \
+			}                                                                 \
+		}                                                                     \
+		/* Only 16 threads are ever live, so one table is enough */           \
+		Assert(!Tls.Tables->Next);                                            \
+		Assert(Tls.Tables->UsedCount == 16);                                  \
+	))                                                                        \
+	TEST(Tls_Get, AgreesAcrossThreads, (                                      \
+		/* Scratch memory isn't aligned, and the slots are shared atomics */  \
+		heap *Heap = Heap_Reserve(1024 * 1024);                               \
+		tls Tls = Tls_Init(Heap, sizeof(u64));                                \
+		tls_test_thread Tests[8];                                             \
+		thread_handle Threads[8];                                             \
+		vptr Entries[8];                                                      \
+		for (u32 I = 0; I < 8; I++) {                                         \
+			Tests[I].Tls = &Tls;                                              \
+			Platform_CreateThread(Threads + I, Tls_TestThread, Tests + I);    \
+			Entries[I] = Tls_Get(&Tls, Threads + I);                          \
+		}                                                                     \
+		for (u32 I = 0; I < 8; I++) {                                         \
+			Platform_JoinThread(Threads[I]);                                  \
+			Assert(Tests[I].Self == Entries[I]);                              \
+			for (u32 J = 0; J < TLS_TEST_ID_COUNT; J++)                       \
+				Assert(Tests[I].Entries[J] == Tests[0].Entries[J]);           \
+		}                                                                     \
+		Platform_FreeMemory(Heap, Heap_GetStats(Heap).ReservedSize);          \
+	))                                                                        \
+	//
+
+#endif
+
 #endif